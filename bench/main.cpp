@@ -0,0 +1,503 @@
+// QuickEditsBench: times the image pipeline on the offscreen platform and prints JSON.
+//
+//   QuickEditsBench [--iterations N] [--sizes 1,12,24] [--fonts N] [--output results.json]
+//
+// Every benchmark reports min/median/mean wall time in milliseconds over N runs.
+
+#include "exportjob.h"
+#include "fontcache.h"
+#include "imagecache.h"
+#include "imagestore.h"
+#include "jpegtransform.h"
+#include "layerindex.h"
+#include "layermodel.h"
+#include "pixelkernels.h"
+#include "resampler.h"
+#include "scenecompositor.h"
+#include "variantexportjob.h"
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFontDatabase>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QQmlComponent>
+#include <QQmlEngine>
+#include <QQuickItem>
+#include <QQuickWindow>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+namespace {
+class Bench
+{
+public:
+    explicit Bench(int iterations)
+        : m_iterations(iterations)
+    {
+    }
+
+    // setup runs before every iteration and is not timed
+    void measure(const QString& name, const QJsonObject& params, const std::function<void()>& body,
+                 const std::function<void()>& setup = {})
+    {
+        QList<double> samples;
+        for (int i = 0; i < m_iterations; ++i) {
+            if (setup) {
+                setup();
+            }
+            QElapsedTimer timer;
+            timer.start();
+            body();
+            samples.append(timer.nsecsElapsed() / 1e6);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (double sample : samples) {
+            total += sample;
+        }
+
+        QJsonObject result;
+        result["name"] = name;
+        result["params"] = params;
+        result["iterations"] = m_iterations;
+        result["min_ms"] = samples.first();
+        result["median_ms"] = samples.at(samples.size() / 2);
+        result["mean_ms"] = total / samples.size();
+        m_results.append(result);
+
+        qInfo().noquote() << QString("%1 %2: %3 ms").arg(name, QString::fromUtf8(QJsonDocument(params).toJson(QJsonDocument::Compact)))
+                                                    .arg(samples.at(samples.size() / 2), 0, 'f', 2);
+    }
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    int m_iterations;
+    QJsonArray m_results;
+};
+
+// Smooth gradients with noise, compresses roughly like a photo
+QImage syntheticPhoto(double megapixels)
+{
+    const int width = int(std::sqrt(megapixels * 1e6 * 1.5));
+    const int height = int(width / 1.5);
+    QImage image(width, height, QImage::Format_RGB32);
+
+    QRandomGenerator random(42);
+    for (int y = 0; y < height; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            int noise = int(random.bounded(16));
+            line[x] = qRgb((x * 255 / width + noise) & 0xff, (y * 255 / height + noise) & 0xff, (128 + noise) & 0xff);
+        }
+    }
+    return image;
+}
+
+QByteArray encode(const QImage& image, const char* format, int quality = -1)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, format, quality);
+    return data;
+}
+
+// Fresh store entry on every call so ImageCache cannot answer from memory
+QUrl storeUrl(const QByteArray& data)
+{
+    return ImageStore::urlForId(ImageStore::instance()->insert(data));
+}
+
+SceneDescription benchScene(const QUrl& base, const QSize& size, const QUrl& logo)
+{
+    SceneDescription scene;
+    scene.sceneSize = size;
+    scene.baseSize = size;
+    scene.baseSource = base;
+
+    for (int i = 0; i < 3; ++i) {
+        SceneLayer text;
+        text.type = SceneLayer::Text;
+        text.geometry = QRectF(size.width() * 0.1, size.height() * (0.1 + i * 0.25), size.width() * 0.6, size.height() * 0.15);
+        text.contentRect = QRectF(QPointF(0, 0), text.geometry.size());
+        text.rotation = i * 10;
+        text.text = QString("Caption %1 for the benchmark").arg(i + 1);
+        text.font = QFont("Roboto");
+        text.font.setPixelSize(qMax(12, size.height() / 20));
+        text.color = Qt::white;
+        text.z = i;
+        scene.layers.append(text);
+    }
+
+    SceneLayer image;
+    image.type = SceneLayer::Image;
+    image.geometry = QRectF(size.width() * 0.7, size.height() * 0.7, size.width() * 0.25, size.height() * 0.25);
+    image.contentRect = QRectF(QPointF(0, 0), image.geometry.size());
+    image.source = logo;
+    image.z = 3;
+    scene.layers.append(image);
+    return scene;
+}
+
+bool runExport(const SceneDescription& scene, const QSize& size, const QString& format, const QString& filePath)
+{
+    ExportJob job(scene, size, format);
+    job.setOutputFile(filePath);
+
+    bool success = false;
+    QEventLoop loop;
+    QObject::connect(&job, &ExportJob::finished, &loop, [&](bool ok) {
+        success = ok;
+        loop.quit();
+    });
+    job.start();
+    loop.exec();
+    return success;
+}
+
+bool runVariantExport(const SceneDescription& scene, const QList<ExportVariant>& variants)
+{
+    VariantExportJob job(scene, variants);
+
+    bool success = false;
+    QEventLoop loop;
+    QObject::connect(&job, &VariantExportJob::finished, &loop, [&](bool ok) {
+        success = ok;
+        loop.quit();
+    });
+    job.start();
+    loop.exec();
+    return success;
+}
+
+// Same layers as benchScene, drawn by the Qt Quick scene graph instead of QPainter
+const char* GrabScene = R"(
+import QtQuick
+Item {
+    property url source
+    Image { anchors.fill: parent; source: parent.source }
+    Repeater {
+        model: 3
+        Text {
+            x: parent.width * 0.1; y: parent.height * (0.1 + index * 0.25)
+            width: parent.width * 0.6; height: parent.height * 0.15
+            rotation: index * 10; wrapMode: Text.Wrap
+            text: "Caption " + (index + 1) + " for the benchmark"
+            font.family: "Roboto"; font.pixelSize: Math.max(12, parent.height / 20); color: "white"
+        }
+    }
+}
+)";
+}
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    // Software rendering keeps grab timings comparable between machines with and without a GPU
+    QQuickWindow::setGraphicsApi(QSGRendererInterface::Software);
+
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("Odizinne");
+    app.setApplicationName("QuickEditsBench");
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the QuickEdits image pipeline, results are printed as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption("iterations", "Runs per benchmark.", "count", "5");
+    QCommandLineOption sizesOption("sizes", "Comma separated image sizes in megapixels.", "list", "1,12,24");
+    QCommandLineOption fontsOption("fonts", "Number of stored fonts for the font benchmarks.", "count", "20");
+    QCommandLineOption outputOption("output", "Write the JSON to this file instead of stdout.", "file");
+    parser.addOptions({ iterationsOption, sizesOption, fontsOption, outputOption });
+    parser.process(app);
+
+    QFontDatabase::addApplicationFont(":/fonts/Roboto-Regular.ttf");
+
+    Bench bench(qMax(1, parser.value(iterationsOption).toInt()));
+    QTemporaryDir tempDir;
+
+    const QStringList sizes = parser.value(sizesOption).split(',', Qt::SkipEmptyParts);
+    for (const QString& sizeText : sizes) {
+        const double megapixels = sizeText.toDouble();
+        if (megapixels <= 0) {
+            continue;
+        }
+
+        const QImage photo = syntheticPhoto(megapixels);
+        const QByteArray jpeg = encode(photo, "JPEG", 90);
+        const QByteArray png = encode(photo, "PNG");
+        const QUrl logo = storeUrl(encode(photo.scaled(512, 512, Qt::KeepAspectRatio, Qt::SmoothTransformation), "PNG"));
+        const QJsonObject params {
+            { "megapixels", megapixels },
+            { "width", photo.width() },
+            { "height", photo.height() }
+        };
+
+        // Decode
+        QUrl url;
+        bench.measure("decode.jpeg", params, [&]() { ImageCache::decode(url); }, [&]() { url = storeUrl(jpeg); });
+        bench.measure("decode.png", params, [&]() { ImageCache::decode(url); }, [&]() { url = storeUrl(png); });
+
+        // Resample: the mip chain built from an already decoded level 0
+        bench.measure("resample.mip3", params, [&]() { ImageCache::instance()->image(url, 3); }, [&]() {
+            url = storeUrl(jpeg);
+            ImageCache::instance()->image(url, 0);
+        });
+
+        // Export scaling to a quarter of the width: Qt's smooth scale vs the banded Lanczos resampler
+        const QImage photoPremultiplied = photo.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        const QSize quarter = photo.size() / 4;
+        bench.measure("resample.qt_smooth_quarter", params, [&]() {
+            photoPremultiplied.scaled(quarter, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        });
+        bench.measure("resample.lanczos_quarter", params, [&]() {
+            Resampler::resize(photoPremultiplied, quarter, Resampler::Lanczos3);
+        });
+
+        // Quarter turn of a JPEG: decode, rotate and re-encode vs the lossless DCT domain rotation.
+        // Cropped to whole 16x16 MCUs, which the lossless path needs.
+        const QByteArray alignedJpeg = encode(photo.copy(0, 0, photo.width() & ~15, photo.height() & ~15), "JPEG", 90);
+        bench.measure("rotate.jpeg_reencode", params, [&]() {
+            encode(ImageCache::decode(url).transformed(QTransform().rotate(90)), "JPEG", 90);
+        }, [&]() { url = storeUrl(alignedJpeg); });
+        bench.measure("rotate.jpeg_lossless", params, [&]() {
+            if (JpegTransform::rotate(alignedJpeg, 1).isEmpty()) {
+                qWarning() << "Lossless rotation refused the benchmark JPEG";
+            }
+        });
+
+        // WASM upload paths: base64 through JS strings as before, raw bytes into the store now
+        bench.measure("upload.base64_roundtrip", params, [&]() {
+            QByteArray decoded = QByteArray::fromBase64(jpeg.toBase64());
+            Q_UNUSED(decoded)
+        });
+        bench.measure("upload.raw_store", params, [&]() {
+            QString id = ImageStore::instance()->insert(jpeg);
+            QByteArray data = ImageStore::instance()->data(id);
+            Q_UNUSED(data)
+            ImageStore::instance()->remove(id);
+        });
+
+        // Composite: QPainter export path vs the scene graph grab the exporter used to rely on
+        const QUrl base = storeUrl(jpeg);
+        const SceneDescription scene = benchScene(base, photo.size(), logo);
+        SceneCompositor compositor(scene);
+        compositor.prepare(photo.size());
+        bench.measure("composite.cpu", params, [&]() { compositor.render(photo.size()); });
+
+        const QString basePath = tempDir.filePath("base.jpg");
+        QFile baseFile(basePath);
+        if (baseFile.open(QIODevice::WriteOnly)) {
+            baseFile.write(jpeg);
+            baseFile.close();
+        }
+        QQmlEngine engine;
+        QQmlComponent component(&engine);
+        component.setData(GrabScene, QUrl());
+        QQuickWindow window;
+        window.resize(photo.size());
+        std::unique_ptr<QObject> root(component.createWithInitialProperties({ { "source", QUrl::fromLocalFile(basePath) } }));
+        if (QQuickItem* item = qobject_cast<QQuickItem*>(root.get())) {
+            item->setParentItem(window.contentItem());
+            item->setSize(photo.size());
+            window.show();
+            bench.measure("composite.grab", params, [&]() { window.grabWindow(); });
+        } else {
+            qWarning() << "Grab scene failed:" << component.errorString();
+        }
+
+        // Export format conversion: Qt's generic converters vs the pixel kernels
+        const QImage frame = compositor.render(photo.size());
+        QJsonObject kernelParams = params;
+        kernelParams["isa"] = PixelKernels::instructionSet();
+        bench.measure("convert.qt_unpremultiply", params, [&]() { frame.convertToFormat(QImage::Format_RGBA8888); });
+        bench.measure("convert.kernel_unpremultiply", kernelParams, [&]() {
+            QByteArray row(frame.width() * 4, Qt::Uninitialized);
+            for (int y = 0; y < frame.height(); ++y) {
+                PixelKernels::unpremultiplyToRgba8888(reinterpret_cast<const QRgb*>(frame.constScanLine(y)),
+                                                      reinterpret_cast<uchar*>(row.data()), frame.width());
+            }
+        });
+        bench.measure("convert.qt_rgb888", params, [&]() { frame.convertToFormat(QImage::Format_RGB888); });
+        bench.measure("convert.kernel_flatten_rgb888", kernelParams, [&]() {
+            QList<QRgb> flattened(frame.width());
+            QByteArray row(frame.width() * 3, Qt::Uninitialized);
+            for (int y = 0; y < frame.height(); ++y) {
+                PixelKernels::flattenOverMatte(reinterpret_cast<const QRgb*>(frame.constScanLine(y)),
+                                               flattened.data(), frame.width(), 0xffffffff);
+                PixelKernels::packRgb888(flattened.constData(), reinterpret_cast<uchar*>(row.data()), frame.width(), false);
+            }
+        });
+
+        // Encode every export format through the strip pipeline
+        const QStringList formats = { "PNG", "JPEG", "BMP", "WEBP" };
+        for (const QString& format : formats) {
+            QJsonObject formatParams = params;
+            formatParams["format"] = format;
+            const QString filePath = tempDir.filePath("export." + format.toLower());
+            bench.measure("export." + format.toLower(), formatParams, [&]() {
+                if (!runExport(scene, photo.size(), format, filePath)) {
+                    qWarning() << "Export failed for" << format;
+                }
+            });
+        }
+
+        // Full size PNG, 2048px JPEG and 512px WebP: one job per file vs one composite for all
+        auto longEdge = [&](int edge) {
+            edge = qMin(edge, qMax(photo.width(), photo.height()));
+            return photo.size().scaled(edge, edge, Qt::KeepAspectRatio);
+        };
+        const QList<ExportVariant> variants = {
+            { "full.png", "PNG", photo.size(), -1 },
+            { "web.jpg", "JPEG", longEdge(2048), 90 },
+            { "thumb.webp", "WEBP", longEdge(512), 80 }
+        };
+        bench.measure("export.variants_separate", params, [&]() {
+            for (const ExportVariant& variant : variants) {
+                runExport(scene, variant.size, variant.format, tempDir.filePath(variant.fileName));
+            }
+        });
+        bench.measure("export.variants_single_pass", params, [&]() {
+            if (!runVariantExport(scene, variants)) {
+                qWarning() << "Variant export failed";
+            }
+        });
+
+        ImageCache::instance()->setCacheLimit(0);
+        ImageCache::instance()->setCacheLimit(512ll * 1024 * 1024);
+    }
+
+    // Layer dragging: one drag of 100 pointer moves, each updating the index and snapping.
+    // The time per drag should barely change between a few layers and many.
+    for (int layerCount : { 50, 500 }) {
+        QQuickItem canvas;
+        canvas.setSize(QSizeF(4000, 3000));
+        QRandomGenerator random(7);
+        for (int i = 0; i < layerCount; ++i) {
+            QQuickItem* layer = new QQuickItem(&canvas);
+            layer->setPosition(QPointF(random.bounded(3700), random.bounded(2800)));
+            layer->setSize(QSizeF(100 + random.bounded(200), 40 + random.bounded(160)));
+            layer->setRotation(random.bounded(4) == 0 ? random.bounded(360) : 0);
+            LayerModel::instance()->add(layer, LayerModel::Text);
+        }
+
+        QQuickItem* dragged = LayerModel::instance()->itemAt(0);
+        const QJsonObject layerParams { { "layers", layerCount }, { "moves", 100 } };
+        bench.measure("layers.drag_snap", layerParams, [&]() {
+            for (int step = 0; step < 100; ++step) {
+                dragged->setPosition(QPointF(200 + step * 30, 150 + step * 20));
+                const QVariantMap snapped = LayerIndex::instance()->snap(dragged, dragged->x(), dragged->y(), 6);
+                dragged->setPosition(QPointF(snapped.value("x").toReal(), snapped.value("y").toReal()));
+            }
+        });
+        bench.measure("layers.hit_test", layerParams, [&]() {
+            for (int step = 0; step < 100; ++step) {
+                LayerIndex::instance()->layerAt(step * 40, step * 30);
+            }
+        });
+    }
+
+    // Fonts: the old startup decoded and registered every stored font from base64 settings,
+    // now startup only reads an index and a font is registered when it is first used
+    QFile fontFile(":/fonts/Roboto-Regular.ttf");
+    fontFile.open(QIODevice::ReadOnly);
+    const QByteArray fontData = fontFile.readAll();
+    const int fontCount = qMax(1, parser.value(fontsOption).toInt());
+    const QJsonObject fontParams { { "fonts", fontCount }, { "bytes", fontData.size() } };
+
+    QSettings settings;
+    settings.beginGroup("CustomFonts");
+    for (int i = 0; i < fontCount; ++i) {
+        settings.setValue(QString("Font %1").arg(i), fontData.toBase64());
+    }
+    settings.endGroup();
+    settings.sync();
+
+    QList<int> registered;
+    bench.measure("fonts.startup_base64", fontParams, [&]() {
+        QSettings stored;
+        stored.beginGroup("CustomFonts");
+        const QStringList families = stored.childKeys();
+        for (const QString& family : families) {
+            registered.append(QFontDatabase::addApplicationFontFromData(QByteArray::fromBase64(stored.value(family).toByteArray())));
+        }
+    }, [&]() {
+        for (int id : std::as_const(registered)) {
+            QFontDatabase::removeApplicationFont(id);
+        }
+        registered.clear();
+    });
+    for (int id : std::as_const(registered)) {
+        QFontDatabase::removeApplicationFont(id);
+    }
+    registered.clear();
+
+    const QString key = FontCache::instance()->insert(fontData);
+    settings.remove("CustomFonts");
+    settings.beginGroup("FontCache");
+    for (int i = 0; i < fontCount; ++i) {
+        settings.setValue(QString("Font %1").arg(i), key);
+    }
+    settings.endGroup();
+    settings.sync();
+
+    bench.measure("fonts.startup_index", fontParams, [&]() {
+        QSettings stored;
+        stored.beginGroup("FontCache");
+        const QStringList families = stored.childKeys();
+        for (const QString& family : families) {
+            QString fontKey = stored.value(family).toString();
+            Q_UNUSED(fontKey)
+        }
+    });
+    bench.measure("fonts.first_use", fontParams, [&]() {
+        registered.append(QFontDatabase::addApplicationFontFromData(FontCache::instance()->data(key)));
+    }, [&]() {
+        for (int id : std::as_const(registered)) {
+            QFontDatabase::removeApplicationFont(id);
+        }
+        registered.clear();
+    });
+    settings.clear();
+
+    QJsonObject system {
+        { "cpu", QSysInfo::currentCpuArchitecture() },
+        { "os", QSysInfo::prettyProductName() },
+        { "threads", QThread::idealThreadCount() },
+        { "qt", QString(qVersion()) }
+    };
+    QJsonObject report {
+        { "system", system },
+        { "benchmarks", bench.results() }
+    };
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly) || output.write(json) != json.size()) {
+            qCritical() << "Could not write" << output.fileName();
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef ADJUSTMENTS_H
+#define ADJUSTMENTS_H
+
+#include <QImage>
+#include <QString>
+#include <QVariant>
+#include <QVariantMap>
+
+// Tonal and color adjustments of one image, applied in a fixed order:
+// blur, levels, brightness, contrast, saturation. The QML preview (AdjustmentEffect.qml and
+// shaders/adjust.frag) runs the same formulas on the GPU, apply() is what export uses.
+struct Adjustments
+{
+    qreal brightness = 0.0;     // -1..1, added to every channel
+    qreal contrast = 0.0;       // -1..1, slope around mid gray is 1 + contrast
+    qreal saturation = 0.0;     // -1..1, 0 keeps the colors, -1 is grayscale
+    qreal blackPoint = 0.0;     // levels input range, 0..1
+    qreal whitePoint = 1.0;
+    qreal gamma = 1.0;          // levels midtones
+    qreal blur = 0.0;           // Gaussian radius in pixels of the full resolution image
+
+    bool isIdentity() const;
+    bool operator==(const Adjustments& other) const;
+    bool operator!=(const Adjustments& other) const { return !(*this == other); }
+
+    // Identifies the parameters in cache keys, identical stacks give identical keys
+    QString key() const;
+
+    QVariantMap toMap() const;
+    // Accepts the QVariantMap or QJSValue a QML "var" property holds, missing values keep their default
+    static Adjustments fromVariant(const QVariant& value);
+
+    // Returns image with the adjustments applied, the image itself when there is nothing to do
+    QImage apply(const QImage& image) const;
+};
+
+#endif // ADJUSTMENTS_H
@@ -0,0 +1,51 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSizeF>
+#include <QString>
+#include <QStringList>
+#include "scenecompositor.h"
+
+// Headless "--batch" mode: applies the layers of a saved project to many images without
+// creating a window. Each image is decoded, composited and encoded by a single task and the
+// tasks are spread over all cores, so throughput grows with the number of cores.
+class BatchRenderer
+{
+public:
+    struct Job
+    {
+        QString inputPath;
+        QString outputPath;
+        // Values for the {placeholders} in text layers
+        QHash<QString, QString> fields;
+    };
+
+    BatchRenderer();
+
+    // Checked before QGuiApplication exists, batch mode forces the offscreen platform
+    static bool isBatchInvocation(int argc, char *argv[]);
+    // Parses the command line and runs the batch, returns the process exit code
+    static int run(const QStringList& arguments);
+
+    bool loadTemplate(const QString& filePath, QString* error);
+    // inputPath is a directory of images or a CSV file with an "image" column
+    bool loadJobs(const QString& inputPath, const QString& outputDirectory, const QString& format, QString* error);
+    // Returns the number of images that failed
+    int renderAll(int threadCount, int quality);
+
+private:
+    bool renderJob(const Job& job, int quality) const;
+    SceneDescription sceneForJob(const Job& job, const QSize& imageSize) const;
+
+    QByteArray m_templateData;
+    QSizeF m_templateSize;
+    // Applied to every input image like the project applied them to its base image
+    Adjustments m_baseAdjustments;
+    QList<SceneLayer> m_layers;
+    QList<Job> m_jobs;
+};
+
+#endif // BATCHRENDERER_H
@@ -0,0 +1,142 @@
+#ifndef EDITHISTORY_H
+#define EDITHISTORY_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJSValue>
+#include <QPointer>
+#include <QVariant>
+#include <QtQml/qqml.h>
+#include <memory>
+#include <vector>
+
+// One entry of the history. Commands are pushed already applied, redo() re-applies them.
+class EditCommand
+{
+public:
+    virtual ~EditCommand() = default;
+
+    virtual void undo() = 0;
+    virtual void redo() = 0;
+
+    // Approximate heap bytes held by the command, counted against the history budget
+    virtual qint64 cost() const = 0;
+
+    // Called when the command leaves the history for good, applied tells which state was kept
+    virtual void discard(bool applied) { Q_UNUSED(applied) }
+
+    QString text;
+    qint64 timestamp = 0;
+};
+
+// Stores only the properties that changed, before and after
+class PropertyCommand : public EditCommand
+{
+public:
+    struct Delta
+    {
+        QPointer<QObject> target;
+        QByteArray property;
+        QVariant before;
+        QVariant after;
+    };
+
+    void undo() override;
+    void redo() override;
+    qint64 cost() const override;
+
+    bool isNoOp() const;
+    bool canMergeWith(QObject* target, const QByteArray& property) const;
+
+    QList<Delta> deltas;
+};
+
+// Structural edits (adding, deleting, reordering layers) implemented by QML callbacks
+class ScriptCommand : public EditCommand
+{
+public:
+    void undo() override;
+    void redo() override;
+    qint64 cost() const override;
+    void discard(bool applied) override;
+
+    QJSValue undoFunction;
+    QJSValue redoFunction;
+    QJSValue discardFunction;
+    qint64 bytes = 0;
+};
+
+class EditHistory : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(bool canUndo READ canUndo NOTIFY historyChanged)
+    Q_PROPERTY(bool canRedo READ canRedo NOTIFY historyChanged)
+    Q_PROPERTY(QString undoText READ undoText NOTIFY historyChanged)
+    Q_PROPERTY(QString redoText READ redoText NOTIFY historyChanged)
+    Q_PROPERTY(bool applying READ applying NOTIFY applyingChanged)
+    Q_PROPERTY(qint64 memoryUsage READ memoryUsage NOTIFY historyChanged)
+    Q_PROPERTY(qint64 memoryBudget READ memoryBudget WRITE setMemoryBudget NOTIFY memoryBudgetChanged)
+
+public:
+    static EditHistory* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static EditHistory* instance();
+
+    bool canUndo() const { return m_index > 0; }
+    bool canRedo() const { return m_index < int(m_commands.size()); }
+    QString undoText() const;
+    QString redoText() const;
+    bool applying() const { return m_applying; }
+    qint64 memoryUsage() const { return m_memoryUsage; }
+    qint64 memoryBudget() const { return m_memoryBudget; }
+    void setMemoryBudget(qint64 bytes);
+
+    void push(std::unique_ptr<EditCommand> command);
+
+public slots:
+    void undo();
+    void redo();
+    void clear();
+
+    // Applies and records a property change, repeated changes to the same property merge
+    void setProperty(QObject* target, const QString& property, const QVariant& value, const QString& text = QString());
+    void setProperties(QObject* target, const QVariantMap& values, const QString& text = QString());
+
+    // Continuous interactions (drags, handles, sliders) become one command on endGesture()
+    void beginGesture(QObject* target, const QStringList& properties, const QString& text = QString());
+    void endGesture();
+
+    // Records an edit QML already performed, undo/redo/discard are QML functions
+    void pushAction(const QString& text, const QJSValue& undoFunction, const QJSValue& redoFunction,
+                    const QJSValue& discardFunction = QJSValue(), qint64 bytes = 0);
+
+signals:
+    void historyChanged();
+    void applyingChanged();
+    void memoryBudgetChanged();
+    // Emitted after undo or redo changed the document
+    void applied();
+
+private:
+    explicit EditHistory(QObject *parent = nullptr);
+    void setApplying(bool applying);
+    void truncateRedo();
+    void enforceBudget();
+    PropertyCommand* mergeTarget(QObject* target, const QByteArray& property);
+
+    static EditHistory* m_instance;
+    std::vector<std::unique_ptr<EditCommand>> m_commands;
+    int m_index;
+    bool m_applying;
+    qint64 m_memoryUsage;
+    qint64 m_memoryBudget;
+    int m_maxCommands;
+    QElapsedTimer m_clock;
+
+    std::unique_ptr<PropertyCommand> m_gesture;
+    bool m_lastMergeable;
+};
+
+#endif // EDITHISTORY_H
@@ -0,0 +1,59 @@
+#ifndef EXPORTJOB_H
+#define EXPORTJOB_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QRgb>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include "memorybudget.h"
+#include "scenecompositor.h"
+
+// Renders a scene in horizontal strips across a thread pool and feeds them, in order,
+// to a StripEncoder writing either to a file or to memory. Only a few strips are alive at once.
+class ExportJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    ExportJob(const SceneDescription& scene, const QSize& outputSize, const QString& format, QObject *parent = nullptr);
+    ~ExportJob() override;
+
+    // Without an output file the encoded bytes are kept in memory, see encodedData()
+    void setOutputFile(const QString& filePath);
+    // Background for transparent areas when the format has no alpha channel
+    void setMatteColor(QRgb matte);
+
+    void start();
+    void cancel();
+
+    QString format() const { return m_format; }
+    QByteArray encodedData() const { return m_encoded; }
+
+signals:
+    void progressChanged(qreal progress);
+    void finished(bool success);
+
+private:
+    bool run();
+    // Encoded file when the scene is only a JPEG base turned by quarter turns, empty otherwise
+    QByteArray losslessJpeg() const;
+    bool writeEncoded(const QByteArray& data);
+
+    SceneDescription m_scene;
+    QSize m_outputSize;
+    QString m_format;
+    QString m_filePath;
+    QRgb m_matte;
+    QByteArray m_encoded;
+    MemoryBudget::Allocation m_encodedAllocation;
+    std::atomic<bool> m_cancelled;
+    int m_stripHeight;
+
+    QThreadPool m_coordinatorPool;
+    QThreadPool m_stripPool;
+};
+
+#endif // EXPORTJOB_H
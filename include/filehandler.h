@@ -13,6 +13,9 @@ class FileHandler : public QObject
 public:
     static FileHandler* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
 
+    // Hands over the bytes of the last browser upload (WebAssembly only)
+    static QByteArray takeUpload();
+
 public slots:
     void openFileDialog();
     void openLayerImageDialog();
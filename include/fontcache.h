@@ -0,0 +1,38 @@
+#ifndef FONTCACHE_H
+#define FONTCACHE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <functional>
+
+// Font files stored as raw bytes under their SHA-1, in the app data directory on native
+// builds and in an IndexedDB backed directory on WebAssembly. Settings only keep the keys.
+class FontCache
+{
+public:
+    static FontCache* instance();
+
+    // Stores the bytes once and returns their key. Before the cache is ready the key is returned
+    // right away and the file is written once the stored entries are restored.
+    QString insert(const QByteArray& data);
+    QByteArray data(const QString& key) const;
+    void remove(const QString& key);
+
+    // WebAssembly restores the directory from IndexedDB asynchronously, native is ready at once
+    bool isReady() const { return m_ready; }
+    void whenReady(const std::function<void()>& callback);
+    void markReady();
+
+private:
+    FontCache();
+    QString pathForKey(const QString& key) const;
+    bool write(const QString& key, const QByteArray& data);
+    void persist();
+
+    QString m_directory;
+    bool m_ready;
+    QList<std::function<void()>> m_pending;
+};
+
+#endif // FONTCACHE_H
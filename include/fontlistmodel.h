@@ -0,0 +1,70 @@
+#ifndef FONTLISTMODEL_H
+#define FONTLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QColor>
+#include <QSet>
+#include <QStringList>
+#include <QtQml/qqml.h>
+
+// Font families for pickers: custom fonts first, then the system families once FontManager has
+// listed them in the background. Rows are appended in batches so thousands of families never
+// stall a frame, filter narrows the list to families starting with the given text.
+class FontListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(QString filter READ filter WRITE setFilter NOTIFY filterChanged)
+    Q_PROPERTY(bool customOnly READ customOnly WRITE setCustomOnly NOTIFY customOnlyChanged)
+    Q_PROPERTY(QColor previewColor READ previewColor WRITE setPreviewColor NOTIFY previewColorChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
+
+public:
+    enum Roles {
+        FamilyRole = Qt::UserRole + 1,
+        CustomRole,
+        PreviewRole
+    };
+
+    explicit FontListModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    QString filter() const { return m_filter; }
+    void setFilter(const QString& filter);
+    bool customOnly() const { return m_customOnly; }
+    void setCustomOnly(bool customOnly);
+    QColor previewColor() const { return m_previewColor; }
+    void setPreviewColor(const QColor& color);
+    int count() const { return m_shown; }
+    bool loading() const;
+
+    Q_INVOKABLE QString familyAt(int row) const;
+
+signals:
+    void filterChanged();
+    void customOnlyChanged();
+    void previewColorChanged();
+    void countChanged();
+    void loadingChanged();
+
+private:
+    void rebuild();
+    void appendBatch();
+    void prefetchPreviews(int from, int to) const;
+
+    QString m_filter;
+    bool m_customOnly;
+    QColor m_previewColor;
+    QSet<QString> m_customFamilies;
+    // Every family matching the filter, the first m_shown of them are rows
+    QStringList m_matches;
+    int m_shown;
+    bool m_appendQueued;
+};
+
+#endif // FONTLISTMODEL_H
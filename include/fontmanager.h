@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QtQml/qqml.h>
+#include <QHash>
+#include <QSet>
 #include <QStringList>
 #include <QSettings>
 
@@ -14,34 +16,59 @@ class FontManager : public QObject
 
     Q_PROPERTY(QStringList availableFonts READ availableFonts NOTIFY availableFontsChanged)
     Q_PROPERTY(QStringList customFontFamilies READ customFontFamilies NOTIFY customFontFamiliesChanged)
+    Q_PROPERTY(bool systemFontsReady READ systemFontsReady NOTIFY availableFontsChanged)
 
 public:
     static FontManager* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static FontManager* instance();
 
     QStringList availableFonts() const { return m_availableFonts; }
     QStringList customFontFamilies() const { return m_customFontFamilies; }
+    // System families sorted case-insensitively, empty until the background enumeration is done
+    QStringList systemFonts() const { return m_systemFonts; }
+    bool systemFontsReady() const { return m_systemFontsReady; }
+
+    // Original file bytes of a custom font, empty for system fonts
+    QByteArray loadFontFromStorage(const QString& fontFamily) const;
 
 public slots:
     void openFontDialog();
     void loadCustomFont(const QString& fontData);
+    void loadCustomFontData(const QByteArray& data);
     void removeCustomFont(const QString& fontFamily);
     void loadCustomFontFromFile(const QUrl& fileUrl);
 
+    // Registers a stored custom font the first time it is used, returns whether the family is usable
+    bool ensureFontLoaded(const QString& fontFamily);
+
 signals:
     void availableFontsChanged();
     void fontLoaded(const QString& fontFamily);
+    // A stored font requested before the font cache was ready is now registered
+    void fontRegistered(const QString& fontFamily);
     void fontRemoved(const QString& fontFamily);
     void customFontFamiliesChanged();
 
 private:
     explicit FontManager(QObject *parent = nullptr);
+    void enumerateSystemFonts();
     void refreshAvailableFonts();
-    void loadStoredFonts();
+    void loadFontIndex();
+    void migrateSettingsFonts();
     void saveFontToStorage(const QString& fontFamily, const QByteArray& fontData);
-    QByteArray loadFontFromStorage(const QString& fontFamily);
+    void trackRegistration(const QString& fontFamily, int fontId, qint64 bytes);
 
     QStringList m_availableFonts;
+    QStringList m_systemFonts;
+    bool m_systemFontsReady;
     QStringList m_customFontFamilies;
+    // Font cache key of every custom family
+    QHash<QString, QString> m_fontKeys;
+    QSet<QString> m_registeredFamilies;
+    QSet<QString> m_pendingFamilies;
+    // Font database id of every registered custom family, and the file size held per id
+    QHash<QString, int> m_fontIds;
+    QHash<int, qint64> m_fontIdBytes;
 };
 
 #endif // FONTMANAGER_H
@@ -0,0 +1,47 @@
+#ifndef FONTPREVIEW_H
+#define FONTPREVIEW_H
+
+#include <QCache>
+#include <QColor>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QUrl>
+#include <QQuickAsyncImageProvider>
+
+// Family names rendered in their own font, for font pickers. Rendering happens once per family,
+// size and color on a worker thread, after that scrolling only reuses small cached images,
+// which the scene graph packs into its shared texture atlas.
+class FontPreviewCache
+{
+public:
+    static FontPreviewCache* instance();
+
+    QImage preview(const QString& family, int height, const QColor& color);
+    // Renders previews in the background so the first rows are ready when a list opens,
+    // previews still queued from an earlier call are dropped
+    void prefetch(const QStringList& families, int height, const QColor& color);
+    // Drops least recently used previews, returns the bytes freed
+    qint64 reclaim(qint64 bytes);
+
+    // "image://fontpreview/..." url of a preview, heights come from the Image's sourceSize
+    static QUrl previewUrl(const QString& family, const QColor& color);
+
+private:
+    FontPreviewCache();
+    static QImage render(const QString& family, int height, const QColor& color);
+
+    QMutex m_mutex;
+    QCache<QString, QImage> m_cache;
+    QThreadPool m_pool;
+};
+
+class FontPreviewProvider : public QQuickAsyncImageProvider
+{
+public:
+    QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+};
+
+#endif // FONTPREVIEW_H
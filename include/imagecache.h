@@ -0,0 +1,87 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QUrl>
+#include <QQuickAsyncImageProvider>
+#include <QtQml/qqml.h>
+#include <memory>
+#include "adjustments.h"
+
+// Shared decoded-image cache. Every source is decoded once at full size, smaller
+// mip levels (1/2, 1/4, ...) and thumbnails are derived from it and cached too.
+class ImageCache : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+public:
+    static ImageCache* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static ImageCache* instance();
+
+    // Full-resolution size from the image header, without decoding pixels
+    Q_INVOKABLE QSize imageSize(const QUrl& source);
+    // "image://cache/..." url served by CachedImageProvider for the given source
+    Q_INVOKABLE QUrl cachedSource(const QUrl& source) const;
+    // Keeps an uploaded source alive while the base image or a layer shows it. The last
+    // release frees the upload and everything decoded from it, other sources are ignored.
+    Q_INVOKABLE void retain(const QUrl& source);
+    Q_INVOKABLE void release(const QUrl& source);
+
+    // Maps "image://cache/..." urls back to the source they wrap
+    static QUrl resolveSource(const QUrl& url);
+    // Uncached decode of any source the app understands (files, qrc, data urls, uploads)
+    static QImage decode(const QUrl& source);
+    // Encoded bytes of the same sources, for passing a file through without decoding it
+    static QByteArray encodedData(const QUrl& source);
+
+    QImage image(const QUrl& source, int level = 0);
+    // Full resolution pixels of rect without holding the whole image when it does not fit the
+    // cache: formats that support it decode only the region, the others are decoded once
+    QImage region(const QUrl& source, const QRect& rect);
+    QImage imageForSize(const QUrl& source, const QSize& requestedSize);
+    QImage thumbnail(const QUrl& source, const QSize& size);
+    // Full resolution with adjustments applied, cached per source and parameter set
+    QImage adjusted(const QUrl& source, const Adjustments& adjustments);
+
+    void setCacheLimit(qint64 bytes);
+    // Evicts at least bytes if there is that much, full resolution entries last. Returns what was freed.
+    qint64 reclaim(qint64 bytes);
+
+private:
+    explicit ImageCache(QObject *parent = nullptr);
+    QImage lookup(const QString& key);
+    void insert(const QString& key, const QImage& image);
+    void reportUsage();
+    // Drops last use stamps of entries no longer in the cache
+    void forgetEvicted();
+    std::shared_ptr<QMutex> decodeLock(const QString& key);
+    static QImage decodeRegion(const QUrl& url, const QRect& rect);
+
+    static ImageCache* m_instance;
+    QMutex m_mutex;
+    QCache<QString, QImage> m_cache;
+    // Milliseconds on m_clock of the last lookup or insert per key, reclaim evicts the oldest first
+    QElapsedTimer m_clock;
+    QHash<QString, qint64> m_lastUse;
+    QHash<QUrl, QSize> m_sizes;
+    QHash<QString, std::shared_ptr<QMutex>> m_decodeLocks;
+    // Last full decode too large for the cache, kept for formats without region decoding
+    QUrl m_oversizedSource;
+    QImage m_oversized;
+};
+
+class CachedImageProvider : public QQuickAsyncImageProvider
+{
+public:
+    QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requestedSize) override;
+};
+
+#endif // IMAGECACHE_H
@@ -2,10 +2,14 @@
 #define IMAGEEXPORTER_H
 
 #include <QObject>
+#include <QColor>
 #include <QQuickItem>
 #include <QUrl>
+#include <QVariantList>
 #include <QtQml/qqml.h>
-#include <QImage>
+#include "scenecompositor.h"
+#include "exportjob.h"
+#include "variantexportjob.h"
 
 class ImageExporter : public QObject
 {
@@ -13,24 +17,60 @@ class ImageExporter : public QObject
     QML_ELEMENT
     QML_SINGLETON
 
+    Q_PROPERTY(bool exporting READ exporting NOTIFY exportingChanged)
+    Q_PROPERTY(qreal exportProgress READ exportProgress NOTIFY exportProgressChanged)
+    Q_PROPERTY(QColor matteColor READ matteColor WRITE setMatteColor NOTIFY matteColorChanged)
+
 public:
     static ImageExporter* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
     static ImageExporter* instance();
 
+    bool exporting() const { return m_exportJob != nullptr || m_variantJob != nullptr; }
+    qreal exportProgress() const { return m_exportProgress; }
+    QColor matteColor() const { return m_matteColor; }
+    void setMatteColor(const QColor& color);
+
+    // Hands encoded bytes to the browser as a file download (WebAssembly only)
+    void downloadData(const QByteArray& data, const QString& fileName, const QString& mimeType);
+
 public slots:
     void saveImage(QQuickItem* imageContainer, const QUrl& fileUrl);
     void openSaveDialog(QQuickItem* imageContainer);
     void saveGrabbedImage(const QString& fileName);
-    void grabImageAndSave(const QString& fileName, int targetWidth, int targetHeight);
+    // variants adds more outputs of the same capture: maps with "format" (file extension),
+    // "size" (long edge in pixels, at most the target size) and "quality"
+    void grabImageAndSave(const QString& fileName, int targetWidth, int targetHeight,
+                          const QVariantList& variants = QVariantList());
+    void cancelExport();
 
 signals:
     void saveFileSelected(const QString& fileName, int originalWidth, int originalHeight);
+    void exportStarted(const QString& fileName);
+    void exportFinished(bool success, const QString& fileName);
+    void exportingChanged();
+    void exportProgressChanged();
+    void matteColorChanged();
 
 private:
     explicit ImageExporter(QObject *parent = nullptr);
+    void startExport(const QString& filePath, const QString& fileName);
+    void startVariantExport(const QString& filePath, const QString& fileName);
+    QList<ExportVariant> variantsFor(const QString& fileName) const;
+    void prepareDownload(const QString& fileName, const QString& mimeType);
+    void discardDownload();
+    static QString formatForPath(const QString& filePath);
+    static QString mimeTypeForFormat(const QString& format);
+    static QString archiveNameFor(const QString& fileName);
+
     static ImageExporter* m_instance;
-    QImage m_grabbedImage;
     QQuickItem* m_imageContainer;
+    SceneDescription m_pendingScene;
+    QSize m_pendingSize;
+    QVariantList m_pendingVariants;
+    ExportJob* m_exportJob;
+    VariantExportJob* m_variantJob;
+    qreal m_exportProgress;
+    QColor m_matteColor;
 };
 
 #endif // IMAGEEXPORTER_H
@@ -0,0 +1,48 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QUrl>
+#include <QQuickImageProvider>
+
+// Holds encoded image files that only exist in memory (WASM uploads), addressed
+// by "image://uploads/<id>" so QML and the compositor share one copy of the bytes
+class ImageStore
+{
+public:
+    static ImageStore* instance();
+
+    QString insert(const QByteArray& data);
+    QByteArray data(const QString& id) const;
+    void remove(const QString& id);
+    // Counts the base image and layers showing an entry, the last release removes it.
+    // Returns true when it did.
+    void retain(const QString& id);
+    bool release(const QString& id);
+
+    static QUrl urlForId(const QString& id);
+    static bool isStoreUrl(const QUrl& url);
+    static QString idForUrl(const QUrl& url);
+
+private:
+    ImageStore() = default;
+
+    mutable QMutex m_mutex;
+    QHash<QString, QByteArray> m_data;
+    QHash<QString, int> m_users;
+    qint64 m_bytes = 0;
+    quint64 m_nextId = 1;
+};
+
+class UploadImageProvider : public QQuickImageProvider
+{
+public:
+    UploadImageProvider();
+
+    QImage requestImage(const QString& id, QSize* size, const QSize& requestedSize) override;
+};
+
+#endif // IMAGESTORE_H
@@ -0,0 +1,71 @@
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <QObject>
+#include <QPointer>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+class QRunnable;
+
+// Shared worker pool for decoding, encoding and other jobs that must not run on the GUI thread.
+// Jobs run on the global thread pool, which resampling bands use as well. On WebAssembly the
+// worker count is part of the pthread pool the page preallocates (see QUICKEDITS_WASM_WORKERS
+// in CMakeLists.txt), so jobs never wait for a new worker to be spawned by the browser. The
+// web build is a pthread build and needs SharedArrayBuffer, so it must be served cross-origin
+// isolated (Cross-Origin-Opener-Policy: same-origin, Cross-Origin-Embedder-Policy: require-corp).
+class JobScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static JobScheduler* instance();
+
+    // Threads a pool doing this kind of work should use at most
+    int workerCount() const { return m_workerCount; }
+
+    void start(QRunnable* runnable);
+    void start(std::function<void()> job);
+
+    // Runs work on a worker and passes its result to then on the GUI thread,
+    // then is skipped when context was destroyed in the meantime
+    template <typename Work, typename Then>
+    void run(QObject* context, Work work, Then then);
+
+    // Calls step on a worker until it returns true, then done on the GUI thread
+    void runChunked(QObject* context, std::function<bool()> step, std::function<void()> done);
+
+private:
+    explicit JobScheduler(QObject *parent = nullptr);
+
+    static JobScheduler* m_instance;
+    int m_workerCount;
+};
+
+template <typename Work, typename Then>
+void JobScheduler::run(QObject* context, Work work, Then then)
+{
+    using Result = std::invoke_result_t<Work>;
+    QPointer<QObject> guard(context);
+
+    start([this, guard, work = std::move(work), then = std::move(then)]() mutable {
+        if constexpr (std::is_void_v<Result>) {
+            work();
+            QMetaObject::invokeMethod(this, [guard, then]() {
+                if (guard) {
+                    then();
+                }
+            }, Qt::QueuedConnection);
+        } else {
+            Result result = work();
+            QMetaObject::invokeMethod(this, [guard, then, result = std::move(result)]() {
+                if (guard) {
+                    then(result);
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+#endif // JOBSCHEDULER_H
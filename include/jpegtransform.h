@@ -0,0 +1,22 @@
+#ifndef JPEGTRANSFORM_H
+#define JPEGTRANSFORM_H
+
+#include <QByteArray>
+#include <QSize>
+
+// Lossless quarter turn rotation of baseline JPEG files, the jpegtran approach: the quantized
+// DCT coefficients are rearranged block by block, nothing is decoded to pixels or quantized again.
+class JpegTransform
+{
+public:
+    static bool isJpeg(const QByteArray& data);
+
+    // Rotates clockwise by quarterTurns * 90 degrees, on top of the EXIF orientation which is
+    // folded in and reset to normal. size receives the pixel size of the result.
+    // Returns an empty array when this cannot be done losslessly (progressive or arithmetic coding,
+    // mirrored orientations, partial edge blocks that would end up inside the image),
+    // the caller then decodes and re-encodes as usual.
+    static QByteArray rotate(const QByteArray& jpeg, int quarterTurns, QSize* size = nullptr);
+};
+
+#endif // JPEGTRANSFORM_H
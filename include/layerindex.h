@@ -0,0 +1,67 @@
+#ifndef LAYERINDEX_H
+#define LAYERINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPointF>
+#include <QPolygonF>
+#include <QQuickItem>
+#include <QRect>
+#include <QRectF>
+#include <QVariantMap>
+#include <QtQml/qqml.h>
+
+// Uniform grid over the bounding boxes of the layers in LayerModel, kept up to date as layers
+// move, resize and rotate. Hit testing and snapping only look at the cells around the point or
+// the dragged layer, so their cost depends on how crowded that area is, not on the layer count.
+class LayerIndex : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+public:
+    static LayerIndex* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static LayerIndex* instance();
+
+    // Topmost layer whose rotated outline contains the point, in the coordinates of the layer
+    // parent. With below set, the next layer under it at that point, wrapping to the top.
+    Q_INVOKABLE QQuickItem* layerAt(qreal x, qreal y, QQuickItem* below = nullptr) const;
+
+    // Position for item near (x, y) that lines its bounding box edges or center up with other
+    // layers or the canvas, within threshold. Returns x, y and guides, a list of
+    // { vertical, position } for the lines that were snapped to.
+    Q_INVOKABLE QVariantMap snap(QQuickItem* item, qreal x, qreal y, qreal threshold) const;
+
+    int size() const { return int(m_entries.size()); }
+
+private slots:
+    void layerGeometryChanged();
+
+private:
+    struct Entry
+    {
+        QPolygonF outline;
+        QRectF bounds;
+        QRect cells;
+    };
+
+    explicit LayerIndex(QObject *parent = nullptr);
+    void insert(QQuickItem* item);
+    void remove(QQuickItem* item);
+    void update(QQuickItem* item);
+    void addToCells(QQuickItem* item, const QRect& cells);
+    void removeFromCells(QQuickItem* item, const QRect& cells);
+    // Every layer with a cell in the range, each listed once
+    QList<QQuickItem*> layersIn(const QRect& cells) const;
+
+    static QPolygonF outlineOf(QQuickItem* item);
+    static QRect cellsFor(const QRectF& bounds);
+
+    static LayerIndex* m_instance;
+    QHash<QQuickItem*, Entry> m_entries;
+    QHash<quint64, QList<QQuickItem*>> m_cells;
+};
+
+#endif // LAYERINDEX_H
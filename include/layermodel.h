@@ -0,0 +1,103 @@
+#ifndef LAYERMODEL_H
+#define LAYERMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QList>
+#include <QQuickItem>
+#include <QtQml/qqml.h>
+
+// Text and image layers of the document, row 0 is the topmost layer.
+// Every layer gets an id that stays the same for the lifetime of its item.
+class LayerModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(QQuickItem* selectedItem READ selectedItem NOTIFY selectedItemChanged)
+
+public:
+    enum LayerType {
+        Text,
+        Image
+    };
+    Q_ENUM(LayerType)
+
+    enum Roles {
+        ItemRole = Qt::UserRole + 1,
+        LayerIdRole,
+        TypeRole,
+        PreviewRole,
+        DetailsRole,
+        LayerRole,
+        SelectedRole
+    };
+
+    struct Layer
+    {
+        QQuickItem* item = nullptr;
+        int id = 0;
+        LayerType type = Text;
+    };
+
+    static LayerModel* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static LayerModel* instance();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    int count() const { return int(m_layers.size()); }
+    QQuickItem* selectedItem() const { return m_selected; }
+
+    // Layers in paint order, bottom first
+    QList<Layer> layersBottomToTop() const;
+
+public slots:
+    // Puts a new layer on top of the stack and returns its id
+    int add(QQuickItem* item, LayerModel::LayerType type);
+    // Brings back a removed layer at the position its z value gives it
+    void restore(QQuickItem* item);
+    // Takes the layer out of the list, the item itself is left alone
+    void remove(QQuickItem* item);
+
+    void select(QQuickItem* item);
+    void clearSelection();
+
+    // Swaps the layer with its neighbour, -1 moves it up towards the top of the list
+    bool shift(QQuickItem* item, int offset);
+
+    int indexOf(QQuickItem* item) const;
+    QQuickItem* itemAt(int row) const;
+    int layerId(QQuickItem* item) const;
+    QQuickItem* itemForId(int id) const;
+
+signals:
+    void countChanged();
+    void selectedItemChanged();
+
+private slots:
+    void layerPropertyChanged();
+
+private:
+    explicit LayerModel(QObject *parent = nullptr);
+    void insertRow(int row, const Layer& layer);
+    void reindex(int from);
+    void watch(QQuickItem* item);
+    void forget(QQuickItem* item);
+    void setItemSelected(QQuickItem* item, bool selected);
+
+    static LayerModel* m_instance;
+    QList<Layer> m_layers;
+    QHash<QQuickItem*, int> m_rows;
+    // Every layer ever added and still alive, including removed ones kept for undo
+    QHash<QQuickItem*, Layer> m_known;
+    QHash<int, QQuickItem*> m_ids;
+    QQuickItem* m_selected;
+    int m_nextId;
+    qreal m_topZ;
+};
+
+#endif // LAYERMODEL_H
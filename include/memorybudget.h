@@ -0,0 +1,95 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QObject>
+#include <QMutex>
+#include <QVariantList>
+#include <QtQml/qqml.h>
+#include <array>
+#include <atomic>
+#include <functional>
+
+// Accounts for the big memory users of the app against one budget. Caches report their size,
+// transient buffers are counted while they exist. When the total goes over the budget the
+// coldest caches are asked to give memory back, font previews first, then decoded images
+// (adjusted copies and derived mip levels go before the full resolution decodes they come from).
+// Everything can be called from any thread, enforcement runs on the GUI thread.
+class MemoryBudget : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(qint64 budget READ budget WRITE setBudget NOTIFY budgetChanged)
+    Q_PROPERTY(qint64 used READ used NOTIFY usageChanged)
+    // One map per category: name, bytes
+    Q_PROPERTY(QVariantList categories READ categories NOTIFY usageChanged)
+
+public:
+    enum Category {
+        DecodedImages,
+        Uploads,
+        Fonts,
+        FontPreviews,
+        ExportBuffers,
+        CategoryCount
+    };
+    Q_ENUM(Category)
+
+    // Frees up to the given number of bytes, returns how many were freed
+    using Reclaimer = std::function<qint64(qint64 bytes)>;
+
+    // Counts a transient buffer for as long as it lives
+    class Allocation
+    {
+    public:
+        Allocation(Category category, qint64 bytes = 0);
+        ~Allocation();
+        Allocation(const Allocation&) = delete;
+        Allocation& operator=(const Allocation&) = delete;
+
+        void resize(qint64 bytes);
+
+    private:
+        Category m_category;
+        qint64 m_bytes;
+    };
+
+    static MemoryBudget* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static MemoryBudget* instance();
+
+    qint64 budget() const { return m_budget; }
+    void setBudget(qint64 bytes);
+    qint64 used() const;
+    qint64 usage(Category category) const { return m_usage[category]; }
+    QVariantList categories() const;
+
+    // For caches that know their total size
+    void set(Category category, qint64 bytes);
+    // For buffers that come and go
+    void add(Category category, qint64 delta);
+    void setReclaimer(Category category, const Reclaimer& reclaimer);
+
+    Q_INVOKABLE void logUsage() const;
+
+signals:
+    void budgetChanged();
+    void usageChanged();
+
+private:
+    explicit MemoryBudget(QObject *parent = nullptr);
+    void scheduleUpdate();
+    void update();
+    void enforce();
+
+    static const char* categoryName(Category category);
+
+    std::array<std::atomic<qint64>, CategoryCount> m_usage;
+    mutable QMutex m_mutex;
+    std::array<Reclaimer, CategoryCount> m_reclaimers;
+    std::atomic<qint64> m_budget;
+    std::atomic<bool> m_updateQueued;
+    bool m_overBudgetReported;
+};
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,29 @@
+#ifndef PIXELKERNELS_H
+#define PIXELKERNELS_H
+
+#include <QRgb>
+#include <QtGlobal>
+
+// Row kernels for the pixel conversions export spends its time in. Every kernel has a scalar
+// reference and vector versions (SSE4.1 and AVX2 picked at runtime on x86, SIMD128 on the
+// web build) that produce the same bytes. Sources are ARGB32 premultiplied scanlines.
+namespace PixelKernels
+{
+// Premultiplied ARGB32 to straight RGBA8888 bytes, the layout PNG stores
+void unpremultiplyToRgba8888(const QRgb* src, uchar* dst, int count);
+
+// Composites premultiplied pixels over an opaque matte color, dst may equal src
+void flattenOverMatte(const QRgb* src, QRgb* dst, int count, QRgb matte);
+
+// Drops the alpha byte of opaque pixels, three bytes per pixel in R,G,B or B,G,R order
+void packRgb888(const QRgb* src, uchar* dst, int count, bool bgrOrder);
+
+// Averages 2x2 blocks in linear light instead of on the sRGB encoded values.
+// bottom may equal top for the last row of an odd height, an odd last column is averaged alone.
+void downscale2xLinear(const QRgb* top, const QRgb* bottom, int srcWidth, QRgb* dst);
+
+// "AVX2", "SSE4.1", "SIMD128" or "scalar"
+const char* instructionSet();
+}
+
+#endif // PIXELKERNELS_H
@@ -0,0 +1,73 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QCborMap>
+#include <QQuickItem>
+#include <QUrl>
+#include <QVariantMap>
+#include <QtQml/qqml.h>
+
+// Reads and writes .qedit projects: the base image, every layer and the assets they use.
+//
+// Layout, all integers little endian:
+//   header   "QEDT", u16 version, u16 reserved, u64 index offset
+//   chunks   asset bytes stored as-is (encoded images, font files), 16-byte aligned
+//   document CBOR chunk describing the scene size, the base image and the layers, bottom first
+//   index    CBOR array of { kind, hash, offset, size }, one entry per chunk
+//
+// Assets are deduplicated by SHA-1. On open the file is memory-mapped while it is parsed and
+// only the chunks the document uses are copied out, still encoded, so decoding waits until
+// they are displayed. The file is closed again right after, it can be saved over at once.
+class ProjectFile : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+public:
+    enum ChunkKind {
+        DocumentChunk,
+        ImageChunk,
+        FontChunk
+    };
+
+    // Parsed project, chunk views point into the buffer that was parsed
+    struct Archive
+    {
+        QCborMap document;
+        QList<QByteArray> chunks;
+        QList<int> kinds;
+
+        // Empty when the index is out of range or the chunk is of another kind
+        QByteArray chunk(qint64 index, ChunkKind kind) const;
+    };
+
+    static ProjectFile* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+
+    static QByteArray serialize(QQuickItem* container);
+    static bool parse(const char* data, qint64 size, Archive& archive, QString* error);
+
+public slots:
+    bool save(QQuickItem* container, const QUrl& fileUrl);
+    bool open(const QUrl& fileUrl);
+
+    // Browser variants of save/open (WebAssembly only)
+    void download(QQuickItem* container, const QString& fileName);
+    void openProjectDialog();
+
+    void openData(const QByteArray& data);
+
+signals:
+    // project: { baseSource, baseRotation, layers: [{ type: "text"|"image", properties }] }
+    void projectOpened(const QVariantMap& project);
+    void projectSaved(const QString& fileName);
+    void errorOccurred(const QString& message);
+
+private:
+    explicit ProjectFile(QObject *parent = nullptr);
+    bool load(const char* data, qint64 size);
+};
+
+#endif // PROJECTFILE_H
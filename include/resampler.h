@@ -0,0 +1,29 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QImage>
+#include <QSize>
+#include <QSizeF>
+#include <QTransform>
+
+// Separable windowed-filter resampling of ARGB32 premultiplied or RGB32 images.
+// The output is split into row bands that run on free threads of the global pool,
+// the calling thread always works on bands too, so it is safe to call from pool threads.
+class Resampler
+{
+public:
+    enum Filter {
+        Lanczos3,   // sharpest, used for downscales
+        Mitchell    // B = C = 1/3, less ringing, used for upscales
+    };
+
+    static QImage resize(const QImage& source, const QSize& size, Filter filter);
+    // Lanczos3 when shrinking, Mitchell when enlarging
+    static QImage resize(const QImage& source, const QSize& size);
+
+    // Pixel size a rectangle of the given size covers once transform is applied.
+    // Affine draws are resampled to this size first, the rotation that remains is close to 1:1.
+    static QSize deviceSize(const QSizeF& size, const QTransform& transform);
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,99 @@
+#ifndef SCENECOMPOSITOR_H
+#define SCENECOMPOSITOR_H
+
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QRectF>
+#include <QSizeF>
+#include <QUrl>
+#include "adjustments.h"
+#include "textlayer.h"
+
+class QQuickItem;
+class QPainter;
+
+// Plain description of one text or image layer, in scene (source image) coordinates
+struct SceneLayer
+{
+    enum Type {
+        Text,
+        Image
+    };
+
+    Type type = Text;
+    QRectF geometry;        // item rectangle inside the scene
+    QRectF contentRect;     // content rectangle relative to geometry
+    qreal rotation = 0.0;   // degrees, around the geometry center
+    qreal z = 0.0;
+
+    // Text layers
+    QString text;
+    QFont font;
+    QColor color;
+
+    // Image layers
+    QUrl source;
+    Adjustments adjustments;
+};
+
+// Everything needed to rebuild the canvas without touching the QML scene
+struct SceneDescription
+{
+    QSizeF sceneSize;
+    QUrl baseSource;
+    QSizeF baseSize;
+    qreal baseRotation = 0.0;
+    Adjustments baseAdjustments;
+    QList<SceneLayer> layers;   // sorted bottom to top
+
+    bool isValid() const { return sceneSize.width() > 0 && sceneSize.height() > 0; }
+};
+
+// Rasterizes a SceneDescription at an arbitrary output resolution with QPainter.
+// Capturing must happen on the GUI thread, everything else is thread-safe.
+class SceneCompositor
+{
+public:
+    explicit SceneCompositor(const SceneDescription& scene);
+
+    static SceneDescription captureScene(QQuickItem* container);
+    static SceneLayer captureLayer(QQuickItem* item, SceneLayer::Type type);
+    static QImage loadImage(const QUrl& url, const Adjustments& adjustments = Adjustments());
+
+    // Uses an already decoded base image instead of loading baseSource, baseAdjustments still apply
+    void setBaseImage(const QImage& image);
+
+    // Decodes the base image and every image layer and outlines the text, call before rendering.
+    // With an output size, images that shrink there are also resampled to the pixel size they
+    // cover, so painting only has to apply what remains of the rotation instead of scaling with
+    // bilinear filtering. Enlarged images are painted from the original, never held at output size.
+    bool prepare(const QSize& outputSize = QSize());
+
+    QImage render(const QSize& outputSize, int tileSize = 1024) const;
+
+    // Paints the given region of the output into target, whose size must match the region
+    void renderRegion(QImage& target, const QRect& region, const QSize& outputSize) const;
+
+private:
+    void paintScene(QPainter& painter) const;
+    void paintLayer(QPainter& painter, const SceneLayer& layer, const QImage& scaledImage,
+                    const TextLayer::Outline& textOutline) const;
+    QSizeF baseDrawSize() const;
+    QSizeF layerDrawSize(const SceneLayer& layer, const QImage& image) const;
+    QImage resampleFor(const QImage& image, const QSizeF& drawSize, qreal rotation, const QSize& outputSize) const;
+
+    SceneDescription m_scene;
+    QImage m_baseImage;
+    // Keyed by source and adjustments, layers sharing both share the image
+    QHash<QString, QImage> m_layerImages;
+    // Resampled for the prepared output size, null where the original is used as is
+    QImage m_scaledBase;
+    QList<QImage> m_scaledLayers;
+    // Glyph outlines of text layers, empty for image layers
+    QList<TextLayer::Outline> m_textOutlines;
+};
+
+#endif // SCENECOMPOSITOR_H
@@ -0,0 +1,95 @@
+#ifndef STRIPENCODER_H
+#define STRIPENCODER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QRgb>
+#include <QSize>
+#include <QString>
+#include <memory>
+
+class QIODevice;
+
+// Receives an image top to bottom, one horizontal strip at a time, and writes it to a device.
+// Formats that can stream rows never hold more than the strip they are given.
+class StripEncoder
+{
+public:
+    virtual ~StripEncoder() = default;
+
+    static std::unique_ptr<StripEncoder> create(const QString& format);
+
+    virtual bool begin(QIODevice* device, const QSize& size) = 0;
+    virtual bool writeStrip(const QImage& strip) = 0;
+    virtual bool finish() = 0;
+
+    // True when the encoder keeps only the current strip in memory
+    virtual bool isStreaming() const = 0;
+
+    // Background that transparent pixels are composited over for formats without alpha
+    void setMatteColor(QRgb matte) { m_matte = matte; }
+    // 0 to 100 for lossy formats, -1 keeps the encoder default
+    void setQuality(int quality) { m_quality = quality; }
+
+protected:
+    QRgb m_matte = 0xffffffff;
+    int m_quality = -1;
+};
+
+#ifdef QUICKEDITS_HAVE_ZLIB
+class PngStripEncoder : public StripEncoder
+{
+public:
+    PngStripEncoder();
+    ~PngStripEncoder() override;
+
+    bool begin(QIODevice* device, const QSize& size) override;
+    bool writeStrip(const QImage& strip) override;
+    bool finish() override;
+    bool isStreaming() const override { return true; }
+
+private:
+    bool writeChunk(const char* type, const QByteArray& data);
+    bool deflateRows(const uchar* data, int length, bool last);
+
+    struct Private;
+    std::unique_ptr<Private> d;
+};
+#endif
+
+// Uncompressed 24-bit BMP written top-down, so rows can go straight to the device
+class BmpStripEncoder : public StripEncoder
+{
+public:
+    bool begin(QIODevice* device, const QSize& size) override;
+    bool writeStrip(const QImage& strip) override;
+    bool finish() override;
+    bool isStreaming() const override { return true; }
+
+private:
+    QIODevice* m_device = nullptr;
+    QSize m_size;
+    QByteArray m_row;
+    QList<QRgb> m_flattened;
+};
+
+// Fallback for formats Qt only encodes from a full frame (JPEG, WebP, PNG without zlib)
+class ImageWriterStripEncoder : public StripEncoder
+{
+public:
+    explicit ImageWriterStripEncoder(const QByteArray& format);
+
+    bool begin(QIODevice* device, const QSize& size) override;
+    bool writeStrip(const QImage& strip) override;
+    bool finish() override;
+    bool isStreaming() const override { return false; }
+
+private:
+    QByteArray m_format;
+    QIODevice* m_device = nullptr;
+    QImage m_frame;
+    int m_nextRow = 0;
+};
+
+#endif // STRIPENCODER_H
@@ -0,0 +1,82 @@
+#ifndef TEXTLAYER_H
+#define TEXTLAYER_H
+
+#include <QQuickItem>
+#include <QColor>
+#include <QFont>
+#include <QList>
+#include <QPainterPath>
+#include <QRectF>
+#include <QString>
+#include <QtQml/qqml.h>
+#include <memory>
+
+class QTextLayout;
+
+// Canvas item of a text layer. The text is shaped and wrapped into a cached QTextLayout once per
+// text, font and width, and drawn with distance field glyphs, so zooming, moving and recoloring
+// never shape again. Export draws the outlines of the very same layout at the output resolution.
+class TextLayer : public QQuickItem
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(QString text READ text WRITE setText NOTIFY textChanged)
+    Q_PROPERTY(QFont font READ font WRITE setFont NOTIFY fontChanged)
+    Q_PROPERTY(QColor color READ color WRITE setColor NOTIFY colorChanged)
+
+public:
+    // Glyph outlines and underline/strike out bars of a laid out text, kept apart because
+    // a bar crossing a glyph would cancel out under the winding fill of the outlines
+    struct Outline
+    {
+        QPainterPath glyphs;
+        QList<QRectF> decorations;
+
+        bool isEmpty() const { return glyphs.isEmpty() && decorations.isEmpty(); }
+    };
+
+    explicit TextLayer(QQuickItem *parent = nullptr);
+    ~TextLayer() override;
+
+    QString text() const { return m_text; }
+    void setText(const QString& text);
+
+    QFont font() const { return m_font; }
+    void setFont(const QFont& font);
+
+    QColor color() const { return m_color; }
+    void setColor(const QColor& color);
+
+    // Wraps text to width the way the canvas does, export goes through here too so both
+    // break lines at the same places
+    static void layoutText(QTextLayout& layout, const QString& text, qreal width);
+    static Outline outline(const QString& text, const QFont& font, qreal width);
+
+signals:
+    void textChanged();
+    void fontChanged();
+    void colorChanged();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void updatePolish() override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+
+private:
+    void invalidateLayout();
+    // Fonts registered after the text was shaped may replace a fallback
+    void fontDatabaseChanged();
+
+    QString m_text;
+    QFont m_font;
+    QColor m_color;
+
+    // Rebuilt in updatePolish, read by updatePaintNode while the GUI thread is blocked
+    std::unique_ptr<QTextLayout> m_layout;
+    qreal m_layoutWidth;
+    bool m_layoutDirty;
+    bool m_nodeDirty;
+};
+
+#endif // TEXTLAYER_H
@@ -0,0 +1,129 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QQuickItem>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QUrl>
+#include <QtQml/qqml.h>
+
+class QSGSimpleTextureNode;
+
+struct TileKey
+{
+    int level = 0;
+    int x = 0;
+    int y = 0;
+
+    bool operator==(const TileKey& other) const
+    {
+        return level == other.level && x == other.x && y == other.y;
+    }
+};
+
+inline size_t qHash(const TileKey& key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.level, key.x, key.y);
+}
+
+// Draws a large image as a pyramid of texture tiles. Only tiles inside the viewport
+// at the level matching the on-screen scale are uploaded, the rest are evicted LRU
+// once the texture budget is exceeded.
+class TiledImage : public QQuickItem
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    Q_PROPERTY(QUrl source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QQuickItem* viewport READ viewport WRITE setViewport NOTIFY viewportChanged)
+    Q_PROPERTY(QSize imageSize READ imageSize NOTIFY imageSizeChanged)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(int tileSize READ tileSize WRITE setTileSize NOTIFY tileSizeChanged)
+    Q_PROPERTY(qint64 textureBudget READ textureBudget WRITE setTextureBudget NOTIFY textureBudgetChanged)
+
+public:
+    enum Status { Null, Loading, Ready, Error };
+    Q_ENUM(Status)
+
+    explicit TiledImage(QQuickItem *parent = nullptr);
+    ~TiledImage() override;
+
+    QUrl source() const { return m_source; }
+    void setSource(const QUrl& source);
+
+    QQuickItem* viewport() const { return m_viewport; }
+    void setViewport(QQuickItem* viewport);
+
+    QSize imageSize() const { return m_imageSize; }
+    Status status() const { return m_status; }
+
+    int tileSize() const { return m_tileSize; }
+    void setTileSize(int tileSize);
+
+    qint64 textureBudget() const { return m_textureBudget; }
+    void setTextureBudget(qint64 bytes);
+
+signals:
+    void sourceChanged();
+    void viewportChanged();
+    void imageSizeChanged();
+    void statusChanged();
+    void tileSizeChanged();
+    void textureBudgetChanged();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+    void releaseResources() override;
+    void itemChange(ItemChange change, const ItemChangeData& value) override;
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+
+private:
+    struct TileNode
+    {
+        QSGSimpleTextureNode* node = nullptr;
+        qint64 bytes = 0;
+        quint64 lastUsed = 0;
+    };
+
+    void setStatus(Status status);
+    void reset();
+    void updateVisibleTiles();
+    void scheduleLoads();
+    void tileLoaded(quint64 generation, const TileKey& key, const QImage& image);
+
+    QSize levelSize(int level) const;
+    QRect tilePixelRect(const TileKey& key) const;
+    QRectF tileItemRect(const TileKey& key) const;
+
+    QUrl m_source;
+    QPointer<QQuickItem> m_viewport;
+    QSize m_imageSize;
+    Status m_status;
+    int m_tileSize;
+    qint64 m_textureBudget;
+    int m_maxLevel;
+    quint64 m_generation;
+
+    // GUI thread state, read by updatePaintNode while the GUI thread is blocked
+    QRectF m_visibleRect;
+    int m_targetLevel;
+    QList<TileKey> m_drawList;
+    QList<TileKey> m_loadQueue;
+    QSet<TileKey> m_loading;
+    QHash<TileKey, QImage> m_pendingUploads;
+    QSet<TileKey> m_resident;
+    bool m_clearNodes;
+
+    // Render thread state
+    QHash<TileKey, TileNode> m_nodes;
+    quint64 m_frame;
+
+    QMetaObject::Connection m_frameConnection;
+    QThreadPool m_loadPool;
+};
+
+#endif // TILEDIMAGE_H
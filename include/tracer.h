@@ -0,0 +1,120 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QUrl>
+#include <QtQml/qqml.h>
+#include <atomic>
+#include <vector>
+
+class QQuickWindow;
+
+// Collects timed spans and writes them as Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev).
+// While disabled a span costs one relaxed atomic load, nothing is allocated or locked.
+class Tracer : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(int eventCount READ eventCount NOTIFY eventCountChanged)
+
+public:
+    static Tracer* create(QQmlEngine *qmlEngine, QJSEngine *jsEngine);
+    static Tracer* instance();
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    bool enabled() const { return isEnabled(); }
+    void setEnabled(bool enabled);
+    int eventCount() const;
+
+    // Microseconds since the tracer was created
+    qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+
+    // name and category must be string literals, only the pointers are stored
+    void addSpan(const char* category, const char* name, qint64 startUs, qint64 durationUs);
+    void addCounter(const char* name, qint64 value);
+
+    // Records render thread frame spans and frame intervals of the window
+    void attachWindow(QQuickWindow* window);
+
+    QByteArray toJson() const;
+
+public slots:
+    void clear();
+    bool save(const QUrl& fileUrl);
+    // Native: writes next to the user's documents, WebAssembly: browser download
+    void dump();
+
+signals:
+    void enabledChanged();
+    void eventCountChanged();
+    void traceSaved(const QString& location);
+
+private:
+    struct Event
+    {
+        const char* category;
+        const char* name;
+        qint64 start;
+        qint64 duration;   // -1 for counters
+        qint64 value;
+        int thread;
+    };
+
+    explicit Tracer(QObject *parent = nullptr);
+    int threadIndex();
+    void append(const Event& event);
+    void scheduleCountUpdate();
+
+    static std::atomic<bool> s_enabled;
+
+    QElapsedTimer m_clock;
+    mutable QMutex m_mutex;
+    std::vector<Event> m_events;
+    QHash<quintptr, int> m_threads;
+    QList<QByteArray> m_threadNames;
+    QPointer<QQuickWindow> m_window;
+    std::atomic<qint64> m_frameStart;
+    qint64 m_lastSwap;
+    std::atomic<bool> m_countUpdateQueued;
+};
+
+// Times the enclosing scope while tracing is enabled
+class TraceScope
+{
+public:
+    TraceScope(const char* category, const char* name)
+        : m_category(category)
+        , m_name(name)
+        , m_start(Tracer::isEnabled() ? Tracer::instance()->now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start >= 0) {
+            Tracer* tracer = Tracer::instance();
+            tracer->addSpan(m_category, m_name, m_start, tracer->now() - m_start);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_category;
+    const char* m_name;
+    qint64 m_start;
+};
+
+#define QE_TRACE_CONCAT_INNER(a, b) a##b
+#define QE_TRACE_CONCAT(a, b) QE_TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(category, name) TraceScope QE_TRACE_CONCAT(traceScope_, __LINE__)(category, name)
+
+#endif // TRACER_H
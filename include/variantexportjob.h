@@ -0,0 +1,73 @@
+#ifndef VARIANTEXPORTJOB_H
+#define VARIANTEXPORTJOB_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QRgb>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+#include "memorybudget.h"
+#include "scenecompositor.h"
+
+struct ExportVariant
+{
+    QString fileName;   // written next to the others, or the entry name in the archive
+    QString format;
+    QSize size;
+    int quality = -1;   // -1 keeps the encoder default
+};
+
+// Exports one scene in several formats and sizes. The scene is composited once at the largest
+// size, every smaller variant is downscaled from the next larger one instead of from the full
+// composite, and encoding runs on a pool while the following variant is being resampled.
+class VariantExportJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    VariantExportJob(const SceneDescription& scene, const QList<ExportVariant>& variants, QObject *parent = nullptr);
+    ~VariantExportJob() override;
+
+    // Without an output directory the variants are bundled in memory, see archive()
+    void setOutputDirectory(const QString& directory);
+    void setMatteColor(QRgb matte);
+
+    void start();
+    void cancel();
+
+    QList<ExportVariant> variants() const { return m_variants; }
+    // Stored zip of every variant, only when there is no output directory
+    QByteArray archive() const { return m_archive; }
+
+signals:
+    void progressChanged(qreal progress);
+    void finished(bool success);
+
+private:
+    bool run();
+    QImage composite(const SceneCompositor& compositor, const QSize& size);
+    bool encode(const ExportVariant& variant, const QImage& image, QByteArray* data) const;
+    bool writeOutput();
+
+    SceneDescription m_scene;
+    QList<ExportVariant> m_variants;
+    QString m_directory;
+    QRgb m_matte;
+    // Indexed like m_variants, each slot written by one encoding task
+    std::vector<QByteArray> m_encoded;
+    QByteArray m_archive;
+    MemoryBudget::Allocation m_archiveAllocation;
+    std::atomic<bool> m_cancelled;
+    int m_stripHeight;
+
+    QThreadPool m_coordinatorPool;
+    // Renders the strips, then encodes the variants, never both at once
+    QThreadPool m_workerPool;
+};
+
+#endif // VARIANTEXPORTJOB_H
@@ -0,0 +1,27 @@
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+// Minimal zip writer for bundling exports into one download. Entries are stored without
+// compression, encoded images would not shrink anyway. No zip64, archives stay below 4 GiB.
+class ZipArchive
+{
+public:
+    ZipArchive();
+
+    bool addFile(const QString& name, const QByteArray& data);
+    // Appends the central directory, the archive cannot be added to afterwards
+    QByteArray finish();
+
+private:
+    QByteArray m_data;
+    QByteArray m_directory;
+    quint16 m_entries;
+    quint16 m_dosTime;
+    quint16 m_dosDate;
+};
+
+#endif // ZIPARCHIVE_H
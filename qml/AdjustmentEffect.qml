@@ -0,0 +1,70 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import Odizinne.QuickEdits
+
+// GPU preview of an adjustment stack, used as layer.effect of an image item.
+// Export runs the same steps on the CPU, see Adjustments::apply().
+Item {
+    id: root
+
+    // Texture of the item the effect is attached to, set by the layer
+    property var source
+    property var adjustments: ({})
+    // Item units per pixel of the full resolution image, the blur radius is in image pixels
+    property real pixelSize: 1
+    // Resolution of the intermediate blur textures, follows the layer's texture size
+    property size textureSize: Qt.size(width, height)
+
+    readonly property real blurRadius: Constants.adjustmentValue(adjustments, "blur") * pixelSize
+    readonly property bool blurred: blurRadius > 0
+    // Matches Taps in shaders/blur.frag
+    readonly property int blurTaps: 12
+
+    ShaderEffect {
+        id: horizontalBlur
+        width: root.width
+        height: root.height
+        visible: root.blurred
+        property var source: root.source
+        property vector2d direction: Qt.vector2d(root.blurRadius / root.blurTaps / Math.max(1, root.width), 0)
+        fragmentShader: "qrc:/shaders/blur.frag.qsb"
+    }
+
+    ShaderEffectSource {
+        id: horizontalPass
+        sourceItem: root.blurred ? horizontalBlur : null
+        hideSource: true
+        textureSize: root.textureSize
+        visible: false
+    }
+
+    ShaderEffect {
+        id: verticalBlur
+        width: root.width
+        height: root.height
+        visible: root.blurred
+        property var source: horizontalPass
+        property vector2d direction: Qt.vector2d(0, root.blurRadius / root.blurTaps / Math.max(1, root.height))
+        fragmentShader: "qrc:/shaders/blur.frag.qsb"
+    }
+
+    ShaderEffectSource {
+        id: verticalPass
+        sourceItem: root.blurred ? verticalBlur : null
+        hideSource: true
+        textureSize: root.textureSize
+        visible: false
+    }
+
+    ShaderEffect {
+        anchors.fill: parent
+        property var source: root.blurred ? verticalPass : root.source
+        property real brightness: Constants.adjustmentValue(root.adjustments, "brightness")
+        property real contrast: Constants.adjustmentValue(root.adjustments, "contrast")
+        property real saturation: Constants.adjustmentValue(root.adjustments, "saturation")
+        property real blackPoint: Constants.adjustmentValue(root.adjustments, "blackPoint")
+        property real whitePoint: Constants.adjustmentValue(root.adjustments, "whitePoint")
+        property real gamma: Constants.adjustmentValue(root.adjustments, "gamma")
+        fragmentShader: "qrc:/shaders/adjust.frag.qsb"
+    }
+}
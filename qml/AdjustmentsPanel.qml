@@ -0,0 +1,80 @@
+pragma ComponentBehavior: Bound
+import QtQuick
+import QtQuick.Controls.Material
+import QtQuick.Layouts
+import Odizinne.QuickEdits
+
+// Sliders for the adjustment stack stored in target[propertyName], edits go through EditHistory
+ColumnLayout {
+    id: root
+    spacing: 8
+
+    property QtObject target: null
+    property string propertyName: "adjustments"
+    readonly property var adjustments: target ? target[propertyName] : null
+
+    Label {
+        text: "Adjustments"
+        font.pixelSize: 16
+        font.bold: true
+    }
+
+    Repeater {
+        model: [
+            { name: "brightness", label: "Brightness", from: -1, to: 1, decimals: 2 },
+            { name: "contrast", label: "Contrast", from: -1, to: 1, decimals: 2 },
+            { name: "saturation", label: "Saturation", from: -1, to: 1, decimals: 2 },
+            { name: "blackPoint", label: "Black point", from: 0, to: 1, decimals: 2 },
+            { name: "whitePoint", label: "White point", from: 0, to: 1, decimals: 2 },
+            { name: "gamma", label: "Gamma", from: 0.1, to: 3, decimals: 2 },
+            { name: "blur", label: "Blur", from: 0, to: 100, decimals: 0 }
+        ]
+
+        delegate: RowLayout {
+            id: row
+            required property var modelData
+            Layout.fillWidth: true
+
+            Label {
+                text: row.modelData.label
+                Layout.preferredWidth: 75
+            }
+
+            Slider {
+                Layout.fillWidth: true
+                from: row.modelData.from
+                to: row.modelData.to
+                value: Constants.adjustmentValue(root.adjustments, row.modelData.name)
+                onPressedChanged: {
+                    if (pressed) {
+                        EditHistory.beginGesture(root.target, [root.propertyName], "Adjust image")
+                    } else {
+                        EditHistory.endGesture()
+                    }
+                }
+                onMoved: root.setValue(row.modelData.name, value)
+            }
+
+            Label {
+                text: Constants.adjustmentValue(root.adjustments, row.modelData.name).toFixed(row.modelData.decimals)
+                Layout.preferredWidth: 35
+            }
+        }
+    }
+
+    MaterialButton {
+        text: "Reset adjustments"
+        Layout.fillWidth: true
+        enabled: Constants.hasAdjustments(root.adjustments)
+        onClicked: EditHistory.setProperty(root.target, root.propertyName, Constants.defaultAdjustments, "Reset adjustments")
+    }
+
+    function setValue(name, value) {
+        if (!target) {
+            return
+        }
+        var updated = Object.assign({}, Constants.defaultAdjustments, adjustments || {})
+        updated[name] = value
+        EditHistory.setProperty(target, propertyName, updated, "Adjust image")
+    }
+}
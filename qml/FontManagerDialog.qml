@@ -65,7 +65,10 @@ Dialog {
 
             ListView {
                 id: fontListView
-                model: FontManager.customFontFamilies
+                model: FontListModel {
+                    customOnly: true
+                    previewColor: UserSettings.darkMode ? "#CCCCCC" : "#333333"
+                }
                 spacing: 8
                 width: fontScrollView.sbVisible ? fontScrollView.width - 20 : fontScrollView.width
 
@@ -78,7 +81,8 @@ Dialog {
                     border.width: 1
                     radius: Material.ExtraSmallScale
 
-                    required property string modelData
+                    required property string family
+                    required property url preview
                     required property int index
 
                     RowLayout {
@@ -91,8 +95,7 @@ Dialog {
                             spacing: 5
 
                             Label {
-                                text: fontItem.modelData
-                                font.family: fontItem.modelData
+                                text: fontItem.family
                                 font.pixelSize: 16
                                 font.bold: true
                                 Layout.fillWidth: true
@@ -100,14 +103,14 @@ Dialog {
                                 color: UserSettings.darkMode ? "#FFFFFF" : "#000000"
                             }
 
-                            Label {
-                                text: "The quick brown fox jumps over the lazy dog"
-                                font.family: fontItem.modelData
-                                font.pixelSize: 12
-                                Layout.fillWidth: true
-                                elide: Text.ElideRight
-                                opacity: 0.8
-                                color: UserSettings.darkMode ? "#CCCCCC" : "#333333"
+                            // Sample rendered once in the font itself, reading the preview registers a stored font
+                            Image {
+                                source: fontItem.preview
+                                sourceSize.height: Math.ceil(22 * Screen.devicePixelRatio)
+                                Layout.preferredHeight: 22
+                                Layout.preferredWidth: Math.min(implicitWidth / Screen.devicePixelRatio, 280)
+                                fillMode: Image.PreserveAspectFit
+                                horizontalAlignment: Image.AlignLeft
                             }
                         }
 
@@ -116,7 +119,7 @@ Dialog {
                             Layout.preferredWidth: 80
                             Material.accent: Material.Red
                             onClicked: {
-                                removeConfirmDialog.fontToRemove = fontItem.modelData
+                                removeConfirmDialog.fontToRemove = fontItem.family
                                 removeConfirmDialog.open()
                             }
                         }
@@ -31,24 +31,35 @@ ApplicationWindow {
     property real maxZoom: 3.0
     property real zoomStep: 0.1
 
+    // Full resolution of the base image, read from its header so it is known before decoding
+    property size baseImageSize: currentImageSource !== "" ? ImageCache.imageSize(currentImageSource) : Qt.size(0, 0)
+
+    // Power of two the canvas is downscaled by on screen, picks the cached mip level to display
+    function mipScale(displayScale) {
+        if (displayScale >= 1) {
+            return 1
+        }
+        return Math.pow(2, Math.ceil(Math.log2(Math.max(displayScale, 1 / 64))))
+    }
+
     property real effectiveImageWidth: {
-        if (currentImageSource !== "" && loadedImage.sourceSize.width > 0) {
+        if (currentImageSource !== "" && baseImageSize.width > 0) {
             var angle = Math.abs(imageRotation % 180)
             if (angle === 90) {
-                return loadedImage.sourceSize.height
+                return baseImageSize.height
             }
-            return loadedImage.sourceSize.width
+            return baseImageSize.width
         }
         return 0
     }
 
     property real effectiveImageHeight: {
-        if (currentImageSource !== "" && loadedImage.sourceSize.height > 0) {
+        if (currentImageSource !== "" && baseImageSize.height > 0) {
             var angle = Math.abs(imageRotation % 180)
             if (angle === 90) {
-                return loadedImage.sourceSize.width
+                return baseImageSize.width
             }
-            return loadedImage.sourceSize.height
+            return baseImageSize.height
         }
         return 0
     }
@@ -88,9 +99,90 @@ ApplicationWindow {
         zoomFactor = fitZoom
     }
 
+    // Lines the dragged layer up with the canvas and nearby layers, Ctrl drags freely
+    function snapLayer(item, mouse) {
+        if (mouse.modifiers & Qt.ControlModifier) {
+            snapGuides = []
+            return
+        }
+        var snapped = LayerIndex.snap(item, item.x, item.y, 6 / zoomFactor)
+        item.x = Math.max(0, Math.min(scaledContent.width - item.width, snapped.x))
+        item.y = Math.max(0, Math.min(scaledContent.height - item.height, snapped.y))
+        snapGuides = snapped.guides
+    }
+
+    // Moves every other layer into the containers below and above the active one for the length
+    // of a gesture. Each container is drawn from one texture, only redrawn when its layers change.
+    function flattenAround(item) {
+        // With one other layer, drawing it live is cheaper than an extra render pass
+        if (flattenedItem || LayerModel.count < 3) {
+            return
+        }
+
+        var view = scaledContent.mapFromItem(imageFlickable, 0, 0, imageFlickable.width, imageFlickable.height)
+        var left = Math.max(0, view.x)
+        var top = Math.max(0, view.y)
+        var right = Math.min(scaledContent.width, view.x + view.width)
+        var bottom = Math.min(scaledContent.height, view.y + view.height)
+        if (right <= left || bottom <= top) {
+            return
+        }
+        flattenRect = Qt.rect(left, top, right - left, bottom - top)
+
+        for (var i = 0; i < LayerModel.count; i++) {
+            var layer = LayerModel.itemAt(i)
+            if (layer !== item) {
+                layer.parent = layer.z > item.z ? flattenedAbove : flattenedBelow
+            }
+        }
+        flattenedItem = item
+    }
+
+    function unflatten() {
+        if (!flattenedItem) {
+            return
+        }
+        // Children rather than the model, a layer removed meanwhile still has to come back
+        while (flattenedBelow.children.length > 0) {
+            flattenedBelow.children[0].parent = scaledContent
+        }
+        while (flattenedAbove.children.length > 0) {
+            flattenedAbove.children[0].parent = scaledContent
+        }
+        flattenedItem = null
+    }
+
+    // Alt+click selects the next layer underneath the pointer, cycling through overlapping ones
+    function selectLayerUnder(mouseArea, mouse) {
+        if (!(mouse.modifiers & Qt.AltModifier)) {
+            return false
+        }
+        var point = mouseArea.mapToItem(scaledContent, mouse.x, mouse.y)
+        var layer = LayerIndex.layerAt(point.x, point.y, selectedTextItem)
+        if (layer) {
+            LayerModel.select(layer)
+        }
+        return true
+    }
+
     property string currentImageSource: ""
-    property var selectedTextItem: null
+    // Upload held for the base image, released when another image replaces it
+    property string retainedImageSource: ""
+    onCurrentImageSourceChanged: {
+        ImageCache.retain(currentImageSource)
+        ImageCache.release(retainedImageSource)
+        retainedImageSource = currentImageSource
+    }
+    readonly property var selectedTextItem: LayerModel.selectedItem
+    // Lines the dragged layer is snapped to, see LayerIndex.snap
+    property var snapGuides: []
+    // Layer being dragged, rotated or resized while the others are drawn from two cached textures
+    property Item flattenedItem: null
+    // Part of the canvas in view when the gesture started, the only part the textures cover
+    property rect flattenRect: Qt.rect(0, 0, 0, 0)
     property real imageRotation: 0
+    // Adjustment stack of the base image, see AdjustmentsPanel
+    property var baseAdjustments: Constants.defaultAdjustments
 
     header: ToolBar {
         height: 50
@@ -98,7 +190,7 @@ ApplicationWindow {
             anchors.fill: parent
             anchors.rightMargin: 15
             spacing: 0
-            property int buttonWidth: Math.max(fileBtn.implicitWidth, layersBtn.implicitWidth, fontsBtn.implicitWidth) + 20
+            property int buttonWidth: Math.max(fileBtn.implicitWidth, editBtn.implicitWidth, layersBtn.implicitWidth, fontsBtn.implicitWidth) + 20
             property int rightButtonWidth: Math.max(donateButton.implicitWidth, githubButton.implicitWidth) + 20
 
 
@@ -135,6 +227,61 @@ ApplicationWindow {
                             ImageExporter.openSaveDialog(scaledContent)
                         }
                     }
+
+                    MenuSeparator {}
+
+                    MenuItem {
+                        text: "Open Project..."
+                        onClicked: {
+                            if (Qt.platform.os === "wasm") {
+                                ProjectFile.openProjectDialog()
+                            } else {
+                                openProjectDialog.open()
+                            }
+                        }
+                    }
+
+                    MenuItem {
+                        text: "Save Project..."
+                        enabled: mainWindow.currentImageSource !== ""
+                        onClicked: {
+                            if (Qt.platform.os === "wasm") {
+                                ProjectFile.download(scaledContent, "project.qedit")
+                            } else {
+                                saveProjectDialog.open()
+                            }
+                        }
+                    }
+                }
+            }
+
+            ToolButton {
+                id: editBtn
+                text: "Edit"
+                Layout.preferredHeight: 50
+                Layout.preferredWidth: parent.buttonWidth
+                icon.source: "qrc:/icons/edit.svg"
+                icon.color: "white"
+                Material.foreground: "white"
+                icon.width: 16
+                icon.height: 16
+                onClicked: editMenu.visible = !editMenu.visible
+
+                Menu {
+                    id: editMenu
+                    y: 50
+
+                    MenuItem {
+                        text: EditHistory.canUndo && EditHistory.undoText !== "" ? "Undo " + EditHistory.undoText : "Undo"
+                        enabled: EditHistory.canUndo
+                        onClicked: EditHistory.undo()
+                    }
+
+                    MenuItem {
+                        text: EditHistory.canRedo && EditHistory.redoText !== "" ? "Redo " + EditHistory.redoText : "Redo"
+                        enabled: EditHistory.canRedo
+                        onClicked: EditHistory.redo()
+                    }
                 }
             }
 
@@ -162,8 +309,7 @@ ApplicationWindow {
                                                                           x: 50,
                                                                           y: 50
                                                                       })
-                            mainWindow.addItemToModel(textItem)
-                            mainWindow.selectItem(textItem)
+                            mainWindow.addLayer(textItem, LayerModel.Text)
                         }
                     }
 
@@ -379,27 +525,77 @@ ApplicationWindow {
                                                             y: 50,
                                                             source: filePath
                                                         })
-            mainWindow.addItemToModel(imageItem)
-            mainWindow.selectItem(imageItem)
+            mainWindow.addLayer(imageItem, LayerModel.Image)
+        }
+    }
+
+    Connections {
+        target: ProjectFile
+        function onProjectOpened(project) {
+            mainWindow.loadProject(project)
         }
+
+        function onErrorOccurred(message) {
+            console.warn("QML: Project error:", message)
+        }
+    }
+
+    Connections {
+        target: LayerModel
+        function onSelectedItemChanged() {
+            mainWindow.updateControls()
+        }
+    }
+
+    Shortcut {
+        sequences: [StandardKey.Undo]
+        enabled: EditHistory.canUndo
+        onActivated: EditHistory.undo()
+    }
+
+    Shortcut {
+        sequences: [StandardKey.Redo]
+        enabled: EditHistory.canRedo
+        onActivated: EditHistory.redo()
+    }
+
+    // Developer tracing: toggle recording, then write the Chrome trace (or download it on the web)
+    Shortcut {
+        sequence: "Ctrl+Alt+T"
+        onActivated: Tracer.enabled = !Tracer.enabled
+    }
+
+    Shortcut {
+        sequence: "Ctrl+Alt+D"
+        onActivated: Tracer.dump()
     }
 
-    ListModel {
-        id: itemsModel
+    // Prints what the memory budget is spent on
+    Shortcut {
+        sequence: "Ctrl+Alt+M"
+        onActivated: MemoryBudget.logUsage()
+    }
+
+    Connections {
+        target: EditHistory
+        function onApplied() {
+            // Undo/redo writes item properties directly, bring the panel back in sync
+            mainWindow.updateControls()
+        }
     }
 
     SaveNamingDialog {
         id: saveNamingDialog
 
-        onFileNameAccepted: function(fileName, width, height) {
+        onFileNameAccepted: function(fileName, width, height, variants) {
             console.log("QML: Save dialog accepted with filename:", fileName, "Resolution:", width + "x" + height)
 
             if (Qt.platform.os === "wasm") {
                 // WebAssembly: grab and save directly
-                ImageExporter.grabImageAndSave(fileName, width, height)
+                ImageExporter.grabImageAndSave(fileName, width, height, variants)
             } else {
                 // Native: grab first, then open file dialog
-                ImageExporter.grabImageAndSave(fileName, width, height)
+                ImageExporter.grabImageAndSave(fileName, width, height, variants)
                 Qt.callLater(function() {
                     saveFileDialog.currentFile = Qt.resolvedUrl(saveFileDialog.currentFolder + "/" + fileName)
                     saveFileDialog.open()
@@ -445,8 +641,7 @@ ApplicationWindow {
                                                             y: 50,
                                                             source: selectedFile
                                                         })
-            mainWindow.addItemToModel(imageItem)
-            mainWindow.selectItem(imageItem)
+            mainWindow.addLayer(imageItem, LayerModel.Image)
         }
     }
 
@@ -464,9 +659,27 @@ ApplicationWindow {
         }
     }
 
+    FileDialog {
+        id: openProjectDialog
+        title: "Open project"
+        fileMode: FileDialog.OpenFile
+        currentFolder: StandardPaths.standardLocations(StandardPaths.DocumentsLocation)[0]
+        nameFilters: ["QuickEdits projects (*.qedit)", "All files (*)"]
+        onAccepted: ProjectFile.open(selectedFile)
+    }
+
+    FileDialog {
+        id: saveProjectDialog
+        title: "Save project as..."
+        fileMode: FileDialog.SaveFile
+        currentFolder: StandardPaths.standardLocations(StandardPaths.DocumentsLocation)[0]
+        nameFilters: ["QuickEdits projects (*.qedit)"]
+        defaultSuffix: "qedit"
+        onAccepted: ProjectFile.save(scaledContent, selectedFile)
+    }
+
     Component.onCompleted: {
         mainLyt.opacity = 1
-        Qt.fontFamilies()
     }
 
     FontManagerDialog {
@@ -528,7 +741,7 @@ ApplicationWindow {
                             Layout.fillWidth: true
                             Layout.preferredWidth: parent.buttonWidth
                             onClicked: {
-                                mainWindow.imageRotation -= 90
+                                EditHistory.setProperty(mainWindow, "imageRotation", mainWindow.imageRotation - 90, "Rotate image")
                             }
                         }
                         MaterialButton {
@@ -537,7 +750,7 @@ ApplicationWindow {
                             Layout.fillWidth: true
                             Layout.preferredWidth: parent.buttonWidth
                             onClicked: {
-                                mainWindow.imageRotation += 90
+                                EditHistory.setProperty(mainWindow, "imageRotation", mainWindow.imageRotation + 90, "Rotate image")
                             }
                         }
                         MaterialButton {
@@ -546,7 +759,7 @@ ApplicationWindow {
                             Layout.fillWidth: true
                             Layout.preferredWidth: parent.buttonWidth
                             onClicked: {
-                                mainWindow.imageRotation = 0
+                                EditHistory.setProperty(mainWindow, "imageRotation", 0, "Rotate image")
                             }
                         }
                     }
@@ -597,6 +810,13 @@ ApplicationWindow {
                         }
                     }
 
+                    AdjustmentsPanel {
+                        Layout.fillWidth: true
+                        visible: mainWindow.currentImageSource !== ""
+                        target: mainWindow
+                        propertyName: "baseAdjustments"
+                    }
+
                     MenuSeparator {
                         Layout.fillWidth: true
                         visible: mainWindow.selectedTextItem !== null
@@ -625,8 +845,7 @@ ApplicationWindow {
                                 wrapMode: TextArea.Wrap
                                 onTextChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('textContent')) {
-                                        mainWindow.selectedTextItem.textContent = text
-                                        mainWindow.updateItemPreview(mainWindow.selectedTextItem)
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "textContent", text, "Edit text")
                                     }
                                 }
                             }
@@ -638,11 +857,96 @@ ApplicationWindow {
                             ComboBox {
                                 id: fontFamily
                                 Layout.fillWidth: true
-                                model: FontManager.availableFonts
-                                onCurrentTextChanged: {
+                                // Family of the selected text, the index means little once the list is filtered
+                                property string family: ""
+                                displayText: family
+                                textRole: "family"
+                                model: FontListModel {
+                                    id: fontListModel
+                                    previewColor: UserSettings.darkMode ? "#FFFFFF" : "#000000"
+                                }
+
+                                delegate: ItemDelegate {
+                                    id: fontDelegate
+                                    required property int index
+                                    required property string family
+                                    required property url preview
+                                    width: ListView.view ? ListView.view.width : implicitWidth
+                                    highlighted: fontFamily.highlightedIndex === index
+
+                                    // Pre-rendered sample, instantiating every family as a live text item is what made scrolling slow
+                                    contentItem: Item {
+                                        implicitHeight: 24
+                                        Image {
+                                            id: fontPreview
+                                            anchors.left: parent.left
+                                            anchors.verticalCenter: parent.verticalCenter
+                                            width: Math.min(parent.width, implicitWidth / Screen.devicePixelRatio)
+                                            height: 24
+                                            source: fontDelegate.preview
+                                            sourceSize.height: Math.ceil(24 * Screen.devicePixelRatio)
+                                            fillMode: Image.PreserveAspectFit
+                                            horizontalAlignment: Image.AlignLeft
+                                        }
+                                        Label {
+                                            anchors.fill: parent
+                                            verticalAlignment: Text.AlignVCenter
+                                            text: fontDelegate.family
+                                            elide: Text.ElideRight
+                                            visible: fontPreview.status !== Image.Ready
+                                        }
+                                    }
+                                }
+
+                                popup: Popup {
+                                    y: fontFamily.height
+                                    width: fontFamily.width
+                                    height: Math.min(420, mainWindow.height * 0.6)
+                                    padding: 0
+
+                                    onOpened: {
+                                        fontSearch.text = ""
+                                        fontSearch.forceActiveFocus()
+                                    }
+
+                                    contentItem: ColumnLayout {
+                                        spacing: 0
+
+                                        TextField {
+                                            id: fontSearch
+                                            Layout.fillWidth: true
+                                            Layout.margins: 8
+                                            placeholderText: fontListModel.loading ? "Loading fonts..." : "Search fonts"
+                                            onTextChanged: fontListModel.filter = text
+                                            onAccepted: {
+                                                if (fontListModel.count > 0) {
+                                                    fontFamily.chooseFamily(fontListModel.familyAt(0))
+                                                    fontFamily.popup.close()
+                                                }
+                                            }
+                                        }
+
+                                        ListView {
+                                            Layout.fillWidth: true
+                                            Layout.fillHeight: true
+                                            clip: true
+                                            model: fontFamily.popup.visible ? fontFamily.delegateModel : null
+                                            currentIndex: fontFamily.highlightedIndex
+                                            ScrollIndicator.vertical: ScrollIndicator { }
+                                        }
+                                    }
+                                }
+
+                                onActivated: function(index) {
+                                    chooseFamily(fontListModel.familyAt(index))
+                                }
+
+                                function chooseFamily(name) {
+                                    family = name
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontFamily')) {
-                                        mainWindow.selectedTextItem.fontFamily = currentText
-                                        mainWindow.updateItemPreview(mainWindow.selectedTextItem)
+                                        // Custom fonts are registered on first use
+                                        FontManager.ensureFontLoaded(name)
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "fontFamily", name, "Change font")
                                     }
                                 }
                             }
@@ -656,8 +960,7 @@ ApplicationWindow {
                                 value: 24
                                 onValueChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontSize')) {
-                                        mainWindow.selectedTextItem.fontSize = value
-                                        mainWindow.updateItemPreview(mainWindow.selectedTextItem)
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "fontSize", value, "Change font size")
                                     }
                                 }
                             }
@@ -669,7 +972,7 @@ ApplicationWindow {
                                 text: "Bold"
                                 onCheckedChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontBold'))
-                                    mainWindow.selectedTextItem.fontBold = checked
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "fontBold", checked, "Bold")
                                 }
                             }
                             CheckBox {
@@ -678,7 +981,7 @@ ApplicationWindow {
                                 text: "Italic"
                                 onCheckedChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontItalic'))
-                                    mainWindow.selectedTextItem.fontItalic = checked
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "fontItalic", checked, "Italic")
                                 }
                             }
                         }
@@ -690,7 +993,7 @@ ApplicationWindow {
                                 text: "Underline"
                                 onCheckedChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontUnderline'))
-                                    mainWindow.selectedTextItem.fontUnderline = checked
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "fontUnderline", checked, "Underline")
                                 }
                             }
                             CheckBox {
@@ -699,7 +1002,7 @@ ApplicationWindow {
                                 text: "Strikeout"
                                 onCheckedChanged: {
                                     if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('fontStrikeout'))
-                                    mainWindow.selectedTextItem.fontStrikeout = checked
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "fontStrikeout", checked, "Strikeout")
                                 }
                             }
                         }
@@ -741,7 +1044,7 @@ ApplicationWindow {
                             Layout.fillWidth: true
                             onSelectedColorChanged: {
                                 if (mainWindow.selectedTextItem && mainWindow.selectedTextItem.hasOwnProperty('textColor'))
-                                mainWindow.selectedTextItem.textColor = selectedColor
+                                EditHistory.setProperty(mainWindow.selectedTextItem, "textColor", selectedColor, "Change text color")
                             }
                         }
 
@@ -762,9 +1065,16 @@ ApplicationWindow {
                                 from: 0
                                 to: scaledContent.width - (mainWindow.selectedTextItem ? mainWindow.selectedTextItem.width : 0)
                                 value: mainWindow.selectedTextItem ? mainWindow.selectedTextItem.x : 0
+                                onPressedChanged: {
+                                    if (pressed) {
+                                        EditHistory.beginGesture(mainWindow.selectedTextItem, ["x"], "Move layer")
+                                    } else {
+                                        EditHistory.endGesture()
+                                    }
+                                }
                                 onValueChanged: {
                                     if (mainWindow.selectedTextItem && value !== mainWindow.selectedTextItem.x) {
-                                        mainWindow.selectedTextItem.x = value
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "x", value, "Move layer")
                                     }
                                 }
                             }
@@ -779,9 +1089,16 @@ ApplicationWindow {
                                 from: 0
                                 to: scaledContent.height - (mainWindow.selectedTextItem ? mainWindow.selectedTextItem.height : 0)
                                 value: mainWindow.selectedTextItem ? mainWindow.selectedTextItem.y : 0
+                                onPressedChanged: {
+                                    if (pressed) {
+                                        EditHistory.beginGesture(mainWindow.selectedTextItem, ["y"], "Move layer")
+                                    } else {
+                                        EditHistory.endGesture()
+                                    }
+                                }
                                 onValueChanged: {
                                     if (mainWindow.selectedTextItem && value !== mainWindow.selectedTextItem.y) {
-                                        mainWindow.selectedTextItem.y = value
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "y", value, "Move layer")
                                     }
                                 }
                             }
@@ -828,7 +1145,7 @@ ApplicationWindow {
                                 onClicked: {
                                     if (mainWindow.selectedTextItem) {
                                         var centerX = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                        mainWindow.selectedTextItem.x = centerX
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "x", centerX, "Align layer")
                                     }
                                 }
                             }
@@ -839,7 +1156,7 @@ ApplicationWindow {
                                 onClicked: {
                                     if (mainWindow.selectedTextItem) {
                                         var centerY = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
-                                        mainWindow.selectedTextItem.y = centerY
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "y", centerY, "Align layer")
                                     }
                                 }
                             }
@@ -868,8 +1185,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -881,8 +1197,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -894,8 +1209,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -907,8 +1221,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -918,8 +1231,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -931,8 +1243,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -944,8 +1255,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
@@ -957,8 +1267,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
@@ -970,8 +1279,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
@@ -984,7 +1292,7 @@ ApplicationWindow {
                             Layout.fillWidth: true
                             onClicked: {
                                 if (mainWindow.selectedTextItem) {
-                                    mainWindow.selectedTextItem.textRotation = 0
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "textRotation", 0, "Reset rotation")
                                 }
                             }
                         }
@@ -1031,9 +1339,16 @@ ApplicationWindow {
                                 from: 0
                                 to: scaledContent.width - (mainWindow.selectedTextItem ? mainWindow.selectedTextItem.width : 0)
                                 value: mainWindow.selectedTextItem ? mainWindow.selectedTextItem.x : 0
+                                onPressedChanged: {
+                                    if (pressed) {
+                                        EditHistory.beginGesture(mainWindow.selectedTextItem, ["x"], "Move layer")
+                                    } else {
+                                        EditHistory.endGesture()
+                                    }
+                                }
                                 onValueChanged: {
                                     if (mainWindow.selectedTextItem && value !== mainWindow.selectedTextItem.x) {
-                                        mainWindow.selectedTextItem.x = value
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "x", value, "Move layer")
                                     }
                                 }
                             }
@@ -1048,9 +1363,16 @@ ApplicationWindow {
                                 from: 0
                                 to: scaledContent.height - (mainWindow.selectedTextItem ? mainWindow.selectedTextItem.height : 0)
                                 value: mainWindow.selectedTextItem ? mainWindow.selectedTextItem.y : 0
+                                onPressedChanged: {
+                                    if (pressed) {
+                                        EditHistory.beginGesture(mainWindow.selectedTextItem, ["y"], "Move layer")
+                                    } else {
+                                        EditHistory.endGesture()
+                                    }
+                                }
                                 onValueChanged: {
                                     if (mainWindow.selectedTextItem && value !== mainWindow.selectedTextItem.y) {
-                                        mainWindow.selectedTextItem.y = value
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "y", value, "Move layer")
                                     }
                                 }
                             }
@@ -1097,7 +1419,7 @@ ApplicationWindow {
                                 onClicked: {
                                     if (mainWindow.selectedTextItem) {
                                         var centerX = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                        mainWindow.selectedTextItem.x = centerX
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "x", centerX, "Align layer")
                                     }
                                 }
                             }
@@ -1108,7 +1430,7 @@ ApplicationWindow {
                                 onClicked: {
                                     if (mainWindow.selectedTextItem) {
                                         var centerY = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
-                                        mainWindow.selectedTextItem.y = centerY
+                                        EditHistory.setProperty(mainWindow.selectedTextItem, "y", centerY, "Align layer")
                                     }
                                 }
                             }
@@ -1137,8 +1459,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1150,8 +1471,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1163,8 +1483,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = 0
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": 0 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1176,8 +1495,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1187,8 +1505,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1200,8 +1517,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = (scaledContent.height - mainWindow.selectedTextItem.height) / 2
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": (scaledContent.height - mainWindow.selectedTextItem.height) / 2 }, "Align layer")
                                         }
                                     }
                                 }
@@ -1213,8 +1529,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = 0
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": 0, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
@@ -1226,8 +1541,7 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = (scaledContent.width - mainWindow.selectedTextItem.width) / 2
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": (scaledContent.width - mainWindow.selectedTextItem.width) / 2, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
@@ -1239,21 +1553,28 @@ ApplicationWindow {
                                     height: 30
                                     onClicked: {
                                         if (mainWindow.selectedTextItem) {
-                                            mainWindow.selectedTextItem.x = scaledContent.width - mainWindow.selectedTextItem.width
-                                            mainWindow.selectedTextItem.y = scaledContent.height - mainWindow.selectedTextItem.height
+                                            EditHistory.setProperties(mainWindow.selectedTextItem, { "x": scaledContent.width - mainWindow.selectedTextItem.width, "y": scaledContent.height - mainWindow.selectedTextItem.height }, "Align layer")
                                         }
                                     }
                                 }
                             }
                         }
 
+                        MenuSeparator { Layout.fillWidth: true }
+
+                        AdjustmentsPanel {
+                            Layout.fillWidth: true
+                            target: mainWindow.selectedTextItem && !mainWindow.selectedTextItem.hasOwnProperty('textContent')
+                                    ? mainWindow.selectedTextItem : null
+                        }
+
                         MaterialButton {
                             id: imgResetBtn
                             text: "Reset rotation"
                             Layout.fillWidth: true
                             onClicked: {
                                 if (mainWindow.selectedTextItem) {
-                                    mainWindow.selectedTextItem.imageRotation = 0
+                                    EditHistory.setProperty(mainWindow.selectedTextItem, "imageRotation", 0, "Reset rotation")
                                 }
                             }
                         }
@@ -1356,22 +1677,8 @@ ApplicationWindow {
                         }
 
                         onClicked: {
-                            // Deselect all items
-                            for (var i = 0; i < scaledContent.children.length; i++) {
-                                var child = scaledContent.children[i]
-                                if (child.hasOwnProperty('selected')) {
-                                    child.selected = false
-                                }
-                            }
-
-                            // Update model selection states
-                            for (var j = 0; j < itemsModel.count; j++) {
-                                itemsModel.setProperty(j, "isSelected", false)
-                            }
-
-                            // Clear selected item and update controls
-                            mainWindow.selectedTextItem = null
-                            mainWindow.updateControls()
+                            // Deselect all items, controls follow the selection change
+                            LayerModel.clearSelection()
                         }
                     }
 
@@ -1404,14 +1711,20 @@ ApplicationWindow {
                             }
                         ]
 
-                        Image {
+                        // Tiled so only the part of the image in view is uploaded, at the level the zoom needs
+                        TiledImage {
                             id: loadedImage
+                            objectName: "baseImage"
                             anchors.centerIn: parent
                             source: mainWindow.currentImageSource
-                            fillMode: Image.PreserveAspectFit
+                            viewport: imageFlickable
                             z: -1000
-                            width: sourceSize.width
-                            height: sourceSize.height
+                            width: mainWindow.baseImageSize.width
+                            height: mainWindow.baseImageSize.height
+
+                            // Read by the export compositor
+                            property real baseRotation: mainWindow.imageRotation
+                            property var adjustments: mainWindow.baseAdjustments
 
                             // Move rotation here instead of on scaledContent
                             transform: Rotation {
@@ -1420,23 +1733,94 @@ ApplicationWindow {
                                 origin.y: loadedImage.height / 2
                             }
 
+                            // Adjustments are previewed on the GPU at screen resolution, export recomputes them
+                            layer.enabled: Constants.hasAdjustments(adjustments)
+                            layer.textureSize: Qt.size(Math.min(4096, Math.ceil(width * Math.min(1, mainWindow.zoomFactor * Screen.devicePixelRatio))),
+                                                       Math.min(4096, Math.ceil(height * Math.min(1, mainWindow.zoomFactor * Screen.devicePixelRatio))))
+                            layer.effect: AdjustmentEffect {
+                                adjustments: loadedImage.adjustments
+                                textureSize: loadedImage.layer.textureSize
+                            }
+
                             onStatusChanged: {
-                                if (status === Image.Ready && mainWindow.zoomFactor === 1.0) {
+                                if (status === TiledImage.Ready && mainWindow.zoomFactor === 1.0) {
                                     mainWindow.fitToScreen()
                                 }
                             }
+                        }
 
-                            Rectangle {
-                                objectName: "imageBorder"
-                                anchors.fill: parent
-                                color: "transparent"
-                                border.width: 2 / mainWindow.zoomFactor
-                                border.color: Colors.accentColor
+                        // Outside the base image so its layer effect leaves the border alone
+                        Rectangle {
+                            objectName: "imageBorder"
+                            anchors.fill: loadedImage
+                            z: -999
+                            color: "transparent"
+                            border.width: 2 / mainWindow.zoomFactor
+                            border.color: Colors.accentColor
+
+                            transform: Rotation {
+                                angle: mainWindow.imageRotation
+                                origin.x: loadedImage.width / 2
+                                origin.y: loadedImage.height / 2
                             }
                         }
 
                         // All text and image components will be children of scaledContent
                         // and will follow the zoom but NOT the rotation
+
+                        // Inactive layers while a layer is being edited, see flattenAround
+                        Item {
+                            id: flattenedBelow
+                            anchors.fill: parent
+                        }
+
+                        Item {
+                            id: flattenedAbove
+                            anchors.fill: parent
+                        }
+
+                        ShaderEffectSource {
+                            sourceItem: flattenedBelow
+                            hideSource: true
+                            visible: mainWindow.flattenedItem !== null
+                            z: mainWindow.flattenedItem ? mainWindow.flattenedItem.z - 0.5 : 0
+                            x: mainWindow.flattenRect.x
+                            y: mainWindow.flattenRect.y
+                            width: mainWindow.flattenRect.width
+                            height: mainWindow.flattenRect.height
+                            sourceRect: mainWindow.flattenRect
+                            textureSize: Qt.size(Math.min(4096, Math.ceil(width * mainWindow.zoomFactor * Screen.devicePixelRatio)),
+                                                 Math.min(4096, Math.ceil(height * mainWindow.zoomFactor * Screen.devicePixelRatio)))
+                        }
+
+                        ShaderEffectSource {
+                            sourceItem: flattenedAbove
+                            hideSource: true
+                            visible: mainWindow.flattenedItem !== null
+                            z: mainWindow.flattenedItem ? mainWindow.flattenedItem.z + 0.5 : 0
+                            x: mainWindow.flattenRect.x
+                            y: mainWindow.flattenRect.y
+                            width: mainWindow.flattenRect.width
+                            height: mainWindow.flattenRect.height
+                            sourceRect: mainWindow.flattenRect
+                            textureSize: Qt.size(Math.min(4096, Math.ceil(width * mainWindow.zoomFactor * Screen.devicePixelRatio)),
+                                                 Math.min(4096, Math.ceil(height * mainWindow.zoomFactor * Screen.devicePixelRatio)))
+                        }
+
+                        // Snapping guides, above every layer
+                        Repeater {
+                            model: mainWindow.snapGuides
+
+                            Rectangle {
+                                required property var modelData
+                                z: 1000000
+                                x: modelData.vertical ? modelData.position - width / 2 : 0
+                                y: modelData.vertical ? 0 : modelData.position - height / 2
+                                width: modelData.vertical ? 1 / mainWindow.zoomFactor : scaledContent.width
+                                height: modelData.vertical ? scaledContent.height : 1 / mainWindow.zoomFactor
+                                color: Colors.accentColor
+                            }
+                        }
                     }
                 }
             }
@@ -1471,7 +1855,7 @@ ApplicationWindow {
                     property bool sbVisible: ScrollBar.vertical.policy === ScrollBar.AlwaysOn
                     ListView {
                         id: itemListView
-                        model: itemsModel
+                        model: LayerModel
                         spacing: 8
                         delegate: Item {
                             id: delegateRoot
@@ -1500,7 +1884,7 @@ ApplicationWindow {
 
                                         onClicked: function(mouse) {
                                             if (mouse.button === Qt.LeftButton) {
-                                                mainWindow.selectItem(delegateRoot.model.item)
+                                                LayerModel.select(delegateRoot.model.item)
                                             } else if (mouse.button === Qt.RightButton) {
                                                 contextMenu.itemToDelete = delegateRoot.model.item
                                                 contextMenu.popup()
@@ -1542,8 +1926,10 @@ ApplicationWindow {
                                                 anchors.fill: parent
                                                 anchors.margins: 2
                                                 source: delegateRoot.model.item && !delegateRoot.model.item.hasOwnProperty('textContent') ?
-                                                       delegateRoot.model.item.source : ""
+                                                       ImageCache.cachedSource(delegateRoot.model.item.source) : ""
                                                 fillMode: Image.PreserveAspectCrop
+                                                asynchronous: true
+                                                sourceSize: Qt.size(96, 96)
                                             }
                                         }
 
@@ -1603,7 +1989,7 @@ ApplicationWindow {
                                         Layout.preferredHeight: 25
                                         Layout.preferredWidth: 25
                                         text: "▼"
-                                        enabled: delegateRoot.index < itemsModel.count - 1
+                                        enabled: delegateRoot.index < LayerModel.count - 1
                                         font.pixelSize: 8
 
                                         onClicked: {
@@ -1622,7 +2008,7 @@ ApplicationWindow {
                 font.pixelSize: 18
                 opacity: 0.5
                 anchors.centerIn: parent
-                visible: itemsModel.count === 0
+                visible: LayerModel.count === 0
             }
         }
     }
@@ -1684,37 +2070,61 @@ ApplicationWindow {
                     radius: Material.ExtraSmallScale / mainWindow.zoomFactor
                 }
 
-                Text {
+                TextLayer {
                     id: textEdit
+                    objectName: "layerContent"
                     anchors.fill: parent
                     anchors.margins: 10
                     text: "Sample Text"
                     font.family: "Arial"
                     font.pixelSize: 24
                     color: Colors.placeholderColor
-                    //selectByMouse: false
-                    wrapMode: TextEdit.Wrap
                 }
 
                 // Main mouse area for dragging and selection
                 MouseArea {
+                    id: moveArea
                     anchors.fill: parent
                     anchors.rightMargin: 8 / mainWindow.zoomFactor
                     anchors.bottomMargin: 8 / mainWindow.zoomFactor
                     anchors.topMargin: 15 / mainWindow.zoomFactor // Leave space for rotation handle
-                    drag.target: textRect
+                    drag.target: clickThrough ? null : textRect
                     drag.minimumX: 0
                     drag.maximumX: scaledContent.width - textRect.width
                     drag.minimumY: 0
                     drag.maximumY: scaledContent.height - textRect.height
 
-                    onPressed: {
+                    property bool clickThrough: false
+
+                    onPressed: (mouse) => {
                         imageFlickable.allowDrag = false
-                        mainWindow.selectItem(textRect)
+                        clickThrough = mainWindow.selectLayerUnder(moveArea, mouse)
+                        if (!clickThrough) {
+                            LayerModel.select(textRect)
+                            EditHistory.beginGesture(textRect, ["x", "y"], "Move layer")
+                            mainWindow.flattenAround(textRect)
+                        }
+                    }
+
+                    onPositionChanged: (mouse) => {
+                        if (drag.active) {
+                            mainWindow.snapLayer(textRect, mouse)
+                        }
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
+                        mainWindow.snapGuides = []
+                        if (!clickThrough) {
+                            EditHistory.endGesture()
+                        }
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        mainWindow.snapGuides = []
+                        EditHistory.endGesture()
                     }
 
                     onDoubleClicked: {
@@ -1746,11 +2156,20 @@ ApplicationWindow {
                         startAngle = Math.atan2(localMouse.y - centerY, localMouse.x - centerX) * 180 / Math.PI - textRect.textRotation
 
                         cursorShape = Qt.ClosedHandCursor
+                        EditHistory.beginGesture(textRect, ["textRotation"], "Rotate layer")
+                        mainWindow.flattenAround(textRect)
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
                         cursorShape = Qt.OpenHandCursor
+                        EditHistory.endGesture()
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
                     }
 
                     onPositionChanged: {
@@ -1788,10 +2207,20 @@ ApplicationWindow {
                         imageFlickable.allowDrag = false
                         lastMouseX = mouseX
                         lastMouseY = mouseY
+                        // Position is included, the sliders clamp it when the size changes
+                        EditHistory.beginGesture(textRect, ["x", "y", "width", "height"], "Resize layer")
+                        mainWindow.flattenAround(textRect)
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
                     }
 
                     onPositionChanged: {
@@ -1834,10 +2263,19 @@ ApplicationWindow {
             width: 300
             height: 200
 
-            property alias source: layerImage.source
+            property url source
             property alias itemLayer: imageRect.z
             property real imageRotation: 0
+            property var adjustments: Constants.defaultAdjustments
             property bool selected: false
+            // The upload stays alive while this layer exists, also while undo history keeps it hidden
+            property url retainedSource
+
+            Component.onCompleted: {
+                retainedSource = source
+                ImageCache.retain(source)
+            }
+            Component.onDestruction: ImageCache.release(retainedSource)
 
             // Update position sliders when item position changes
             onXChanged: {
@@ -1872,32 +2310,80 @@ ApplicationWindow {
 
                 Image {
                     id: layerImage
+                    objectName: "layerContent"
                     anchors.fill: parent
                     fillMode: Image.PreserveAspectFit
                     anchors.margins: 2 / mainWindow.zoomFactor
+                    source: ImageCache.cachedSource(imageRect.source)
+                    asynchronous: true
+                    retainWhileLoading: true
+
+                    // Request the mip level matching the on-screen size, not the full photo
+                    property size fullSize: imageRect.source.toString() !== "" ? ImageCache.imageSize(imageRect.source) : Qt.size(0, 0)
+                    property real mipScale: fullSize.width > 0 && fullSize.height > 0
+                                            ? mainWindow.mipScale(Math.min(width / fullSize.width, height / fullSize.height)
+                                                                  * mainWindow.zoomFactor * Screen.devicePixelRatio)
+                                            : 1
+                    sourceSize.width: Math.ceil(fullSize.width * mipScale)
+                    sourceSize.height: Math.ceil(fullSize.height * mipScale)
+
+                    // Adjustment preview, rendered at the on-screen size of the layer
+                    layer.enabled: Constants.hasAdjustments(imageRect.adjustments)
+                    layer.textureSize: Qt.size(Math.min(4096, Math.ceil(width * mainWindow.zoomFactor * Screen.devicePixelRatio)),
+                                               Math.min(4096, Math.ceil(height * mainWindow.zoomFactor * Screen.devicePixelRatio)))
+                    layer.effect: AdjustmentEffect {
+                        adjustments: imageRect.adjustments
+                        pixelSize: layerImage.fullSize.width > 0 ? layerImage.paintedWidth / layerImage.fullSize.width : 1
+                        textureSize: layerImage.layer.textureSize
+                    }
                 }
 
                 // Main mouse area for dragging and selection
                 MouseArea {
+                    id: moveArea
                     anchors.centerIn: parent
                     width: layerImage.paintedWidth
                     height: layerImage.paintedHeight
                     anchors.rightMargin: 8 / mainWindow.zoomFactor
                     anchors.bottomMargin: 8 / mainWindow.zoomFactor
                     anchors.topMargin: 15 / mainWindow.zoomFactor
-                    drag.target: imageRect
+                    drag.target: clickThrough ? null : imageRect
                     drag.minimumX: 0
                     drag.maximumX: scaledContent.width - imageRect.width
                     drag.minimumY: 0
                     drag.maximumY: scaledContent.height - imageRect.height
 
-                    onPressed: {
+                    property bool clickThrough: false
+
+                    onPressed: (mouse) => {
                         imageFlickable.allowDrag = false
-                        mainWindow.selectItem(imageRect)
+                        clickThrough = mainWindow.selectLayerUnder(moveArea, mouse)
+                        if (!clickThrough) {
+                            LayerModel.select(imageRect)
+                            EditHistory.beginGesture(imageRect, ["x", "y"], "Move layer")
+                            mainWindow.flattenAround(imageRect)
+                        }
+                    }
+
+                    onPositionChanged: (mouse) => {
+                        if (drag.active) {
+                            mainWindow.snapLayer(imageRect, mouse)
+                        }
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
+                        mainWindow.snapGuides = []
+                        if (!clickThrough) {
+                            EditHistory.endGesture()
+                        }
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        mainWindow.snapGuides = []
+                        EditHistory.endGesture()
                     }
                 }
 
@@ -1924,11 +2410,20 @@ ApplicationWindow {
                         startAngle = Math.atan2(localMouse.y - centerY, localMouse.x - centerX) * 180 / Math.PI - imageRect.imageRotation
 
                         cursorShape = Qt.ClosedHandCursor
+                        EditHistory.beginGesture(imageRect, ["imageRotation"], "Rotate layer")
+                        mainWindow.flattenAround(imageRect)
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
                         cursorShape = Qt.OpenHandCursor
+                        EditHistory.endGesture()
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
                     }
 
                     onPositionChanged: {
@@ -1966,10 +2461,20 @@ ApplicationWindow {
                         imageFlickable.allowDrag = false
                         lastMouseX = mouseX
                         lastMouseY = mouseY
+                        // Position is included, the sliders clamp it when the size changes
+                        EditHistory.beginGesture(imageRect, ["x", "y", "width", "height"], "Resize layer")
+                        mainWindow.flattenAround(imageRect)
                     }
 
                     onReleased: {
                         imageFlickable.allowDrag = true
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
+                    }
+
+                    onCanceled: {
+                        mainWindow.unflatten()
+                        EditHistory.endGesture()
                     }
 
                     onPositionChanged: {
@@ -2013,193 +2518,96 @@ ApplicationWindow {
     }
 
     function moveItemUp(item) {
-        var currentIndex = -1
-
-        // Find current index
-        for (var i = 0; i < itemsModel.count; i++) {
-            if (itemsModel.get(i).item === item) {
-                currentIndex = i
-                break
-            }
-        }
-
-        if (currentIndex > 0) {
-            // Swap with item above
-            var itemAbove = itemsModel.get(currentIndex - 1)
-            var currentItem = itemsModel.get(currentIndex)
-
-            var tempLayer = itemAbove.layer
-            itemAbove.item.itemLayer = currentItem.layer
-            currentItem.item.itemLayer = tempLayer
-
-            // Update model
-            itemsModel.setProperty(currentIndex - 1, "layer", currentItem.layer)
-            itemsModel.setProperty(currentIndex, "layer", tempLayer)
-
-            // Move in model (swap positions)
-            itemsModel.move(currentIndex, currentIndex - 1, 1)
+        if (LayerModel.shift(item, -1)) {
+            EditHistory.pushAction("Move layer up",
+                                   function() { LayerModel.shift(item, 1) },
+                                   function() { LayerModel.shift(item, -1) })
         }
     }
 
     function moveItemDown(item) {
-        var currentIndex = -1
-
-        // Find current index
-        for (var i = 0; i < itemsModel.count; i++) {
-            if (itemsModel.get(i).item === item) {
-                currentIndex = i
-                break
-            }
-        }
-
-        if (currentIndex < itemsModel.count - 1 && currentIndex >= 0) {
-            // Swap with item below
-            var itemBelow = itemsModel.get(currentIndex + 1)
-            var currentItem = itemsModel.get(currentIndex)
-
-            var tempLayer = itemBelow.layer
-            itemBelow.item.itemLayer = currentItem.layer
-            currentItem.item.itemLayer = tempLayer
-
-            // Update model
-            itemsModel.setProperty(currentIndex + 1, "layer", currentItem.layer)
-            itemsModel.setProperty(currentIndex, "layer", tempLayer)
-
-            // Move in model (swap positions)
-            itemsModel.move(currentIndex, currentIndex + 1, 1)
+        if (LayerModel.shift(item, 1)) {
+            EditHistory.pushAction("Move layer down",
+                                   function() { LayerModel.shift(item, -1) },
+                                   function() { LayerModel.shift(item, 1) })
         }
     }
 
-    function addItemToModel(item) {
-        var preview, type, details
-
+    // Approximate memory a layer keeps alive while it only exists in the undo history
+    function layerCost(item) {
         if (item.hasOwnProperty('textContent')) {
-            // Text item
-            preview = item.textContent.length > 20 ?
-                        item.textContent.substring(0, 20) + "..." :
-                        item.textContent
-            type = "Text"
-            details = item.fontFamily + " " + item.fontSize + "pt"
-        } else {
-            // Image item
-            if (Qt.platform.os === "wasm") {
-                preview = "Imported image"
-            } else {
-                var fileName = item.source.toString().split('/').pop()
-                preview = fileName.length > 20 ? fileName.substring(0, 20) + "..." : fileName
-            }
-            type = "Image"
-            details = Math.round(item.width) + "×" + Math.round(item.height)
-        }
-
-        // Find the highest z value and increment by 1
-        var highestZ = 0
-        for (var i = 0; i < itemsModel.count; i++) {
-            var existingItem = itemsModel.get(i)
-            if (existingItem.layer > highestZ) {
-                highestZ = existingItem.layer
-            }
-        }
-
-        // Set new item's layer to be on top
-        var newLayer = highestZ + 1
-        item.itemLayer = newLayer
-
-        // Insert at the beginning (top of list = highest z)
-        itemsModel.insert(0, {
-                              item: item,
-                              preview: preview || "Empty",
-                              type: type,
-                              details: details,
-                              layer: newLayer,
-                              isSelected: true
-                          })
-
-        // Deselect all other items
-        for (var j = 1; j < itemsModel.count; j++) {
-            itemsModel.setProperty(j, "isSelected", false)
+            return 1024 + item.textContent.length * 2
         }
+        var size = ImageCache.imageSize(item.source)
+        return size.width * size.height * 4
     }
 
-    function updateItemPreview(item) {
-        for (var i = 0; i < itemsModel.count; i++) {
-            var modelItem = itemsModel.get(i)
-            if (modelItem.item === item) {
-                var preview, details
-
-                if (item.hasOwnProperty('textContent')) {
-                    preview = item.textContent.length > 20 ?
-                                item.textContent.substring(0, 20) + "..." :
-                                item.textContent
-                    details = item.fontFamily + " " + item.fontSize + "pt"
-                } else {
-                    if (Qt.platform.os === "wasm") {
-                        preview = "Imported image"
-                    } else {
-                        var fileName = item.source.toString().split('/').pop()
-                        preview = fileName.length > 20 ? fileName.substring(0, 20) + "..." : fileName
-                    }
-                    details = Math.round(item.width) + "×" + Math.round(item.height)
-                }
-
-                itemsModel.setProperty(i, "preview", preview || "Empty")
-                itemsModel.setProperty(i, "details", details)
-                itemsModel.setProperty(i, "layer", item.itemLayer)
+    function addLayer(item, type) {
+        LayerModel.add(item, type)
+        LayerModel.select(item)
+        EditHistory.pushAction(type === LayerModel.Text ? "Add text layer" : "Add image layer",
+                               function() { mainWindow.removeLayer(item) },
+                               function() { mainWindow.restoreLayer(item) },
+                               function(applied) { if (!applied) item.destroy() },
+                               layerCost(item))
+    }
 
-                // Force the ListView to update by emitting dataChanged
-                // This ensures visual previews refresh when properties change
-                break
-            }
-        }
+    // Deleted layers are only hidden so undo can bring them back
+    function removeLayer(item) {
+        // Also clears the selection if this was selected
+        LayerModel.remove(item)
+        item.visible = false
     }
 
-    function selectItem(item) {
-        // Deselect all items first
-        for (var j = 0; j < scaledContent.children.length; j++) {
-            var child = scaledContent.children[j]
-            if (child.hasOwnProperty('selected')) {
-                child.selected = false
-            }
-        }
+    function restoreLayer(item) {
+        item.visible = true
+        LayerModel.restore(item)
+        LayerModel.select(item)
+    }
 
-        // Update model selection states
-        for (var i = 0; i < itemsModel.count; i++) {
-            var isSelected = itemsModel.get(i).item === item
-            itemsModel.setProperty(i, "isSelected", isSelected)
+    // Replaces the current document, the history of the previous one does not apply anymore
+    function loadProject(project) {
+        EditHistory.clear()
+        LayerModel.clearSelection()
+        for (var i = LayerModel.count - 1; i >= 0; i--) {
+            var item = LayerModel.itemAt(i)
+            LayerModel.remove(item)
+            item.destroy()
         }
 
-        // Select the target item
-        if (item && item.hasOwnProperty('selected')) {
-            item.selected = true
+        mainWindow.imageRotation = project.baseRotation
+        mainWindow.baseAdjustments = project.baseAdjustments
+        mainWindow.currentImageSource = project.baseSource
+        imageContainer.visible = true
+
+        // Layers come bottom first, adding them in order restores the stacking
+        for (var j = 0; j < project.layers.length; j++) {
+            var layer = project.layers[j]
+            var isText = layer.type === "text"
+            var layerItem = (isText ? textComponent : imageComponent).createObject(scaledContent, layer.properties)
+            LayerModel.add(layerItem, isText ? LayerModel.Text : LayerModel.Image)
         }
 
-        mainWindow.selectedTextItem = item
-        mainWindow.updateControls()
+        Qt.callLater(function() {
+            mainWindow.fitToScreen()
+        })
     }
 
     function deleteItem(item) {
-        // Remove from model
-        for (var i = 0; i < itemsModel.count; i++) {
-            if (itemsModel.get(i).item === item) {
-                itemsModel.remove(i)
-                break
-            }
-        }
-
-        // Clear selection if this was selected
-        if (mainWindow.selectedTextItem === item) {
-            mainWindow.selectedTextItem = null
-            mainWindow.updateControls()
-        }
-
-        // Destroy the item
-        item.destroy()
+        removeLayer(item)
+
+        // The item is destroyed once the delete can no longer be undone
+        EditHistory.pushAction("Delete layer",
+                               function() { mainWindow.restoreLayer(item) },
+                               function() { mainWindow.removeLayer(item) },
+                               function(applied) { if (applied) item.destroy() },
+                               layerCost(item))
     }
 
     function updateControls() {
         if (selectedTextItem && selectedTextItem.hasOwnProperty('textContent')) {
             textContent.text = selectedTextItem.textContent
-            fontFamily.currentIndex = fontFamily.find(selectedTextItem.fontFamily)
+            fontFamily.family = selectedTextItem.fontFamily
             fontSize.value = selectedTextItem.fontSize
             boldCheck.checked = selectedTextItem.fontBold
             italicCheck.checked = selectedTextItem.fontItalic
@@ -2227,7 +2635,7 @@ ApplicationWindow {
         } else {
             // Clear controls when nothing is selected
             textContent.text = ""
-            fontFamily.currentIndex = -1
+            fontFamily.family = ""
             fontSize.value = 24
             boldCheck.checked = false
             italicCheck.checked = false
@@ -2,6 +2,7 @@ pragma ComponentBehavior: Bound
 import QtQuick
 import QtQuick.Controls.Material
 import QtQuick.Layouts
+import Odizinne.QuickEdits
 
 Dialog {
     id: root
@@ -17,8 +18,9 @@ Dialog {
     property real originalHeight: 1080
     property real aspectRatio: originalWidth / originalHeight
     property bool updatingResolution: false
+    property bool variantsNeedMatte: false
 
-    signal fileNameAccepted(string fileName, int width, int height)
+    signal fileNameAccepted(string fileName, int width, int height, var variants)
     signal fileNameRejected()
 
     standardButtons: Dialog.Ok | Dialog.Cancel
@@ -45,8 +47,15 @@ Dialog {
         // Add selected extension
         fileName = nameWithoutExt + '.' + selectedExtension
 
+        // Extra sizes of the same export, see ImageExporter.grabImageAndSave
+        var variants = []
+        for (var j = 0; j < variantModel.count; j++) {
+            var variant = variantModel.get(j)
+            variants.push({ format: variant.format, size: variant.size, quality: variant.quality })
+        }
+
         finalFileName = fileName
-        fileNameAccepted(fileName, widthSpinBox.value, heightSpinBox.value)
+        fileNameAccepted(fileName, widthSpinBox.value, heightSpinBox.value, variants)
     }
 
     onRejected: {
@@ -201,6 +210,119 @@ Dialog {
                 Layout.fillWidth: true
             }
         }
+
+        MenuSeparator {
+            Layout.fillWidth: true
+        }
+
+        Label {
+            Layout.fillWidth: true
+            text: "Additional sizes:"
+            font.bold: true
+        }
+
+        Label {
+            Layout.fillWidth: true
+            text: "Smaller copies exported in the same pass. Sizes are the long edge in pixels, quality applies to jpg and webp."
+            wrapMode: Text.Wrap
+            opacity: 0.7
+            visible: variantModel.count > 0
+        }
+
+        Repeater {
+            model: variantModel
+
+            delegate: RowLayout {
+                id: variantRow
+                required property int index
+                required property string format
+                required property int size
+                required property int quality
+                Layout.fillWidth: true
+                spacing: 10
+
+                ComboBox {
+                    Layout.preferredHeight: 35
+                    Layout.preferredWidth: 80
+                    model: ["png", "jpg", "bmp", "webp"]
+                    currentIndex: Math.max(0, model.indexOf(variantRow.format))
+                    onActivated: variantModel.setProperty(variantRow.index, "format", currentText)
+                }
+
+                SpinBox {
+                    Layout.preferredWidth: 120
+                    Layout.preferredHeight: 35
+                    from: 1
+                    to: Math.max(widthSpinBox.value, heightSpinBox.value)
+                    value: variantRow.size
+                    editable: true
+
+                    textFromValue: function(value, locale) {
+                        return value.toString()
+                    }
+
+                    onValueModified: variantModel.setProperty(variantRow.index, "size", value)
+                }
+
+                SpinBox {
+                    Layout.preferredWidth: 100
+                    Layout.preferredHeight: 35
+                    from: 1
+                    to: 100
+                    value: variantRow.quality
+                    editable: true
+                    enabled: variantRow.format === "jpg" || variantRow.format === "webp"
+                    onValueModified: variantModel.setProperty(variantRow.index, "quality", value)
+                }
+
+                Item {
+                    Layout.fillWidth: true
+                }
+
+                MaterialButton {
+                    text: "Remove"
+                    Layout.preferredWidth: implicitWidth + 20
+                    onClicked: variantModel.remove(variantRow.index)
+                }
+            }
+        }
+
+        MaterialButton {
+            text: "Add Size"
+            Layout.preferredWidth: implicitWidth + 20
+            onClicked: {
+                // A web sized JPEG first, thumbnails after that
+                var longEdge = Math.max(widthSpinBox.value, heightSpinBox.value)
+                var first = variantModel.count === 0
+                variantModel.append({
+                    format: first ? "jpg" : "webp",
+                    size: Math.min(first ? 2048 : 512, longEdge),
+                    quality: 90
+                })
+            }
+        }
+
+        // JPEG and BMP have no alpha channel, transparent areas are filled with this color
+        RowLayout {
+            Layout.fillWidth: true
+            spacing: 10
+            visible: formatCombo.currentText === "jpg" || formatCombo.currentText === "bmp" || root.variantsNeedMatte
+
+            Label {
+                text: "Transparent areas:"
+            }
+
+            ComboBox {
+                id: matteCombo
+                Layout.preferredHeight: 35
+                Layout.preferredWidth: 120
+                model: ["White", "Black"]
+                currentIndex: Qt.colorEqual(ImageExporter.matteColor, "black") ? 1 : 0
+                onActivated: function(index) {
+                    ImageExporter.matteColor = index === 1 ? "black" : "white"
+                }
+            }
+        }
     }
 
     function setFileName(fileName) {
@@ -236,6 +358,33 @@ Dialog {
         fileNameField.selectAll()
     }
 
+    ListModel {
+        id: variantModel
+    }
+
+    Connections {
+        target: variantModel
+
+        function onCountChanged() {
+            root.updateVariantsNeedMatte()
+        }
+
+        function onDataChanged() {
+            root.updateVariantsNeedMatte()
+        }
+    }
+
+    function updateVariantsNeedMatte() {
+        var needed = false
+        for (var i = 0; i < variantModel.count; i++) {
+            var format = variantModel.get(i).format
+            if (format === "jpg" || format === "bmp") {
+                needed = true
+            }
+        }
+        variantsNeedMatte = needed
+    }
+
     function setOriginalResolution(width, height) {
         originalWidth = width
         originalHeight = height
@@ -248,4 +397,68 @@ Dialog {
         heightSpinBox.value = height
         updatingResolution = false
     }
+
+    // Export progress, stays open after the naming dialog closes
+    Dialog {
+        id: exportProgressDialog
+        title: "Exporting Image"
+        modal: true
+        width: 400
+        parent: Overlay.overlay
+        anchors.centerIn: parent
+        closePolicy: Popup.NoAutoClose
+        Material.roundedScale: Material.ExtraSmallScale
+
+        property string exportFileName: ""
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: 15
+
+            Label {
+                Layout.fillWidth: true
+                text: exportProgressDialog.exportFileName
+                elide: Text.ElideMiddle
+                opacity: 0.7
+            }
+
+            ProgressBar {
+                Layout.fillWidth: true
+                from: 0
+                to: 1
+                value: ImageExporter.exportProgress
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+
+                Label {
+                    text: Math.round(ImageExporter.exportProgress * 100) + "%"
+                }
+
+                Item {
+                    Layout.fillWidth: true
+                }
+
+                MaterialButton {
+                    text: "Cancel"
+                    Layout.preferredWidth: implicitWidth + 20
+                    onClicked: ImageExporter.cancelExport()
+                }
+            }
+        }
+    }
+
+    Connections {
+        target: ImageExporter
+
+        function onExportStarted(fileName) {
+            exportProgressDialog.exportFileName = fileName
+            exportProgressDialog.open()
+        }
+
+        function onExportFinished(success, fileName) {
+            exportProgressDialog.close()
+        }
+    }
 }
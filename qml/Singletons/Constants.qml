@@ -3,5 +3,27 @@ import QtQuick
 import Odizinne.QuickEdits
 
 QtObject {
+    // Neutral adjustment stack, the same defaults as the C++ Adjustments struct
+    readonly property var defaultAdjustments: ({
+        "brightness": 0,
+        "contrast": 0,
+        "saturation": 0,
+        "blackPoint": 0,
+        "whitePoint": 1,
+        "gamma": 1,
+        "blur": 0
+    })
 
+    function adjustmentValue(adjustments, name) {
+        return adjustments && adjustments[name] !== undefined ? adjustments[name] : defaultAdjustments[name]
+    }
+
+    function hasAdjustments(adjustments) {
+        for (var name in defaultAdjustments) {
+            if (adjustmentValue(adjustments, name) !== defaultAdjustments[name]) {
+                return true
+            }
+        }
+        return false
+    }
 }
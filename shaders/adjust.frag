@@ -0,0 +1,35 @@
+#version 440
+
+// Levels, brightness, contrast and saturation of the adjustment preview.
+// Must stay in step with Adjustments::apply(), which renders the export.
+
+layout(location = 0) in vec2 qt_TexCoord0;
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    float qt_Opacity;
+    float brightness;
+    float contrast;
+    float saturation;
+    float blackPoint;
+    float whitePoint;
+    float gamma;
+};
+
+layout(binding = 1) uniform sampler2D source;
+
+void main()
+{
+    vec4 color = texture(source, qt_TexCoord0);
+    if (color.a > 0.0) {
+        vec3 c = color.rgb / color.a;
+        c = clamp((c - blackPoint) / max(whitePoint - blackPoint, 1.0 / 255.0), 0.0, 1.0);
+        c = pow(c, vec3(1.0 / gamma));
+        c = (c + brightness - 0.5) * (1.0 + contrast) + 0.5;
+        float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));
+        c = clamp(mix(vec3(luma), c, 1.0 + saturation), 0.0, 1.0);
+        color.rgb = c * color.a;
+    }
+    fragColor = color * qt_Opacity;
+}
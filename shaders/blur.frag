@@ -0,0 +1,32 @@
+#version 440
+
+// One direction of the adjustment preview blur, run once horizontally and once vertically.
+// Export uses a box blur approximation of the same Gaussian, see Adjustments::apply().
+
+layout(location = 0) in vec2 qt_TexCoord0;
+layout(location = 0) out vec4 fragColor;
+
+layout(std140, binding = 0) uniform buf {
+    mat4 qt_Matrix;
+    float qt_Opacity;
+    vec2 direction;     // texture coordinate step between two taps
+};
+
+layout(binding = 1) uniform sampler2D source;
+
+// Taps on each side of the center, the last one sits at the blur radius
+const int Taps = 12;
+const float Sigma = float(Taps) / 3.0;
+
+void main()
+{
+    vec4 sum = texture(source, qt_TexCoord0);
+    float total = 1.0;
+    for (int i = 1; i <= Taps; ++i) {
+        float weight = exp(-0.5 * float(i * i) / (Sigma * Sigma));
+        sum += weight * (texture(source, qt_TexCoord0 + direction * float(i))
+                         + texture(source, qt_TexCoord0 - direction * float(i)));
+        total += 2.0 * weight;
+    }
+    fragColor = sum / total * qt_Opacity;
+}
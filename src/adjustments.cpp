@@ -0,0 +1,218 @@
+#include "adjustments.h"
+#include "tracer.h"
+#include <QJSValue>
+#include <cmath>
+#include <vector>
+
+namespace {
+// Three box blurs in a row are within a few percent of a Gaussian and cost the same for any radius
+const int BoxPasses = 3;
+
+// Box widths whose successive application approximates a Gaussian of the given sigma
+std::vector<int> boxRadii(double sigma)
+{
+    const double idealWidth = std::sqrt(12.0 * sigma * sigma / BoxPasses + 1.0);
+    int lower = int(std::floor(idealWidth));
+    if (lower % 2 == 0) {
+        --lower;
+    }
+    const int upper = lower + 2;
+    const double idealCount = (12.0 * sigma * sigma - BoxPasses * lower * lower - 4.0 * BoxPasses * lower - 3.0 * BoxPasses)
+                              / (-4.0 * lower - 4.0);
+    const int lowerCount = int(std::lround(idealCount));
+
+    std::vector<int> radii;
+    for (int i = 0; i < BoxPasses; ++i) {
+        radii.push_back(((i < lowerCount ? lower : upper) - 1) / 2);
+    }
+    return radii;
+}
+
+// Running sum box blur of premultiplied pixels along rows, edges repeat the border pixel
+void boxBlurRows(const QImage& source, QImage& target, int radius)
+{
+    const int width = source.width();
+    const int window = radius * 2 + 1;
+    for (int y = 0; y < source.height(); ++y) {
+        const uchar* in = source.constScanLine(y);
+        uchar* out = target.scanLine(y);
+        int sum[4] = { 0, 0, 0, 0 };
+        for (int i = -radius; i <= radius; ++i) {
+            const uchar* pixel = in + qBound(0, i, width - 1) * 4;
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += pixel[c];
+            }
+        }
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = uchar((sum[c] + window / 2) / window);
+            }
+            const uchar* leaving = in + qMax(0, x - radius) * 4;
+            const uchar* entering = in + qMin(width - 1, x + radius + 1) * 4;
+            for (int c = 0; c < 4; ++c) {
+                sum[c] += entering[c] - leaving[c];
+            }
+        }
+    }
+}
+
+// Same along columns, one row of running sums keeps the memory access sequential
+void boxBlurColumns(const QImage& source, QImage& target, int radius)
+{
+    const int height = source.height();
+    const int values = source.width() * 4;
+    const int window = radius * 2 + 1;
+    std::vector<int> sums(values, 0);
+    for (int i = -radius; i <= radius; ++i) {
+        const uchar* row = source.constScanLine(qBound(0, i, height - 1));
+        for (int v = 0; v < values; ++v) {
+            sums[v] += row[v];
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        uchar* out = target.scanLine(y);
+        for (int v = 0; v < values; ++v) {
+            out[v] = uchar((sums[v] + window / 2) / window);
+        }
+        const uchar* leaving = source.constScanLine(qMax(0, y - radius));
+        const uchar* entering = source.constScanLine(qMin(height - 1, y + radius + 1));
+        for (int v = 0; v < values; ++v) {
+            sums[v] += entering[v] - leaving[v];
+        }
+    }
+}
+
+QImage gaussianBlur(const QImage& image, qreal radius)
+{
+    TRACE_SCOPE("image", "blur");
+    // The shader samples +-radius with sigma = radius / 3
+    const std::vector<int> radii = boxRadii(radius / 3.0);
+    QImage current = image;
+    QImage scratch(image.size(), image.format());
+    for (int boxRadius : radii) {
+        if (boxRadius <= 0) {
+            continue;
+        }
+        boxBlurRows(current, scratch, boxRadius);
+        if (current.constBits() == image.constBits()) {
+            current = QImage(image.size(), image.format());
+        }
+        boxBlurColumns(scratch, current, boxRadius);
+    }
+    return current;
+}
+
+qreal readValue(const QVariantMap& map, const char* name, qreal fallback)
+{
+    const QVariant value = map.value(QLatin1StringView(name));
+    bool ok = false;
+    const qreal number = value.toReal(&ok);
+    return ok && std::isfinite(number) ? number : fallback;
+}
+}
+
+bool Adjustments::isIdentity() const
+{
+    return *this == Adjustments();
+}
+
+bool Adjustments::operator==(const Adjustments& other) const
+{
+    return brightness == other.brightness && contrast == other.contrast && saturation == other.saturation
+           && blackPoint == other.blackPoint && whitePoint == other.whitePoint && gamma == other.gamma
+           && blur == other.blur;
+}
+
+QString Adjustments::key() const
+{
+    return QStringLiteral("%1,%2,%3,%4,%5,%6,%7")
+        .arg(brightness).arg(contrast).arg(saturation).arg(blackPoint).arg(whitePoint).arg(gamma).arg(blur);
+}
+
+QVariantMap Adjustments::toMap() const
+{
+    return {
+        { "brightness", brightness },
+        { "contrast", contrast },
+        { "saturation", saturation },
+        { "blackPoint", blackPoint },
+        { "whitePoint", whitePoint },
+        { "gamma", gamma },
+        { "blur", blur }
+    };
+}
+
+Adjustments Adjustments::fromVariant(const QVariant& value)
+{
+    const QVariantMap map = value.metaType() == QMetaType::fromType<QJSValue>()
+                                ? value.value<QJSValue>().toVariant().toMap()
+                                : value.toMap();
+
+    Adjustments adjustments;
+    adjustments.brightness = qBound(-1.0, readValue(map, "brightness", 0.0), 1.0);
+    adjustments.contrast = qBound(-1.0, readValue(map, "contrast", 0.0), 1.0);
+    adjustments.saturation = qBound(-1.0, readValue(map, "saturation", 0.0), 1.0);
+    adjustments.blackPoint = qBound(0.0, readValue(map, "blackPoint", 0.0), 1.0);
+    adjustments.whitePoint = qBound(0.0, readValue(map, "whitePoint", 1.0), 1.0);
+    adjustments.gamma = qBound(0.1, readValue(map, "gamma", 1.0), 10.0);
+    adjustments.blur = qMax(0.0, readValue(map, "blur", 0.0));
+    return adjustments;
+}
+
+QImage Adjustments::apply(const QImage& image) const
+{
+    if (image.isNull() || isIdentity()) {
+        return image;
+    }
+    TRACE_SCOPE("image", "apply adjustments");
+
+    const bool opaque = image.format() == QImage::Format_RGB32;
+    QImage result = image.convertToFormat(opaque ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied);
+
+    // Blurred premultiplied, so transparent pixels do not bleed dark fringes
+    if (blur >= 0.5) {
+        result = gaussianBlur(result, blur);
+    }
+
+    const Adjustments neutral;
+    if (brightness == neutral.brightness && contrast == neutral.contrast && saturation == neutral.saturation
+        && blackPoint == neutral.blackPoint && whitePoint == neutral.whitePoint && gamma == neutral.gamma) {
+        return result;
+    }
+
+    // Levels, brightness and contrast act on each channel alone, one table covers them
+    float tone[256];
+    const double range = qMax(whitePoint - blackPoint, 1.0 / 255.0);
+    for (int i = 0; i < 256; ++i) {
+        double value = qBound(0.0, (i / 255.0 - blackPoint) / range, 1.0);
+        value = std::pow(value, 1.0 / gamma);
+        tone[i] = float((value + brightness - 0.5) * (1.0 + contrast) + 0.5);
+    }
+
+    const float saturationFactor = float(1.0 + saturation);
+    for (int y = 0; y < result.height(); ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(y));
+        for (int x = 0; x < result.width(); ++x) {
+            const QRgb pixel = line[x];
+            const int alpha = qAlpha(pixel);
+            if (alpha == 0) {
+                continue;
+            }
+
+            // Straight color in, premultiplied out, like the shader
+            const QRgb straight = alpha == 255 ? pixel : qUnpremultiply(pixel);
+            const float red = tone[qRed(straight)];
+            const float green = tone[qGreen(straight)];
+            const float blue = tone[qBlue(straight)];
+            const float luma = 0.2126f * red + 0.7152f * green + 0.0722f * blue;
+
+            auto channel = [&](float value) {
+                const float saturated = qBound(0.0f, luma + (value - luma) * saturationFactor, 1.0f);
+                return int(saturated * alpha + 0.5f);
+            };
+            line[x] = qRgba(channel(red), channel(green), channel(blue), alpha);
+        }
+    }
+
+    return result;
+}
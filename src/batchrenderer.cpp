@@ -0,0 +1,381 @@
+#include "batchrenderer.h"
+#include "imagecache.h"
+#include "imagestore.h"
+#include "projectfile.h"
+#include "tracer.h"
+#include <QBuffer>
+#include <QCborArray>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+
+namespace {
+const QStringList ImageFilters = { "*.png", "*.jpg", "*.jpeg", "*.bmp", "*.webp" };
+
+// Progress is reported every this many images
+const int ProgressInterval = 100;
+
+// RFC 4180 style: quoted fields may contain separators, newlines and doubled quotes
+QList<QStringList> parseCsv(const QString& text)
+{
+    QList<QStringList> rows;
+    QStringList row;
+    QString field;
+    bool quoted = false;
+
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        const QChar c = text.at(i);
+        if (quoted) {
+            if (c == '"' && i + 1 < text.size() && text.at(i + 1) == '"') {
+                field += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            row.append(field);
+            field.clear();
+        } else if (c == '\n' || c == '\r') {
+            if (c == '\r' && i + 1 < text.size() && text.at(i + 1) == '\n') {
+                ++i;
+            }
+            row.append(field);
+            field.clear();
+            if (row.size() > 1 || !row.first().isEmpty()) {
+                rows.append(row);
+            }
+            row.clear();
+        } else {
+            field += c;
+        }
+    }
+
+    if (!field.isEmpty() || !row.isEmpty()) {
+        row.append(field);
+        rows.append(row);
+    }
+    return rows;
+}
+
+QString substitute(QString text, const QHash<QString, QString>& fields)
+{
+    for (auto it = fields.constBegin(); it != fields.constEnd(); ++it) {
+        text.replace("{" + it.key() + "}", it.value());
+    }
+    return text;
+}
+
+QRectF rectFromCbor(const QCborValue& value, const QRectF& fallback)
+{
+    const QCborArray array = value.toArray();
+    if (array.size() != 4) {
+        return fallback;
+    }
+    return QRectF(array.at(0).toDouble(), array.at(1).toDouble(), array.at(2).toDouble(), array.at(3).toDouble());
+}
+}
+
+BatchRenderer::BatchRenderer() = default;
+
+bool BatchRenderer::isBatchInvocation(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0 || std::strncmp(argv[i], "--batch=", 8) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BatchRenderer::run(const QStringList& arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Applies the layers of a QuickEdits project to a batch of images.");
+    parser.addHelpOption();
+
+    QCommandLineOption batchOption("batch", "Project (.qedit) whose layers are stamped on every image.", "template");
+    QCommandLineOption inputOption("input", "Directory of images, or a CSV file with an \"image\" column, "
+                                   "an optional \"output\" column and one column per {placeholder}.", "path");
+    QCommandLineOption outputOption("output", "Directory the rendered images are written to.", "directory");
+    QCommandLineOption formatOption("format", "Output format (png, jpg, bmp, webp), defaults to the input format.", "format");
+    QCommandLineOption qualityOption("quality", "Encoder quality from 0 to 100 for lossy formats.", "quality", "-1");
+    QCommandLineOption jobsOption("jobs", "Images rendered in parallel, defaults to the number of cores.", "count");
+    parser.addOptions({ batchOption, inputOption, outputOption, formatOption, qualityOption, jobsOption });
+    parser.process(arguments);
+
+    if (!parser.isSet(inputOption) || !parser.isSet(outputOption)) {
+        qCritical().noquote() << "--batch needs --input and --output\n" << parser.helpText();
+        return 2;
+    }
+
+    BatchRenderer renderer;
+    QString error;
+    if (!renderer.loadTemplate(parser.value(batchOption), &error)
+        || !renderer.loadJobs(parser.value(inputOption), parser.value(outputOption),
+                              parser.value(formatOption).toLower(), &error)) {
+        qCritical().noquote() << error;
+        return 1;
+    }
+
+    int threadCount = parser.isSet(jobsOption) ? parser.value(jobsOption).toInt() : QThread::idealThreadCount();
+    int failed = renderer.renderAll(qMax(1, threadCount), parser.value(qualityOption).toInt());
+    return failed == 0 ? 0 : 1;
+}
+
+bool BatchRenderer::loadTemplate(const QString& filePath, QString* error)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("Could not open template %1: %2").arg(filePath, file.errorString());
+        return false;
+    }
+    m_templateData = file.readAll();
+
+    ProjectFile::Archive archive;
+    if (!ProjectFile::parse(m_templateData.constData(), m_templateData.size(), archive, error)) {
+        return false;
+    }
+
+    const QCborMap& document = archive.document;
+    const QCborArray scene = document[QStringLiteral("scene")].toArray();
+    if (scene.size() == 2) {
+        m_templateSize = QSizeF(scene.at(0).toDouble(), scene.at(1).toDouble());
+    } else {
+        // Projects without a scene size were laid out on the base image itself
+        QByteArray base = archive.chunk(document[QStringLiteral("base")][QStringLiteral("asset")].toInteger(-1),
+                                        ProjectFile::ImageChunk);
+        QBuffer buffer(&base);
+        QImageReader reader(&buffer);
+        reader.setAutoTransform(true);
+        m_templateSize = reader.size();
+    }
+    if (m_templateSize.isEmpty()) {
+        *error = QString("Template %1 has no usable canvas size").arg(filePath);
+        return false;
+    }
+
+    m_baseAdjustments = Adjustments::fromVariant(
+        document[QStringLiteral("base")][QStringLiteral("adjustments")].toMap().toVariantMap());
+
+    const QCborArray layers = document[QStringLiteral("layers")].toArray();
+    for (const QCborValue& value : layers) {
+        const QCborMap properties = value[QStringLiteral("properties")].toMap();
+        auto property = [&properties](const char* name) {
+            return properties.value(QLatin1StringView(name));
+        };
+
+        SceneLayer layer;
+        layer.z = m_layers.size();
+        layer.geometry = QRectF(property("x").toDouble(), property("y").toDouble(),
+                                property("width").toDouble(), property("height").toDouble());
+        layer.contentRect = rectFromCbor(value[QStringLiteral("content")], QRectF(QPointF(0, 0), layer.geometry.size()));
+
+        QString type = value[QStringLiteral("type")].toString();
+        if (type == "text") {
+            layer.type = SceneLayer::Text;
+            layer.text = property("textContent").toString();
+            layer.rotation = property("textRotation").toDouble();
+            layer.color = QColor::fromString(property("textColor").toString());
+
+            QString family = property("fontFamily").toString();
+            QByteArray fontData = archive.chunk(value[QStringLiteral("font")].toInteger(-1), ProjectFile::FontChunk);
+            if (!fontData.isEmpty() && !QFontDatabase::hasFamily(family)) {
+                // Registered for this process only, batch runs leave the font library alone
+                QFontDatabase::addApplicationFontFromData(fontData);
+            }
+
+            QFont font(family);
+            font.setPixelSize(qMax(1, int(property("fontSize").toInteger())));
+            font.setBold(property("fontBold").toBool());
+            font.setItalic(property("fontItalic").toBool());
+            font.setUnderline(property("fontUnderline").toBool());
+            font.setStrikeOut(property("fontStrikeout").toBool());
+            layer.font = font;
+        } else if (type == "image") {
+            QByteArray image = archive.chunk(value[QStringLiteral("asset")].toInteger(-1), ProjectFile::ImageChunk);
+            if (image.isEmpty()) {
+                qWarning() << "Skipping template image layer with a missing asset";
+                continue;
+            }
+            // Shared by every task, ImageCache decodes it once
+            layer.type = SceneLayer::Image;
+            layer.source = ImageStore::urlForId(ImageStore::instance()->insert(image));
+            layer.rotation = property("imageRotation").toDouble();
+            layer.adjustments = Adjustments::fromVariant(property("adjustments").toMap().toVariantMap());
+        } else {
+            continue;
+        }
+
+        m_layers.append(layer);
+    }
+
+    qInfo() << "Template" << filePath << "with" << m_layers.size() << "layers on a"
+            << m_templateSize.width() << "x" << m_templateSize.height() << "canvas";
+    return true;
+}
+
+bool BatchRenderer::loadJobs(const QString& inputPath, const QString& outputDirectory, const QString& format, QString* error)
+{
+    if (!QDir().mkpath(outputDirectory)) {
+        *error = QString("Could not create output directory %1").arg(outputDirectory);
+        return false;
+    }
+    QDir outputDir(outputDirectory);
+
+    auto outputPath = [&](const QString& inputFile, const QString& name) {
+        QFileInfo input(inputFile);
+        QString suffix = format.isEmpty() ? input.suffix() : format;
+        return outputDir.filePath(name.isEmpty() ? input.completeBaseName() + "." + suffix : name);
+    };
+
+    QFileInfo info(inputPath);
+    if (info.isDir()) {
+        QDir inputDir(inputPath);
+        const QStringList files = inputDir.entryList(ImageFilters, QDir::Files, QDir::Name);
+        for (const QString& fileName : files) {
+            Job job;
+            job.inputPath = inputDir.filePath(fileName);
+            job.outputPath = outputPath(job.inputPath, QString());
+            job.fields.insert("file", QFileInfo(fileName).completeBaseName());
+            m_jobs.append(job);
+        }
+    } else {
+        QFile file(inputPath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            *error = QString("Could not open %1: %2").arg(inputPath, file.errorString());
+            return false;
+        }
+
+        const QList<QStringList> rows = parseCsv(QTextStream(&file).readAll());
+        const QStringList header = rows.value(0);
+        const int imageColumn = header.indexOf("image");
+        const int outputColumn = header.indexOf("output");
+        if (imageColumn < 0) {
+            *error = QString("%1 has no \"image\" column").arg(inputPath);
+            return false;
+        }
+
+        QDir csvDir = info.absoluteDir();
+        for (qsizetype row = 1; row < rows.size(); ++row) {
+            const QStringList& values = rows.at(row);
+            Job job;
+            job.inputPath = csvDir.absoluteFilePath(values.value(imageColumn));
+            job.outputPath = outputPath(job.inputPath, values.value(outputColumn));
+            for (qsizetype column = 0; column < header.size(); ++column) {
+                job.fields.insert(header.at(column), values.value(column));
+            }
+            job.fields.insert("file", QFileInfo(job.inputPath).completeBaseName());
+            m_jobs.append(job);
+        }
+    }
+
+    if (m_jobs.isEmpty()) {
+        *error = QString("No images found in %1").arg(inputPath);
+        return false;
+    }
+    return true;
+}
+
+int BatchRenderer::renderAll(int threadCount, int quality)
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+
+    // One task per image: idle threads keep pulling from the shared queue, so slow images
+    // never hold the others back and no thread waits on another one
+    const int total = int(m_jobs.size());
+    std::atomic<int> finished(0);
+    std::atomic<int> failed(0);
+    QElapsedTimer timer;
+    timer.start();
+
+    qInfo() << "Rendering" << total << "images on" << threadCount << "threads";
+    for (const Job& job : std::as_const(m_jobs)) {
+        pool.start([this, &job, &finished, &failed, &timer, total, quality]() {
+            if (!renderJob(job, quality)) {
+                ++failed;
+            }
+            int count = ++finished;
+            if (count % ProgressInterval == 0 || count == total) {
+                qInfo().noquote() << QString("%1/%2 images, %3 images/s").arg(count).arg(total)
+                                     .arg(count * 1000.0 / qMax<qint64>(1, timer.elapsed()), 0, 'f', 1);
+            }
+        });
+    }
+    pool.waitForDone();
+
+    qInfo() << "Finished in" << timer.elapsed() << "ms," << failed.load() << "failed";
+    return failed.load();
+}
+
+bool BatchRenderer::renderJob(const Job& job, int quality) const
+{
+    TRACE_SCOPE("batch", "render image");
+    // Decoded outside ImageCache, every input is used once and would only evict the shared layers
+    QImage image = ImageCache::decode(QUrl::fromLocalFile(job.inputPath));
+    if (image.isNull()) {
+        qWarning() << "Skipping" << job.inputPath;
+        return false;
+    }
+
+    SceneCompositor compositor(sceneForJob(job, image.size()));
+    compositor.setBaseImage(image);
+    if (!compositor.prepare(image.size())) {
+        return false;
+    }
+
+    QImage result = compositor.render(image.size());
+    if (!image.hasAlphaChannel()) {
+        result.convertTo(QImage::Format_RGB32);
+    }
+
+    QImageWriter writer(job.outputPath);
+    writer.setQuality(quality);
+    if (!writer.write(result)) {
+        qWarning() << "Failed to write" << job.outputPath << ":" << writer.errorString();
+        return false;
+    }
+    return true;
+}
+
+SceneDescription BatchRenderer::sceneForJob(const Job& job, const QSize& imageSize) const
+{
+    SceneDescription scene;
+    scene.sceneSize = imageSize;
+    scene.baseSize = imageSize;
+    scene.baseAdjustments = m_baseAdjustments;
+
+    // Positions follow the image proportionally, sizes scale uniformly so text and logos keep their shape
+    const qreal scaleX = imageSize.width() / m_templateSize.width();
+    const qreal scaleY = imageSize.height() / m_templateSize.height();
+    const qreal scale = qMin(scaleX, scaleY);
+
+    for (const SceneLayer& templateLayer : m_layers) {
+        SceneLayer layer = templateLayer;
+        layer.geometry = QRectF(templateLayer.geometry.x() * scaleX, templateLayer.geometry.y() * scaleY,
+                                templateLayer.geometry.width() * scale, templateLayer.geometry.height() * scale);
+        layer.contentRect = QRectF(templateLayer.contentRect.topLeft() * scale, templateLayer.contentRect.size() * scale);
+
+        if (layer.type == SceneLayer::Text) {
+            layer.text = substitute(templateLayer.text, job.fields);
+            layer.font.setPixelSize(qMax(1, qRound(templateLayer.font.pixelSize() * scale)));
+        }
+        scene.layers.append(layer);
+    }
+    return scene;
+}
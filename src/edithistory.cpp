@@ -0,0 +1,400 @@
+#include "edithistory.h"
+#include <QUrl>
+#include <QDebug>
+
+namespace {
+// Changes to the same property closer together than this become one undo step
+const qint64 MergeIntervalMs = 1000;
+
+#ifdef Q_OS_WASM
+const qint64 DefaultMemoryBudget = 16ll * 1024 * 1024;
+#else
+const qint64 DefaultMemoryBudget = 64ll * 1024 * 1024;
+#endif
+
+const int DefaultMaxCommands = 1000;
+
+qint64 variantCost(const QVariant& value)
+{
+    qint64 cost = sizeof(QVariant);
+    switch (value.metaType().id()) {
+    case QMetaType::QString:
+        cost += value.toString().size() * sizeof(QChar);
+        break;
+    case QMetaType::QByteArray:
+        cost += value.toByteArray().size();
+        break;
+    case QMetaType::QUrl:
+        cost += value.toUrl().toString().size() * sizeof(QChar);
+        break;
+    default:
+        break;
+    }
+    return cost;
+}
+
+void callScript(const QJSValue& function, const QJSValueList& args = QJSValueList())
+{
+    if (!function.isCallable()) {
+        return;
+    }
+    QJSValue result = function.call(args);
+    if (result.isError()) {
+        qWarning() << "Edit history callback failed:" << result.toString();
+    }
+}
+}
+
+void PropertyCommand::undo()
+{
+    for (auto it = deltas.crbegin(); it != deltas.crend(); ++it) {
+        if (it->target) {
+            it->target->setProperty(it->property.constData(), it->before);
+        }
+    }
+}
+
+void PropertyCommand::redo()
+{
+    for (const Delta& delta : std::as_const(deltas)) {
+        if (delta.target) {
+            delta.target->setProperty(delta.property.constData(), delta.after);
+        }
+    }
+}
+
+qint64 PropertyCommand::cost() const
+{
+    qint64 cost = sizeof(PropertyCommand) + text.size() * sizeof(QChar);
+    for (const Delta& delta : deltas) {
+        cost += sizeof(Delta) + delta.property.size() + variantCost(delta.before) + variantCost(delta.after);
+    }
+    return cost;
+}
+
+bool PropertyCommand::isNoOp() const
+{
+    for (const Delta& delta : deltas) {
+        if (delta.before != delta.after) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PropertyCommand::canMergeWith(QObject* target, const QByteArray& property) const
+{
+    return deltas.size() == 1 && deltas.first().target == target && deltas.first().property == property;
+}
+
+void ScriptCommand::undo()
+{
+    callScript(undoFunction);
+}
+
+void ScriptCommand::redo()
+{
+    callScript(redoFunction);
+}
+
+qint64 ScriptCommand::cost() const
+{
+    return sizeof(ScriptCommand) + text.size() * sizeof(QChar) + bytes;
+}
+
+void ScriptCommand::discard(bool applied)
+{
+    callScript(discardFunction, { QJSValue(applied) });
+}
+
+// Static instance
+EditHistory* EditHistory::m_instance = nullptr;
+
+EditHistory::EditHistory(QObject *parent)
+    : QObject(parent)
+    , m_index(0)
+    , m_applying(false)
+    , m_memoryUsage(0)
+    , m_memoryBudget(DefaultMemoryBudget)
+    , m_maxCommands(DefaultMaxCommands)
+    , m_lastMergeable(false)
+{
+    m_clock.start();
+}
+
+EditHistory* EditHistory::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    // Commands hold QML callbacks, the history must outlive whatever QML drops
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+EditHistory* EditHistory::instance()
+{
+    if (!m_instance) {
+        m_instance = new EditHistory();
+    }
+    return m_instance;
+}
+
+QString EditHistory::undoText() const
+{
+    return canUndo() ? m_commands[m_index - 1]->text : QString();
+}
+
+QString EditHistory::redoText() const
+{
+    return canRedo() ? m_commands[m_index]->text : QString();
+}
+
+void EditHistory::setMemoryBudget(qint64 bytes)
+{
+    if (m_memoryBudget == bytes) {
+        return;
+    }
+    m_memoryBudget = bytes;
+    enforceBudget();
+    emit memoryBudgetChanged();
+    emit historyChanged();
+}
+
+void EditHistory::setApplying(bool applying)
+{
+    if (m_applying == applying) {
+        return;
+    }
+    m_applying = applying;
+    emit applyingChanged();
+}
+
+void EditHistory::push(std::unique_ptr<EditCommand> command)
+{
+    // Side effects of undo/redo are part of the command being applied
+    if (m_applying || !command) {
+        return;
+    }
+
+    truncateRedo();
+    command->timestamp = m_clock.elapsed();
+    m_memoryUsage += command->cost();
+    m_commands.push_back(std::move(command));
+    m_index = int(m_commands.size());
+    m_lastMergeable = false;
+
+    enforceBudget();
+    emit historyChanged();
+}
+
+void EditHistory::undo()
+{
+    endGesture();
+    if (!canUndo()) {
+        return;
+    }
+
+    setApplying(true);
+    m_commands[--m_index]->undo();
+    setApplying(false);
+
+    m_lastMergeable = false;
+    emit historyChanged();
+    emit applied();
+}
+
+void EditHistory::redo()
+{
+    endGesture();
+    if (!canRedo()) {
+        return;
+    }
+
+    setApplying(true);
+    m_commands[m_index++]->redo();
+    setApplying(false);
+
+    m_lastMergeable = false;
+    emit historyChanged();
+    emit applied();
+}
+
+void EditHistory::clear()
+{
+    m_gesture.reset();
+    for (int i = int(m_commands.size()) - 1; i >= 0; --i) {
+        m_commands[i]->discard(i < m_index);
+    }
+    m_commands.clear();
+    m_index = 0;
+    m_memoryUsage = 0;
+    m_lastMergeable = false;
+    emit historyChanged();
+}
+
+void EditHistory::truncateRedo()
+{
+    while (int(m_commands.size()) > m_index) {
+        m_memoryUsage -= m_commands.back()->cost();
+        m_commands.back()->discard(false);
+        m_commands.pop_back();
+    }
+}
+
+void EditHistory::enforceBudget()
+{
+    // Drop the oldest steps first, the most recent one always stays undoable
+    int dropped = 0;
+    while (m_index - dropped > 1
+           && (m_memoryUsage > m_memoryBudget || int(m_commands.size()) - dropped > m_maxCommands)) {
+        EditCommand* command = m_commands[dropped].get();
+        m_memoryUsage -= command->cost();
+        command->discard(true);
+        ++dropped;
+    }
+
+    if (dropped > 0) {
+        m_commands.erase(m_commands.begin(), m_commands.begin() + dropped);
+        m_index -= dropped;
+    }
+}
+
+PropertyCommand* EditHistory::mergeTarget(QObject* target, const QByteArray& property)
+{
+    if (!m_lastMergeable || m_commands.empty() || m_index != int(m_commands.size())) {
+        return nullptr;
+    }
+
+    auto command = dynamic_cast<PropertyCommand*>(m_commands.back().get());
+    if (!command || !command->canMergeWith(target, property)
+        || m_clock.elapsed() - command->timestamp > MergeIntervalMs) {
+        return nullptr;
+    }
+    return command;
+}
+
+void EditHistory::setProperty(QObject* target, const QString& property, const QVariant& value, const QString& text)
+{
+    if (!target) {
+        return;
+    }
+
+    QByteArray name = property.toUtf8();
+
+    // Inside undo/redo or an open gesture the change is already accounted for
+    bool inGesture = false;
+    if (m_gesture) {
+        for (const PropertyCommand::Delta& delta : std::as_const(m_gesture->deltas)) {
+            if (delta.target == target && delta.property == name) {
+                inGesture = true;
+                break;
+            }
+        }
+    }
+    if (m_applying || inGesture) {
+        target->setProperty(name.constData(), value);
+        return;
+    }
+
+    QVariant before = target->property(name.constData());
+    if (before == value) {
+        return;
+    }
+    target->setProperty(name.constData(), value);
+    QVariant after = target->property(name.constData());
+
+    if (PropertyCommand* command = mergeTarget(target, name)) {
+        m_memoryUsage -= command->cost();
+        command->deltas.first().after = after;
+        command->timestamp = m_clock.elapsed();
+
+        if (command->isNoOp()) {
+            m_commands.pop_back();
+            m_index = int(m_commands.size());
+            m_lastMergeable = false;
+        } else {
+            m_memoryUsage += command->cost();
+        }
+        emit historyChanged();
+        return;
+    }
+
+    auto command = std::make_unique<PropertyCommand>();
+    command->text = text;
+    command->deltas.append({ target, name, before, after });
+    push(std::move(command));
+    m_lastMergeable = true;
+}
+
+void EditHistory::setProperties(QObject* target, const QVariantMap& values, const QString& text)
+{
+    if (!target) {
+        return;
+    }
+
+    auto command = std::make_unique<PropertyCommand>();
+    command->text = text;
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        QByteArray name = it.key().toUtf8();
+        QVariant before = target->property(name.constData());
+        target->setProperty(name.constData(), it.value());
+        command->deltas.append({ target, name, before, target->property(name.constData()) });
+    }
+
+    if (!command->isNoOp()) {
+        push(std::move(command));
+    }
+}
+
+void EditHistory::beginGesture(QObject* target, const QStringList& properties, const QString& text)
+{
+    endGesture();
+    if (!target || m_applying) {
+        return;
+    }
+
+    m_gesture = std::make_unique<PropertyCommand>();
+    m_gesture->text = text;
+    for (const QString& property : properties) {
+        QByteArray name = property.toUtf8();
+        m_gesture->deltas.append({ target, name, target->property(name.constData()), QVariant() });
+    }
+}
+
+void EditHistory::endGesture()
+{
+    if (!m_gesture) {
+        return;
+    }
+
+    std::unique_ptr<PropertyCommand> command = std::move(m_gesture);
+
+    // Keep only what the gesture actually changed
+    QList<PropertyCommand::Delta> changed;
+    for (PropertyCommand::Delta& delta : command->deltas) {
+        if (!delta.target) {
+            continue;
+        }
+        delta.after = delta.target->property(delta.property.constData());
+        if (delta.after != delta.before) {
+            changed.append(delta);
+        }
+    }
+
+    if (!changed.isEmpty()) {
+        command->deltas = changed;
+        push(std::move(command));
+    }
+}
+
+void EditHistory::pushAction(const QString& text, const QJSValue& undoFunction, const QJSValue& redoFunction,
+                             const QJSValue& discardFunction, qint64 bytes)
+{
+    auto command = std::make_unique<ScriptCommand>();
+    command->text = text;
+    command->undoFunction = undoFunction;
+    command->redoFunction = redoFunction;
+    command->discardFunction = discardFunction;
+    command->bytes = qMax<qint64>(0, bytes);
+    push(std::move(command));
+}
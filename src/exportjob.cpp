@@ -0,0 +1,241 @@
+#include "exportjob.h"
+#include "imagecache.h"
+#include "jobscheduler.h"
+#include "jpegtransform.h"
+#include "stripencoder.h"
+#include <QBuffer>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QDebug>
+#include <cmath>
+#include <vector>
+
+namespace {
+const int DefaultStripHeight = 128;
+
+struct StripSlot
+{
+    QImage image;
+    QSemaphore ready;
+};
+}
+
+ExportJob::ExportJob(const SceneDescription& scene, const QSize& outputSize, const QString& format, QObject *parent)
+    : QObject(parent)
+    , m_scene(scene)
+    , m_outputSize(outputSize)
+    , m_format(format)
+    , m_matte(0xffffffff)
+    , m_encodedAllocation(MemoryBudget::ExportBuffers)
+    , m_cancelled(false)
+    , m_stripHeight(DefaultStripHeight)
+{
+    m_coordinatorPool.setMaxThreadCount(1);
+    m_stripPool.setMaxThreadCount(JobScheduler::instance()->workerCount());
+}
+
+ExportJob::~ExportJob()
+{
+    cancel();
+    m_coordinatorPool.waitForDone();
+    m_stripPool.waitForDone();
+}
+
+void ExportJob::setOutputFile(const QString& filePath)
+{
+    m_filePath = filePath;
+}
+
+void ExportJob::setMatteColor(QRgb matte)
+{
+    m_matte = matte;
+}
+
+void ExportJob::start()
+{
+    m_coordinatorPool.start([this]() {
+        bool success = run();
+        emit finished(success && !m_cancelled);
+    });
+}
+
+void ExportJob::cancel()
+{
+    m_cancelled = true;
+}
+
+bool ExportJob::run()
+{
+    TRACE_SCOPE("export", "export");
+    if (!m_scene.isValid() || m_outputSize.isEmpty()) {
+        return false;
+    }
+
+    // Nothing to render: rotate the original in the DCT domain instead of re-encoding it
+    const QByteArray lossless = losslessJpeg();
+    if (!lossless.isEmpty()) {
+        return writeEncoded(lossless);
+    }
+
+    SceneCompositor compositor(m_scene);
+    if (!compositor.prepare(m_outputSize)) {
+        return false;
+    }
+
+    std::unique_ptr<StripEncoder> encoder = StripEncoder::create(m_format);
+    encoder->setMatteColor(m_matte);
+
+    QSaveFile file;
+    QBuffer buffer(&m_encoded);
+    QIODevice* device = &buffer;
+    if (!m_filePath.isEmpty()) {
+        file.setFileName(m_filePath);
+        device = &file;
+    }
+
+    if (!device->open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not open export target:" << m_filePath;
+        return false;
+    }
+
+    if (!encoder->begin(device, m_outputSize)) {
+        qWarning() << "Could not start encoder for format:" << m_format;
+        return false;
+    }
+
+    const int width = m_outputSize.width();
+    const int height = m_outputSize.height();
+    const int stripCount = (height + m_stripHeight - 1) / m_stripHeight;
+
+    // Strips rendered ahead of the encoder, bounded so peak memory stays at a few strips
+    const int window = qMax(2, m_stripPool.maxThreadCount() * 2);
+    std::vector<std::unique_ptr<StripSlot>> slots;
+    for (int i = 0; i < window; ++i) {
+        slots.push_back(std::make_unique<StripSlot>());
+    }
+    MemoryBudget::Allocation stripAllocation(MemoryBudget::ExportBuffers,
+                                             qint64(qMin(window, stripCount)) * width * m_stripHeight * 4);
+
+    auto submit = [&](int index) {
+        StripSlot* slot = slots[index % window].get();
+        QRect region(0, index * m_stripHeight, width, qMin(m_stripHeight, height - index * m_stripHeight));
+        m_stripPool.start([this, &compositor, slot, region]() {
+            if (!m_cancelled) {
+                QImage strip(region.size(), QImage::Format_ARGB32_Premultiplied);
+                strip.fill(Qt::transparent);
+                compositor.renderRegion(strip, region, m_outputSize);
+                slot->image = strip;
+            }
+            slot->ready.release();
+        });
+    };
+
+    for (int i = 0; i < qMin(window, stripCount); ++i) {
+        submit(i);
+    }
+
+    // Encoding is not streamed for every format, leave room for the final encode in the progress
+    const qreal renderShare = encoder->isStreaming() ? 1.0 : 0.8;
+
+    bool success = true;
+    for (int i = 0; i < stripCount; ++i) {
+        StripSlot* slot = slots[i % window].get();
+        slot->ready.acquire();
+
+        bool written = false;
+        if (!m_cancelled) {
+            TRACE_SCOPE("export", "encode strip");
+            written = encoder->writeStrip(slot->image);
+        }
+        if (!written) {
+            success = false;
+            break;
+        }
+        slot->image = QImage();
+
+        if (i + window < stripCount) {
+            submit(i + window);
+        }
+
+        emit progressChanged(renderShare * (i + 1) / stripCount);
+    }
+
+    // Strip tasks reference the compositor and the slots, let them drain before leaving
+    m_stripPool.waitForDone();
+
+    if (success) {
+        TRACE_SCOPE("export", "finish encoding");
+        success = encoder->finish();
+    }
+
+    if (!success || m_cancelled) {
+        if (device == &file) {
+            file.cancelWriting();
+        }
+        m_encoded.clear();
+        return false;
+    }
+    m_encodedAllocation.resize(m_encoded.size());
+
+    if (device == &file && !file.commit()) {
+        qWarning() << "Could not write export file:" << m_filePath;
+        return false;
+    }
+
+    emit progressChanged(1.0);
+    return true;
+}
+
+QByteArray ExportJob::losslessJpeg() const
+{
+    if ((m_format != "JPEG" && m_format != "JPG") || !m_scene.layers.isEmpty()
+        || !m_scene.baseAdjustments.isIdentity() || m_scene.baseSource.isEmpty()) {
+        return QByteArray();
+    }
+
+    const qreal turns = m_scene.baseRotation / 90.0;
+    if (std::abs(turns - std::round(turns)) > 1e-6) {
+        return QByteArray();
+    }
+
+    // Only at the original resolution, and with the base covering the whole scene
+    const bool transposed = int(std::round(turns)) % 2 != 0;
+    const QSize baseSize = m_scene.baseSize.toSize();
+    if (m_scene.sceneSize.toSize() != (transposed ? baseSize.transposed() : baseSize)
+        || m_outputSize != m_scene.sceneSize.toSize()) {
+        return QByteArray();
+    }
+
+    const QByteArray source = ImageCache::encodedData(m_scene.baseSource);
+    if (!JpegTransform::isJpeg(source)) {
+        return QByteArray();
+    }
+
+    QSize size;
+    QByteArray result = JpegTransform::rotate(source, int(std::round(turns)), &size);
+    if (size != m_outputSize) {
+        return QByteArray();
+    }
+    return result;
+}
+
+bool ExportJob::writeEncoded(const QByteArray& data)
+{
+    if (m_cancelled) {
+        return false;
+    }
+
+    if (m_filePath.isEmpty()) {
+        m_encoded = data;
+        m_encodedAllocation.resize(m_encoded.size());
+    } else {
+        QSaveFile file(m_filePath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+            qWarning() << "Could not write export file:" << m_filePath;
+            return false;
+        }
+    }
+
+    emit progressChanged(1.0);
+    return true;
+}
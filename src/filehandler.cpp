@@ -1,5 +1,8 @@
 #include "filehandler.h"
+#include "imagestore.h"
+#include "tracer.h"
 #include <QDebug>
+#include <utility>
 
 #ifdef Q_OS_WASM
 #include <emscripten.h>
@@ -7,22 +10,34 @@
 
 static FileHandler* g_fileHandler = nullptr;
 
+// Raw bytes of the last file read by the browser, JS writes straight into it
+static QByteArray g_uploadBuffer;
+
 extern "C" {
-EMSCRIPTEN_KEEPALIVE void fileSelectedCallback(const char* dataUrl) {
+EMSCRIPTEN_KEEPALIVE char* uploadBufferAlloc(int size) {
+    g_uploadBuffer = QByteArray(size, Qt::Uninitialized);
+    return g_uploadBuffer.data();
+}
+
+EMSCRIPTEN_KEEPALIVE void fileSelectedCallback() {
+    TRACE_SCOPE("io", "ingest upload");
     qDebug() << "fileSelectedCallback called";
     if (g_fileHandler) {
-        QString fileData = QString::fromUtf8(dataUrl);
-        qDebug() << "Emitting fileSelected signal with data length:" << fileData.length();
-        emit g_fileHandler->fileSelected(fileData);
+        QByteArray fileData = FileHandler::takeUpload();
+        QString source = ImageStore::urlForId(ImageStore::instance()->insert(fileData)).toString();
+        qDebug() << "Emitting fileSelected signal with data length:" << fileData.size();
+        emit g_fileHandler->fileSelected(source);
     }
 }
 
-EMSCRIPTEN_KEEPALIVE void layerImageSelectedCallback(const char* dataUrl) {
+EMSCRIPTEN_KEEPALIVE void layerImageSelectedCallback() {
+    TRACE_SCOPE("io", "ingest upload");
     qDebug() << "layerImageSelectedCallback called";
     if (g_fileHandler) {
-        QString fileData = QString::fromUtf8(dataUrl);
-        qDebug() << "Emitting layerImageSelected signal with data length:" << fileData.length();
-        emit g_fileHandler->layerImageSelected(fileData);
+        QByteArray fileData = FileHandler::takeUpload();
+        QString source = ImageStore::urlForId(ImageStore::instance()->insert(fileData)).toString();
+        qDebug() << "Emitting layerImageSelected signal with data length:" << fileData.size();
+        emit g_fileHandler->layerImageSelected(source);
     }
 }
 }
@@ -36,6 +51,15 @@ FileHandler::FileHandler(QObject *parent) : QObject(parent)
 #endif
 }
 
+QByteArray FileHandler::takeUpload()
+{
+#ifdef Q_OS_WASM
+    return std::exchange(g_uploadBuffer, QByteArray());
+#else
+    return QByteArray();
+#endif
+}
+
 FileHandler* FileHandler::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
 {
     Q_UNUSED(qmlEngine)
@@ -70,14 +94,13 @@ void FileHandler::openFileDialog()
                 var reader = new FileReader();
                 reader.onload = function(event) {
                     console.log("Main image file read, calling callback");
-                    var dataUrl = event.target.result;
-                    var len = lengthBytesUTF8(dataUrl) + 1;
-                    var ptr = _malloc(len);
-                    stringToUTF8(dataUrl, ptr, len);
-                    Module._fileSelectedCallback(ptr);
-                    _free(ptr);
+                    // Copy the raw file once into a buffer owned by C++, no base64 round-trip
+                    var bytes = new Uint8Array(event.target.result);
+                    var ptr = Module._uploadBufferAlloc(bytes.length);
+                    HEAPU8.set(bytes, ptr);
+                    Module._fileSelectedCallback();
                 };
-                reader.readAsDataURL(file);
+                reader.readAsArrayBuffer(file);
             }
         };
         input.click();
@@ -112,14 +135,13 @@ void FileHandler::openLayerImageDialog()
                 var reader = new FileReader();
                 reader.onload = function(event) {
                     console.log("Layer image file read, calling callback");
-                    var dataUrl = event.target.result;
-                    var len = lengthBytesUTF8(dataUrl) + 1;
-                    var ptr = _malloc(len);
-                    stringToUTF8(dataUrl, ptr, len);
-                    Module._layerImageSelectedCallback(ptr);
-                    _free(ptr);
+                    // Copy the raw file once into a buffer owned by C++, no base64 round-trip
+                    var bytes = new Uint8Array(event.target.result);
+                    var ptr = Module._uploadBufferAlloc(bytes.length);
+                    HEAPU8.set(bytes, ptr);
+                    Module._layerImageSelectedCallback();
                 };
-                reader.readAsDataURL(file);
+                reader.readAsArrayBuffer(file);
             }
         };
         input.click();
@@ -0,0 +1,149 @@
+#include "fontcache.h"
+#include "tracer.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDebug>
+
+#ifdef Q_OS_WASM
+#include <emscripten.h>
+
+extern "C" {
+EMSCRIPTEN_KEEPALIVE void fontCacheReadyCallback() {
+    FontCache::instance()->markReady();
+}
+}
+#endif
+
+FontCache* FontCache::instance()
+{
+    static FontCache cache;
+    return &cache;
+}
+
+FontCache::FontCache()
+    : m_ready(false)
+{
+#ifdef Q_OS_WASM
+    m_directory = "/fontcache";
+    EM_ASM({
+        var directory = UTF8ToString($0);
+        try {
+            FS.mkdir(directory);
+            FS.mount(IDBFS, {}, directory);
+        } catch (error) {
+            console.log("Font cache directory already mounted:", error);
+        }
+        // Pull the stored fonts out of IndexedDB before anything reads the directory
+        FS.syncfs(true, function(error) {
+            if (error) {
+                console.error("Restoring the font cache failed:", error);
+            }
+            Module._fontCacheReadyCallback();
+        });
+    }, m_directory.toUtf8().constData());
+#else
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/fonts";
+    QDir().mkpath(m_directory);
+    m_ready = true;
+#endif
+}
+
+QString FontCache::pathForKey(const QString& key) const
+{
+    return m_directory + "/" + key + ".font";
+}
+
+QString FontCache::insert(const QByteArray& data)
+{
+    QString key = QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+
+    // Restoring from IndexedDB replaces the directory, a file written before that would be lost
+    if (!m_ready) {
+        whenReady([this, key, data]() { write(key, data); });
+        return key;
+    }
+    return write(key, data) ? key : QString();
+}
+
+bool FontCache::write(const QString& key, const QByteArray& data)
+{
+    TRACE_SCOPE("font", "write font cache");
+    QString path = pathForKey(key);
+    if (QFile::exists(path)) {
+        return true;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to write font cache entry" << path << ":" << file.errorString();
+        return false;
+    }
+
+    persist();
+    return true;
+}
+
+QByteArray FontCache::data(const QString& key) const
+{
+    TRACE_SCOPE("font", "read font cache");
+    if (key.isEmpty()) {
+        return QByteArray();
+    }
+
+    QFile file(pathForKey(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Font cache entry" << key << "is missing";
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+void FontCache::remove(const QString& key)
+{
+    if (!m_ready) {
+        whenReady([this, key]() { remove(key); });
+        return;
+    }
+    if (!key.isEmpty() && QFile::remove(pathForKey(key))) {
+        persist();
+    }
+}
+
+void FontCache::whenReady(const std::function<void()>& callback)
+{
+    if (m_ready) {
+        callback();
+    } else {
+        m_pending.append(callback);
+    }
+}
+
+void FontCache::markReady()
+{
+    if (m_ready) {
+        return;
+    }
+    m_ready = true;
+
+    const QList<std::function<void()>> pending = std::move(m_pending);
+    m_pending.clear();
+    for (const auto& callback : pending) {
+        callback();
+    }
+}
+
+void FontCache::persist()
+{
+#ifdef Q_OS_WASM
+    EM_ASM({
+        FS.syncfs(false, function(error) {
+            if (error) {
+                console.error("Saving the font cache failed:", error);
+            }
+        });
+    });
+#endif
+}
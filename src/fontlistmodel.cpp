@@ -0,0 +1,200 @@
+#include "fontlistmodel.h"
+#include "fontcache.h"
+#include "fontmanager.h"
+#include "fontpreview.h"
+#include <QGuiApplication>
+#include <QPointer>
+#include <QTimer>
+#include <QDebug>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+// Rows added per event loop turn, and previews rendered ahead when a list is (re)built
+const int BatchSize = 200;
+const int PrefetchCount = 40;
+// Row height of the pickers in device independent pixels
+const int PreviewHeight = 24;
+}
+
+FontListModel::FontListModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_customOnly(false)
+    , m_previewColor(Qt::black)
+    , m_shown(0)
+    , m_appendQueued(false)
+{
+    FontManager* manager = FontManager::instance();
+    connect(manager, &FontManager::availableFontsChanged, this, [this]() {
+        rebuild();
+        emit loadingChanged();
+    });
+    connect(manager, &FontManager::customFontFamiliesChanged, this, &FontListModel::rebuild);
+    rebuild();
+
+    // Stored fonts have no preview until the cache is restored, ask the view again once it is
+    FontCache* cache = FontCache::instance();
+    if (!cache->isReady()) {
+        QPointer<FontListModel> model(this);
+        cache->whenReady([model]() {
+            if (model && model->m_shown > 0) {
+                emit model->dataChanged(model->index(0), model->index(model->m_shown - 1), { PreviewRole });
+            }
+        });
+    }
+}
+
+int FontListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_shown;
+}
+
+QVariant FontListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_shown) {
+        return QVariant();
+    }
+
+    const QString& family = m_matches.at(index.row());
+    switch (role) {
+    case Qt::DisplayRole:
+    case FamilyRole:
+        return family;
+    case CustomRole:
+        return m_customFamilies.contains(family);
+    case PreviewRole:
+        // Only rows a view creates get here, stored custom fonts are registered on demand
+        if (m_customFamilies.contains(family) && !FontManager::instance()->ensureFontLoaded(family)) {
+            return QUrl();
+        }
+        return FontPreviewCache::previewUrl(family, m_previewColor);
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> FontListModel::roleNames() const
+{
+    return {
+        { FamilyRole, "family" },
+        { CustomRole, "custom" },
+        { PreviewRole, "preview" }
+    };
+}
+
+void FontListModel::setFilter(const QString& filter)
+{
+    if (filter == m_filter) {
+        return;
+    }
+    m_filter = filter;
+    rebuild();
+    emit filterChanged();
+}
+
+void FontListModel::setCustomOnly(bool customOnly)
+{
+    if (customOnly == m_customOnly) {
+        return;
+    }
+    m_customOnly = customOnly;
+    rebuild();
+    emit customOnlyChanged();
+}
+
+void FontListModel::setPreviewColor(const QColor& color)
+{
+    if (color == m_previewColor) {
+        return;
+    }
+    m_previewColor = color;
+    if (m_shown > 0) {
+        emit dataChanged(index(0), index(m_shown - 1), { PreviewRole });
+    }
+    prefetchPreviews(0, qMin(m_shown, PrefetchCount));
+    emit previewColorChanged();
+}
+
+bool FontListModel::loading() const
+{
+    return (!m_customOnly && !FontManager::instance()->systemFontsReady()) || m_shown < m_matches.size();
+}
+
+QString FontListModel::familyAt(int row) const
+{
+    return row >= 0 && row < m_shown ? m_matches.at(row) : QString();
+}
+
+void FontListModel::rebuild()
+{
+    FontManager* manager = FontManager::instance();
+    const QStringList customFamilies = manager->customFontFamilies();
+    m_customFamilies = QSet<QString>(customFamilies.cbegin(), customFamilies.cend());
+
+    QStringList matches;
+    for (const QString& family : customFamilies) {
+        if (family.startsWith(m_filter, Qt::CaseInsensitive)) {
+            matches.append(family);
+        }
+    }
+
+    if (!m_customOnly) {
+        // The system list is sorted case-insensitively, matches of a prefix are one run
+        const QStringList& systemFonts = manager->systemFonts();
+        auto it = std::lower_bound(systemFonts.cbegin(), systemFonts.cend(), m_filter, [](const QString& family, const QString& prefix) {
+            return family.compare(prefix, Qt::CaseInsensitive) < 0;
+        });
+        for (; it != systemFonts.cend() && it->startsWith(m_filter, Qt::CaseInsensitive); ++it) {
+            if (!m_customFamilies.contains(*it)) {
+                matches.append(*it);
+            }
+        }
+    }
+
+    beginResetModel();
+    m_matches = matches;
+    m_shown = qMin(int(m_matches.size()), BatchSize);
+    endResetModel();
+    emit countChanged();
+
+    prefetchPreviews(0, qMin(m_shown, PrefetchCount));
+    if (m_shown < m_matches.size() && !m_appendQueued) {
+        m_appendQueued = true;
+        QTimer::singleShot(0, this, &FontListModel::appendBatch);
+    }
+}
+
+void FontListModel::appendBatch()
+{
+    m_appendQueued = false;
+    const int total = int(m_matches.size());
+    if (m_shown >= total) {
+        return;
+    }
+
+    const int last = qMin(total, m_shown + BatchSize) - 1;
+    beginInsertRows(QModelIndex(), m_shown, last);
+    m_shown = last + 1;
+    endInsertRows();
+    emit countChanged();
+
+    if (m_shown < total) {
+        m_appendQueued = true;
+        QTimer::singleShot(0, this, &FontListModel::appendBatch);
+    } else {
+        emit loadingChanged();
+    }
+}
+
+void FontListModel::prefetchPreviews(int from, int to) const
+{
+    QStringList families;
+    for (int row = from; row < to; ++row) {
+        // Custom fonts may not be registered yet, their rows render on demand
+        if (!m_customFamilies.contains(m_matches.at(row))) {
+            families.append(m_matches.at(row));
+        }
+    }
+    const int height = qCeil(PreviewHeight * qGuiApp->devicePixelRatio());
+    FontPreviewCache::instance()->prefetch(families, height, m_previewColor);
+}
@@ -1,10 +1,17 @@
 #include "fontmanager.h"
+#include "filehandler.h"
+#include "fontcache.h"
+#include "jobscheduler.h"
+#include "memorybudget.h"
+#include "tracer.h"
 #include <QFontDatabase>
+#include <QTimer>
 #include <QStandardPaths>
 #include <QDir>
 #include <QFile>
 #include <QSettings>
 #include <QDebug>
+#include <memory>
 
 #ifdef Q_OS_WASM
 #include <emscripten.h>
@@ -13,35 +20,38 @@
 static FontManager* g_fontManager = nullptr;
 
 extern "C" {
-EMSCRIPTEN_KEEPALIVE void fontSelectedCallback(const char* dataUrl) {
+EMSCRIPTEN_KEEPALIVE void fontSelectedCallback() {
     qDebug() << "fontSelectedCallback called";
     if (g_fontManager) {
-        QString fontData = QString::fromUtf8(dataUrl);
-        qDebug() << "Emitting fontSelected signal with data length:" << fontData.length();
-        // Extract base64 from data URL (remove "data:font/...;base64," prefix)
-        int commaIndex = fontData.indexOf(',');
-        if (commaIndex != -1) {
-            QString base64Data = fontData.mid(commaIndex + 1);
-            g_fontManager->loadCustomFont(base64Data);
-        }
+        // Raw font bytes written by JS into the shared upload buffer
+        QByteArray fontData = FileHandler::takeUpload();
+        qDebug() << "Loading font with data length:" << fontData.size();
+        g_fontManager->loadCustomFontData(fontData);
     }
 }
 }
 #endif
 
-FontManager::FontManager(QObject *parent) : QObject(parent)
+FontManager::FontManager(QObject *parent) : QObject(parent), m_systemFontsReady(false)
 {
 #ifdef Q_OS_WASM
     g_fontManager = this;
 #endif
-    loadStoredFonts();
+    // Only the small index is read here, font files are registered when first used
+    loadFontIndex();
     refreshAvailableFonts();
+    enumerateSystemFonts();
 }
 
 FontManager* FontManager::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
 {
     Q_UNUSED(qmlEngine)
     Q_UNUSED(jsEngine)
+    return instance();
+}
+
+FontManager* FontManager::instance()
+{
     static FontManager* instance = new FontManager();
     return instance;
 }
@@ -70,14 +80,12 @@ void FontManager::openFontDialog()
                 var reader = new FileReader();
                 reader.onload = function(event) {
                     console.log("Font file read, calling callback");
-                    var dataUrl = event.target.result;
-                    var len = lengthBytesUTF8(dataUrl) + 1;
-                    var ptr = _malloc(len);
-                    stringToUTF8(dataUrl, ptr, len);
-                    Module._fontSelectedCallback(ptr);
-                    _free(ptr);
+                    var bytes = new Uint8Array(event.target.result);
+                    var ptr = Module._uploadBufferAlloc(bytes.length);
+                    HEAPU8.set(bytes, ptr);
+                    Module._fontSelectedCallback();
                 };
-                reader.readAsDataURL(file);  // This gives you base64 data URL
+                reader.readAsArrayBuffer(file);
             }
         };
         input.click();
@@ -89,17 +97,32 @@ void FontManager::openFontDialog()
 
 void FontManager::loadCustomFont(const QString& fontData)
 {
-    QByteArray data = QByteArray::fromBase64(fontData.toUtf8());
+    // Base64 of a whole font file, decode it off the GUI thread and register it back there
+    const QByteArray encoded = fontData.toUtf8();
+    JobScheduler::instance()->run(this, [encoded]() {
+        TRACE_SCOPE("font", "decode base64 font");
+        return QByteArray::fromBase64(encoded);
+    }, [this](const QByteArray& data) {
+        loadCustomFontData(data);
+    });
+}
 
+void FontManager::loadCustomFontData(const QByteArray& data)
+{
+    TRACE_SCOPE("font", "register custom font");
     int fontId = QFontDatabase::addApplicationFontFromData(data);
     if (fontId != -1) {
         QStringList fontFamilies = QFontDatabase::applicationFontFamilies(fontId);
         if (!fontFamilies.isEmpty()) {
             QString fontFamily = fontFamilies.first();
+            trackRegistration(fontFamily, fontId, data.size());
 
             // Save to persistent storage
             saveFontToStorage(fontFamily, data);
-            m_customFontFamilies.append(fontFamily);
+            m_registeredFamilies.insert(fontFamily);
+            if (!m_customFontFamilies.contains(fontFamily)) {
+                m_customFontFamilies.append(fontFamily);
+            }
 
             refreshAvailableFonts();
             emit customFontFamiliesChanged();
@@ -111,11 +134,28 @@ void FontManager::loadCustomFont(const QString& fontData)
     }
 }
 
+void FontManager::trackRegistration(const QString& fontFamily, int fontId, qint64 bytes)
+{
+    // The font database keeps its own copy of the file, counted once per id
+    m_fontIds.insert(fontFamily, fontId);
+    if (!m_fontIdBytes.contains(fontId)) {
+        m_fontIdBytes.insert(fontId, bytes);
+        MemoryBudget::instance()->add(MemoryBudget::Fonts, bytes);
+    }
+}
+
 void FontManager::saveFontToStorage(const QString& fontFamily, const QByteArray& fontData)
 {
+    // Raw bytes go to the font cache, settings only map the family to its key
+    QString key = FontCache::instance()->insert(fontData);
+    if (key.isEmpty()) {
+        return;
+    }
+    m_fontKeys.insert(fontFamily, key);
+
     QSettings settings("Odizinne", "QuickEdits");
-    settings.beginGroup("CustomFonts");
-    settings.setValue(fontFamily, fontData.toBase64());
+    settings.beginGroup("FontCache");
+    settings.setValue(fontFamily, key);
     settings.endGroup();
 
     // Also keep track of custom font names
@@ -126,34 +166,126 @@ void FontManager::saveFontToStorage(const QString& fontFamily, const QByteArray&
     }
 }
 
-void FontManager::loadStoredFonts()
+QByteArray FontManager::loadFontFromStorage(const QString& fontFamily) const
 {
+    return FontCache::instance()->data(m_fontKeys.value(fontFamily));
+}
+
+void FontManager::loadFontIndex()
+{
+    TRACE_SCOPE("font", "read font index");
     QSettings settings("Odizinne", "QuickEdits");
     QStringList customFonts = settings.value("CustomFontsList", QStringList()).toStringList();
 
-    settings.beginGroup("CustomFonts");
+    settings.beginGroup("FontCache");
     for (const QString& fontFamily : customFonts) {
-        QByteArray fontData = QByteArray::fromBase64(settings.value(fontFamily).toByteArray());
-
-        if (!fontData.isEmpty()) {
-            int fontId = QFontDatabase::addApplicationFontFromData(fontData);
-            if (fontId != -1) {
-                m_customFontFamilies.append(fontFamily);
-            }
+        QString key = settings.value(fontFamily).toString();
+        if (!key.isEmpty()) {
+            m_fontKeys.insert(fontFamily, key);
+            m_customFontFamilies.append(fontFamily);
         }
     }
     settings.endGroup();
 
+    // Older versions kept base64 copies in settings, move them once the cache is available
+    settings.beginGroup("CustomFonts");
+    bool hasLegacyFonts = !settings.childKeys().isEmpty();
+    settings.endGroup();
+    if (hasLegacyFonts) {
+        FontCache::instance()->whenReady([this]() { migrateSettingsFonts(); });
+    }
+
     if (!m_customFontFamilies.isEmpty()) {
         emit customFontFamiliesChanged();
     }
 }
 
+void FontManager::migrateSettingsFonts()
+{
+    QSettings settings("Odizinne", "QuickEdits");
+    QStringList customFonts = settings.value("CustomFontsList", QStringList()).toStringList();
+
+    QList<QPair<QString, QByteArray>> encodedFonts;
+    settings.beginGroup("CustomFonts");
+    for (const QString& fontFamily : customFonts) {
+        encodedFonts.append({ fontFamily, settings.value(fontFamily).toByteArray() });
+    }
+    settings.endGroup();
+
+    // One font decoded per step, all of them together can take seconds
+    auto legacyFonts = std::make_shared<QList<QPair<QString, QByteArray>>>();
+    auto next = std::make_shared<qsizetype>(0);
+    JobScheduler::instance()->runChunked(this, [encodedFonts, legacyFonts, next]() {
+        if (*next < encodedFonts.size()) {
+            TRACE_SCOPE("font", "decode legacy font");
+            const QPair<QString, QByteArray>& entry = encodedFonts.at((*next)++);
+            const QByteArray fontData = QByteArray::fromBase64(entry.second);
+            if (!fontData.isEmpty()) {
+                legacyFonts->append({ entry.first, fontData });
+            }
+        }
+        return *next >= encodedFonts.size();
+    }, [this, legacyFonts]() {
+        for (const QPair<QString, QByteArray>& font : std::as_const(*legacyFonts)) {
+            saveFontToStorage(font.first, font.second);
+            if (!m_customFontFamilies.contains(font.first)) {
+                m_customFontFamilies.append(font.first);
+            }
+        }
+
+        // Frees the localStorage quota the blobs were using on WebAssembly
+        QSettings settings("Odizinne", "QuickEdits");
+        settings.remove("CustomFonts");
+        qDebug() << "Moved" << legacyFonts->size() << "fonts from settings to the font cache";
+
+        refreshAvailableFonts();
+        emit customFontFamiliesChanged();
+    });
+}
+
+bool FontManager::ensureFontLoaded(const QString& fontFamily)
+{
+    TRACE_SCOPE("font", "register stored font");
+    if (m_registeredFamilies.contains(fontFamily)) {
+        return true;
+    }
+    if (!m_fontKeys.contains(fontFamily)) {
+        return QFontDatabase::hasFamily(fontFamily);
+    }
+
+    // On WebAssembly the cache may still be restoring, register once it is there
+    if (!FontCache::instance()->isReady()) {
+        if (!m_pendingFamilies.contains(fontFamily)) {
+            m_pendingFamilies.insert(fontFamily);
+            FontCache::instance()->whenReady([this, fontFamily]() {
+                m_pendingFamilies.remove(fontFamily);
+                // Text already set to this family was shaped with a fallback, let it know
+                if (ensureFontLoaded(fontFamily)) {
+                    emit fontRegistered(fontFamily);
+                }
+            });
+        }
+        return false;
+    }
+
+    QByteArray fontData = loadFontFromStorage(fontFamily);
+    int fontId = fontData.isEmpty() ? -1 : QFontDatabase::addApplicationFontFromData(fontData);
+    if (fontId == -1) {
+        qWarning() << "Failed to register stored font" << fontFamily;
+        return false;
+    }
+
+    m_registeredFamilies.insert(fontFamily);
+    trackRegistration(fontFamily, fontId, fontData.size());
+    qDebug() << "Registered stored font" << fontFamily;
+    return true;
+}
+
 void FontManager::removeCustomFont(const QString& fontFamily)
 {
     if (m_customFontFamilies.contains(fontFamily)) {
         QSettings settings("Odizinne", "QuickEdits");
-        settings.beginGroup("CustomFonts");
+        settings.beginGroup("FontCache");
         settings.remove(fontFamily);
         settings.endGroup();
 
@@ -161,16 +293,58 @@ void FontManager::removeCustomFont(const QString& fontFamily)
         customFonts.removeAll(fontFamily);
         settings.setValue("CustomFontsList", customFonts);
 
+        // Several families can come from one file, keep it while another one still uses it
+        QString key = m_fontKeys.take(fontFamily);
+        if (!m_fontKeys.values().contains(key)) {
+            FontCache::instance()->remove(key);
+        }
+
         m_customFontFamilies.removeAll(fontFamily);
 
+        // Unregister it too, the font database holds a copy of the file until then
+        m_registeredFamilies.remove(fontFamily);
+        auto id = m_fontIds.constFind(fontFamily);
+        if (id != m_fontIds.cend()) {
+            const int fontId = id.value();
+            m_fontIds.erase(id);
+            if (!m_fontIds.values().contains(fontId)) {
+                QFontDatabase::removeApplicationFont(fontId);
+                MemoryBudget::instance()->add(MemoryBudget::Fonts, -m_fontIdBytes.take(fontId));
+            }
+        }
+
         emit customFontFamiliesChanged();
         emit fontRemoved(fontFamily);
     }
 }
 
+void FontManager::enumerateSystemFonts()
+{
+    // Listing thousands of installed families takes a while, keep it off the startup path
+    auto enumerate = []() {
+        TRACE_SCOPE("font", "enumerate system fonts");
+        QStringList families = QFontDatabase::families();
+        families.sort(Qt::CaseInsensitive);
+        return families;
+    };
+    auto deliver = [this](const QStringList& families) {
+        m_systemFonts = families;
+        m_systemFontsReady = true;
+        qDebug() << "Enumerated" << families.size() << "system font families";
+        refreshAvailableFonts();
+    };
+
+#ifdef Q_OS_WASM
+    // The browser font database belongs to the main thread, list it once the first frame is out
+    QTimer::singleShot(0, this, [enumerate, deliver]() { deliver(enumerate()); });
+#else
+    JobScheduler::instance()->run(this, enumerate, deliver);
+#endif
+}
+
 void FontManager::refreshAvailableFonts()
 {
-    QStringList allFonts = QFontDatabase::families();
+    QStringList allFonts = m_systemFonts;
 
     for (const QString& customFont : m_customFontFamilies) {
         allFonts.removeAll(customFont);
@@ -184,33 +358,16 @@ void FontManager::refreshAvailableFonts()
 void FontManager::loadCustomFontFromFile(const QUrl& fileUrl)
 {
 #ifndef Q_OS_WASM
-    QString filePath = fileUrl.toLocalFile();
-    QFile file(filePath);
-
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray fontData = file.readAll();
-        file.close();
-
-        int fontId = QFontDatabase::addApplicationFontFromData(fontData);
-        if (fontId != -1) {
-            QStringList fontFamilies = QFontDatabase::applicationFontFamilies(fontId);
-            if (!fontFamilies.isEmpty()) {
-                QString fontFamily = fontFamilies.first();
-
-                // Save to persistent storage
-                saveFontToStorage(fontFamily, fontData);
-                m_customFontFamilies.append(fontFamily);
-
-                refreshAvailableFonts();
-                emit customFontFamiliesChanged();
-                emit fontLoaded(fontFamily);
-                qDebug() << "Font loaded from file:" << fontFamily;
-            }
-        } else {
-            qWarning() << "Failed to load font from file:" << filePath;
+    const QString filePath = fileUrl.toLocalFile();
+    JobScheduler::instance()->run(this, [filePath]() {
+        QFile file(filePath);
+        return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    }, [this, filePath](const QByteArray& data) {
+        if (data.isEmpty()) {
+            qWarning() << "Could not open font file:" << filePath;
+            return;
         }
-    } else {
-        qWarning() << "Could not open font file:" << filePath;
-    }
+        loadCustomFontData(data);
+    });
 #endif
 }
@@ -0,0 +1,158 @@
+#include "fontpreview.h"
+#include "jobscheduler.h"
+#include "memorybudget.h"
+#include "tracer.h"
+#include <QFontMetrics>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+#include <QDebug>
+
+namespace {
+const int DefaultPreviewHeight = 24;
+const int MaxPreviewWidth = 480;
+// A few thousand families of previews
+const qint64 CacheLimit = 32ll * 1024 * 1024;
+
+QString previewKey(const QString& family, int height, const QColor& color)
+{
+    return QString("%1|%2|%3").arg(color.name(QColor::HexArgb)).arg(height).arg(family);
+}
+
+class PreviewRunnable : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    PreviewRunnable(const QString& family, int height, const QColor& color)
+        : m_family(family)
+        , m_height(height)
+        , m_color(color)
+    {
+    }
+
+    void run() override
+    {
+        emit done(FontPreviewCache::instance()->preview(m_family, m_height, m_color));
+    }
+
+signals:
+    void done(const QImage& image);
+
+private:
+    QString m_family;
+    int m_height;
+    QColor m_color;
+};
+
+class PreviewResponse : public QQuickImageResponse
+{
+public:
+    PreviewResponse(const QString& family, int height, const QColor& color)
+    {
+        auto runnable = new PreviewRunnable(family, height, color);
+        connect(runnable, &PreviewRunnable::done, this, [this](const QImage& image) {
+            m_image = image;
+            emit finished();
+        });
+        JobScheduler::instance()->start(runnable);
+    }
+
+    QQuickTextureFactory* textureFactory() const override
+    {
+        return QQuickTextureFactory::textureFactoryForImage(m_image);
+    }
+
+private:
+    QImage m_image;
+};
+}
+
+FontPreviewCache::FontPreviewCache()
+{
+    m_cache.setMaxCost(CacheLimit);
+    // Prefetching must never hold up previews of rows that are on screen
+    m_pool.setMaxThreadCount(1);
+    MemoryBudget::instance()->setReclaimer(MemoryBudget::FontPreviews, [this](qint64 bytes) {
+        return reclaim(bytes);
+    });
+}
+
+FontPreviewCache* FontPreviewCache::instance()
+{
+    static FontPreviewCache* instance = new FontPreviewCache();
+    return instance;
+}
+
+QUrl FontPreviewCache::previewUrl(const QString& family, const QColor& color)
+{
+    return QUrl("image://fontpreview/" + color.name(QColor::HexRgb).mid(1) + "/"
+                + QString::fromLatin1(QUrl::toPercentEncoding(family)));
+}
+
+QImage FontPreviewCache::preview(const QString& family, int height, const QColor& color)
+{
+    const QString key = previewKey(family, height, color);
+    {
+        QMutexLocker locker(&m_mutex);
+        if (QImage* cached = m_cache.object(key)) {
+            return *cached;
+        }
+    }
+
+    // Two threads may render the same preview, the result is identical and small
+    const QImage image = render(family, height, color);
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(key, new QImage(image), qMax<qint64>(1, image.sizeInBytes()));
+    MemoryBudget::instance()->set(MemoryBudget::FontPreviews, m_cache.totalCost());
+    return image;
+}
+
+qint64 FontPreviewCache::reclaim(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 before = m_cache.totalCost();
+    m_cache.setMaxCost(qMax<qint64>(0, before - bytes));
+    m_cache.setMaxCost(CacheLimit);
+    MemoryBudget::instance()->set(MemoryBudget::FontPreviews, m_cache.totalCost());
+    return before - m_cache.totalCost();
+}
+
+void FontPreviewCache::prefetch(const QStringList& families, int height, const QColor& color)
+{
+    // A new list replaces what an older one still had queued
+    m_pool.clear();
+    for (const QString& family : families) {
+        m_pool.start([this, family, height, color]() { preview(family, height, color); });
+    }
+}
+
+QImage FontPreviewCache::render(const QString& family, int height, const QColor& color)
+{
+    TRACE_SCOPE("font", "render font preview");
+    QFont font(family);
+    font.setPixelSize(qMax(6, height * 3 / 4));
+    const QFontMetrics metrics(font);
+    const int width = qBound(1, metrics.horizontalAdvance(family) + 2, MaxPreviewWidth);
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    painter.setFont(font);
+    painter.setPen(color);
+    painter.drawText(image.rect(), Qt::AlignLeft | Qt::AlignVCenter, metrics.elidedText(family, Qt::ElideRight, width));
+    return image;
+}
+
+QQuickImageResponse* FontPreviewProvider::requestImageResponse(const QString& id, const QSize& requestedSize)
+{
+    // "<rrggbb>/<percent-encoded family>", see FontPreviewCache::previewUrl()
+    const int slash = id.indexOf('/');
+    const QColor color(QStringLiteral("#") + id.left(slash));
+    const QString family = QUrl::fromPercentEncoding(id.mid(slash + 1).toLatin1());
+    const int height = requestedSize.height() > 0 ? requestedSize.height() : DefaultPreviewHeight;
+    return new PreviewResponse(family, height, color);
+}
+
+#include "fontpreview.moc"
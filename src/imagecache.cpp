@@ -0,0 +1,646 @@
+#include "imagecache.h"
+#include "imagestore.h"
+#include "jobscheduler.h"
+#include "memorybudget.h"
+#include "pixelkernels.h"
+#include "tracer.h"
+#include <QBuffer>
+#include <QFile>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QQmlEngine>
+#include <QRunnable>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+#ifdef Q_OS_WASM
+const qint64 DefaultCacheLimit = 256ll * 1024 * 1024;
+#else
+const qint64 DefaultCacheLimit = 768ll * 1024 * 1024;
+#endif
+
+// Requests up to this size are served as exact thumbnails instead of mip levels
+const int ThumbnailMaxSize = 256;
+
+// Milliseconds within which two uses count as equally recent when reclaiming
+const qint64 RecencyGranularity = 1000;
+
+// Next mip level, 2x2 blocks averaged in linear light so fine detail keeps its brightness
+QImage halve(const QImage& image)
+{
+    QImage result((image.width() + 1) / 2, (image.height() + 1) / 2, image.format());
+    if (result.isNull()) {
+        return result;
+    }
+    for (int y = 0; y < result.height(); ++y) {
+        const int top = y * 2;
+        const int bottom = qMin(top + 1, image.height() - 1);
+        PixelKernels::downscale2xLinear(reinterpret_cast<const QRgb*>(image.constScanLine(top)),
+                                        reinterpret_cast<const QRgb*>(image.constScanLine(bottom)),
+                                        image.width(),
+                                        reinterpret_cast<QRgb*>(result.scanLine(y)));
+    }
+    return result;
+}
+
+// Opens a reader on the encoded bytes of a source, the buffer keeps in-memory data alive
+bool openReader(const QUrl& url, QImageReader& reader, QBuffer& buffer)
+{
+    if (url.isEmpty()) {
+        return false;
+    }
+
+    if (url.isLocalFile()) {
+        reader.setFileName(url.toLocalFile());
+        return true;
+    }
+
+    if (url.scheme() == "qrc") {
+        reader.setFileName(":" + url.path());
+        return true;
+    }
+
+    if (ImageStore::isStoreUrl(url)) {
+        buffer.setData(ImageStore::instance()->data(ImageStore::idForUrl(url)));
+    } else if (url.scheme() == "data") {
+        // data:[<mediatype>][;base64],<data>
+        QByteArray encoded = url.toEncoded();
+        int commaIndex = encoded.indexOf(',');
+        if (commaIndex == -1) {
+            return false;
+        }
+        buffer.setData(QByteArray::fromBase64(encoded.mid(commaIndex + 1)));
+    } else {
+        reader.setFileName(url.toString());
+        return true;
+    }
+
+    buffer.open(QIODevice::ReadOnly);
+    reader.setDevice(&buffer);
+    return true;
+}
+
+QString cacheKey(char kind, const QSize& size, const QUrl& source)
+{
+    return QString("%1%2x%3|%4").arg(kind).arg(size.width()).arg(size.height()).arg(source.toString());
+}
+
+qint64 imageCost(const QImage& image)
+{
+    return qMax<qint64>(1, image.sizeInBytes());
+}
+
+// Rect of the oriented image in the pixels of the file, before EXIF orientation is applied
+QRect storedRect(const QRect& rect, const QSize& storedSize, QImageIOHandler::Transformations transformation)
+{
+    auto toStored = [&](QPointF point) {
+        // Inverse of the decoder: mirror, flip, then rotate 90 degrees clockwise
+        if (transformation & QImageIOHandler::TransformationRotate90) {
+            point = QPointF(point.y(), storedSize.height() - point.x());
+        }
+        if (transformation & QImageIOHandler::TransformationFlip) {
+            point.setY(storedSize.height() - point.y());
+        }
+        if (transformation & QImageIOHandler::TransformationMirror) {
+            point.setX(storedSize.width() - point.x());
+        }
+        return point;
+    };
+    const QRectF stored = QRectF(toStored(rect.topLeft()), toStored(QPointF(rect.x() + rect.width(), rect.y() + rect.height()))).normalized();
+    return stored.toRect() & QRect(QPoint(0, 0), storedSize);
+}
+
+// Decodes off the GUI thread, the response may be gone by the time it finishes
+class ImageLoadRunnable : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    ImageLoadRunnable(const QUrl& source, const QSize& requestedSize)
+        : m_source(source)
+        , m_requestedSize(requestedSize)
+    {
+    }
+
+    void run() override
+    {
+        ImageCache* cache = ImageCache::instance();
+        const QSize& size = m_requestedSize;
+        bool small = size.width() > 0 && size.height() > 0
+                     && size.width() <= ThumbnailMaxSize && size.height() <= ThumbnailMaxSize;
+        emit done(small ? cache->thumbnail(m_source, size) : cache->imageForSize(m_source, size));
+    }
+
+signals:
+    void done(const QImage& image);
+
+private:
+    QUrl m_source;
+    QSize m_requestedSize;
+};
+
+class CachedImageResponse : public QQuickImageResponse
+{
+public:
+    CachedImageResponse(const QUrl& source, const QSize& requestedSize)
+        : m_source(source)
+    {
+        auto runnable = new ImageLoadRunnable(source, requestedSize);
+        connect(runnable, &ImageLoadRunnable::done, this, [this](const QImage& image) {
+            m_image = image;
+            emit finished();
+        });
+        JobScheduler::instance()->start(runnable);
+    }
+
+    QQuickTextureFactory* textureFactory() const override
+    {
+        return QQuickTextureFactory::textureFactoryForImage(m_image);
+    }
+
+    QString errorString() const override
+    {
+        return m_image.isNull() ? QString("Could not decode %1").arg(m_source.toString().left(64)) : QString();
+    }
+
+private:
+    QUrl m_source;
+    QImage m_image;
+};
+}
+
+// Static instance
+ImageCache* ImageCache::m_instance = nullptr;
+
+ImageCache::ImageCache(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+    setCacheLimit(DefaultCacheLimit);
+    MemoryBudget::instance()->setReclaimer(MemoryBudget::DecodedImages, [this](qint64 bytes) {
+        return reclaim(bytes);
+    });
+}
+
+ImageCache* ImageCache::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    // Image providers and the compositor keep using the cache after QML lets go of it
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+ImageCache* ImageCache::instance()
+{
+    static QMutex instanceMutex;
+    QMutexLocker locker(&instanceMutex);
+    if (!m_instance) {
+        m_instance = new ImageCache();
+    }
+    return m_instance;
+}
+
+void ImageCache::setCacheLimit(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(bytes);
+    reportUsage();
+}
+
+qint64 ImageCache::reclaim(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 oversized = m_oversized.isNull() ? 0 : imageCost(m_oversized);
+    const qint64 before = m_cache.totalCost() + oversized;
+    auto freed = [&]() {
+        return before - m_cache.totalCost() - (m_oversized.isNull() ? 0 : oversized);
+    };
+
+    // Least recently used first, entries used within the same second count as equally cold.
+    // Among those, adjusted copies go first, then derived levels and thumbnails, which are
+    // rebuilt from level 0 by halving. Level 0 goes last, tiles and every other level are cut from it.
+    const QString fullPrefix = cacheKey('L', QSize(0, 0), QUrl());
+    struct Candidate
+    {
+        qint64 lastUse;
+        int priority;
+        QString key;
+    };
+    QList<Candidate> candidates;
+    const QList<QString> keys = m_cache.keys();
+    for (const QString& key : keys) {
+        const int priority = key.startsWith('A') ? 0 : (key.startsWith(fullPrefix) ? 2 : 1);
+        candidates.append({ m_lastUse.value(key) / RecencyGranularity, priority, key });
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.lastUse != b.lastUse ? a.lastUse < b.lastUse : a.priority < b.priority;
+    });
+    for (const Candidate& candidate : std::as_const(candidates)) {
+        if (freed() >= bytes) {
+            break;
+        }
+        m_cache.remove(candidate.key);
+    }
+    forgetEvicted();
+
+    if (freed() < bytes && !m_oversized.isNull()) {
+        m_oversizedSource = QUrl();
+        m_oversized = QImage();
+    }
+
+    reportUsage();
+    return freed();
+}
+
+QUrl ImageCache::cachedSource(const QUrl& source) const
+{
+    if (source.isEmpty()) {
+        return QUrl();
+    }
+    return QUrl("image://cache/" + QString::fromLatin1(QUrl::toPercentEncoding(source.toString())));
+}
+
+void ImageCache::retain(const QUrl& source)
+{
+    QUrl url = resolveSource(source);
+    if (ImageStore::isStoreUrl(url)) {
+        ImageStore::instance()->retain(ImageStore::idForUrl(url));
+    }
+}
+
+void ImageCache::release(const QUrl& source)
+{
+    QUrl url = resolveSource(source);
+    if (!ImageStore::isStoreUrl(url) || !ImageStore::instance()->release(ImageStore::idForUrl(url))) {
+        return;
+    }
+
+    // Ids are never reused, nothing can ask for these again
+    QMutexLocker locker(&m_mutex);
+    const QString suffix = "|" + url.toString();
+    const QList<QString> keys = m_cache.keys();
+    for (const QString& key : keys) {
+        if (key.endsWith(suffix)) {
+            m_cache.remove(key);
+            m_lastUse.remove(key);
+        }
+    }
+    m_sizes.remove(url);
+    if (m_oversizedSource == url) {
+        m_oversizedSource = QUrl();
+        m_oversized = QImage();
+    }
+    reportUsage();
+}
+
+QUrl ImageCache::resolveSource(const QUrl& url)
+{
+    if (url.scheme() != "image" || url.host() != "cache") {
+        return url;
+    }
+    return QUrl(QUrl::fromPercentEncoding(url.path(QUrl::FullyEncoded).mid(1).toLatin1()));
+}
+
+QSize ImageCache::imageSize(const QUrl& source)
+{
+    TRACE_SCOPE("image", "read image header");
+    QUrl url = resolveSource(source);
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_sizes.constFind(url);
+        if (it != m_sizes.constEnd()) {
+            return it.value();
+        }
+    }
+
+    QImageReader reader;
+    QBuffer buffer;
+    QSize size;
+    if (openReader(url, reader, buffer)) {
+        reader.setAutoTransform(true);
+        size = reader.size();
+        // Orientation is applied on decode, report the size the user actually sees
+        if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+            size.transpose();
+        }
+    }
+
+    if (!size.isValid()) {
+        // Some handlers cannot read the size from the header alone
+        size = image(url, 0).size();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_sizes.insert(url, size);
+    return size;
+}
+
+QImage ImageCache::decode(const QUrl& source)
+{
+    TRACE_SCOPE("image", "decode");
+    QUrl url = resolveSource(source);
+    QImageReader reader;
+    QBuffer buffer;
+    if (!openReader(url, reader, buffer)) {
+        return QImage();
+    }
+
+    reader.setAutoTransform(true);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "Failed to decode image" << url.toString().left(64) << ":" << reader.errorString();
+        return image;
+    }
+
+    // Premultiplied is what QPainter and the scene graph consume without another conversion
+    if (image.hasAlphaChannel()) {
+        image.convertTo(QImage::Format_ARGB32_Premultiplied);
+    } else if (image.format() != QImage::Format_RGB32) {
+        image.convertTo(QImage::Format_RGB32);
+    }
+    return image;
+}
+
+QByteArray ImageCache::encodedData(const QUrl& source)
+{
+    QImageReader reader;
+    QBuffer buffer;
+    if (!openReader(resolveSource(source), reader, buffer)) {
+        return QByteArray();
+    }
+
+    // In-memory sources are already in the buffer, the others are files
+    if (buffer.isOpen()) {
+        return buffer.data();
+    }
+    QFile file(reader.fileName());
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not read" << reader.fileName();
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+QImage ImageCache::image(const QUrl& source, int level)
+{
+    QUrl url = resolveSource(source);
+    QString key = cacheKey('L', QSize(level, level), url);
+
+    QImage cached = lookup(key);
+    if (!cached.isNull()) {
+        return cached;
+    }
+    if (level <= 0) {
+        QMutexLocker locker(&m_mutex);
+        if (m_oversizedSource == url) {
+            return m_oversized;
+        }
+    }
+
+    // Concurrent requests for the same image wait here instead of decoding it twice
+    std::shared_ptr<QMutex> lock = decodeLock(key);
+    QMutexLocker decodeLocker(lock.get());
+
+    cached = lookup(key);
+    if (!cached.isNull()) {
+        return cached;
+    }
+
+    QImage result;
+    if (level <= 0) {
+        result = decode(url);
+    } else {
+        // Each level halves the previous one, so big photos are only decoded once
+        QImage parent = image(url, level - 1);
+        if (!parent.isNull()) {
+            TRACE_SCOPE("image", "resample mip level");
+            result = halve(parent);
+        }
+    }
+
+    if (!result.isNull()) {
+        insert(key, result);
+    }
+    return result;
+}
+
+QImage ImageCache::region(const QUrl& source, const QRect& rect)
+{
+    QUrl url = resolveSource(source);
+    QString key = cacheKey('L', QSize(0, 0), url);
+
+    QImage full = lookup(key);
+    if (!full.isNull()) {
+        return full.copy(rect);
+    }
+
+    // Decoded once and cached when it fits, unless that would only push the budget over again
+    const QSize size = imageSize(url);
+    const qint64 cost = qint64(size.width()) * size.height() * 4;
+    MemoryBudget* budget = MemoryBudget::instance();
+    bool fits;
+    {
+        QMutexLocker locker(&m_mutex);
+        fits = cost <= m_cache.maxCost();
+        if (m_oversizedSource == url) {
+            return m_oversized.copy(rect);
+        }
+    }
+    if (fits && budget->used() + cost <= budget->budget()) {
+        full = image(url, 0);
+        return full.isNull() ? full : full.copy(rect);
+    }
+
+    QImageReader reader;
+    QBuffer buffer;
+    if (openReader(url, reader, buffer) && reader.supportsOption(QImageIOHandler::ClipRect)) {
+        return decodeRegion(url, rect);
+    }
+
+    // No region decoding for this format, keep the one full decode the tiles are cut from
+    std::shared_ptr<QMutex> lock = decodeLock(key);
+    QMutexLocker decodeLocker(lock.get());
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_oversizedSource == url) {
+            return m_oversized.copy(rect);
+        }
+    }
+    full = decode(url);
+    if (full.isNull()) {
+        return full;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_oversizedSource = url;
+    m_oversized = full;
+    reportUsage();
+    return full.copy(rect);
+}
+
+QImage ImageCache::decodeRegion(const QUrl& url, const QRect& rect)
+{
+    TRACE_SCOPE("image", "decode region");
+    QImageReader reader;
+    QBuffer buffer;
+    if (!openReader(url, reader, buffer)) {
+        return QImage();
+    }
+
+    reader.setAutoTransform(true);
+    reader.setClipRect(storedRect(rect, reader.size(), reader.transformation()));
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "Failed to decode image region" << url.toString().left(64) << ":" << reader.errorString();
+        return image;
+    }
+
+    if (image.hasAlphaChannel()) {
+        image.convertTo(QImage::Format_ARGB32_Premultiplied);
+    } else if (image.format() != QImage::Format_RGB32) {
+        image.convertTo(QImage::Format_RGB32);
+    }
+    return image;
+}
+
+QImage ImageCache::imageForSize(const QUrl& source, const QSize& requestedSize)
+{
+    QSize fullSize = imageSize(source);
+    if (!fullSize.isValid() || (requestedSize.width() <= 0 && requestedSize.height() <= 0)) {
+        return image(source, 0);
+    }
+
+    // Smallest mip level that still covers the requested size in both constrained dimensions
+    qreal ratio = std::numeric_limits<qreal>::max();
+    if (requestedSize.width() > 0) {
+        ratio = qMin(ratio, qreal(fullSize.width()) / requestedSize.width());
+    }
+    if (requestedSize.height() > 0) {
+        ratio = qMin(ratio, qreal(fullSize.height()) / requestedSize.height());
+    }
+
+    int level = ratio > 1.0 ? int(std::floor(std::log2(ratio))) : 0;
+    while (level > 0 && (fullSize.width() >> level) < 1 && (fullSize.height() >> level) < 1) {
+        --level;
+    }
+    return image(source, level);
+}
+
+QImage ImageCache::thumbnail(const QUrl& source, const QSize& size)
+{
+    QUrl url = resolveSource(source);
+    QString key = cacheKey('T', size, url);
+
+    QImage cached = lookup(key);
+    if (!cached.isNull()) {
+        return cached;
+    }
+
+    // Thumbnails are shown cropped to fill their cell, scale to cover it
+    QImage base = imageForSize(url, size);
+    if (base.isNull()) {
+        return base;
+    }
+    QImage result = base.scaled(size, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+    insert(key, result);
+    return result;
+}
+
+QImage ImageCache::adjusted(const QUrl& source, const Adjustments& adjustments)
+{
+    if (adjustments.isIdentity()) {
+        return image(source, 0);
+    }
+
+    // Changing one layer's parameters misses only that layer's entry, the others stay cached
+    QUrl url = resolveSource(source);
+    QString key = QString("A%1|%2").arg(adjustments.key(), url.toString());
+
+    QImage cached = lookup(key);
+    if (!cached.isNull()) {
+        return cached;
+    }
+
+    std::shared_ptr<QMutex> lock = decodeLock(key);
+    QMutexLocker decodeLocker(lock.get());
+
+    cached = lookup(key);
+    if (!cached.isNull()) {
+        return cached;
+    }
+
+    QImage result = adjustments.apply(image(url, 0));
+    if (!result.isNull()) {
+        insert(key, result);
+    }
+    return result;
+}
+
+void ImageCache::reportUsage()
+{
+    // Called with m_mutex held
+    const qint64 oversized = m_oversized.isNull() ? 0 : imageCost(m_oversized);
+    MemoryBudget::instance()->set(MemoryBudget::DecodedImages, m_cache.totalCost() + oversized);
+}
+
+QImage ImageCache::lookup(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    QImage* image = m_cache.object(key);
+    if (!image) {
+        return QImage();
+    }
+    m_lastUse[key] = m_clock.elapsed();
+    return *image;
+}
+
+void ImageCache::insert(const QString& key, const QImage& image)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.insert(key, new QImage(image), imageCost(image));
+    m_lastUse[key] = m_clock.elapsed();
+    // QCache evicts on its own when full, drop the stamps it left behind now and then
+    if (m_lastUse.size() > 2 * m_cache.size() + 64) {
+        forgetEvicted();
+    }
+    reportUsage();
+}
+
+void ImageCache::forgetEvicted()
+{
+    // Called with m_mutex held
+    for (auto it = m_lastUse.begin(); it != m_lastUse.end();) {
+        it = m_cache.contains(it.key()) ? std::next(it) : m_lastUse.erase(it);
+    }
+}
+
+std::shared_ptr<QMutex> ImageCache::decodeLock(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    std::shared_ptr<QMutex>& lock = m_decodeLocks[key];
+    if (!lock) {
+        lock = std::make_shared<QMutex>();
+    }
+
+    // Drop locks nobody is waiting on so the table does not grow with every source seen
+    for (auto it = m_decodeLocks.begin(); it != m_decodeLocks.end();) {
+        if (it.key() != key && it.value().use_count() == 1) {
+            it = m_decodeLocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return lock;
+}
+
+QQuickImageResponse* CachedImageProvider::requestImageResponse(const QString& id, const QSize& requestedSize)
+{
+    // The id is the percent-encoded source, see ImageCache::cachedSource()
+    QUrl source(QUrl::fromPercentEncoding(id.toLatin1()));
+    return new CachedImageResponse(source, requestedSize);
+}
+
+#include "imagecache.moc"
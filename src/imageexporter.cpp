@@ -1,10 +1,10 @@
 #include "imageexporter.h"
-#include <QQuickItemGrabResult>
-#include <QSharedPointer>
+#include "tracer.h"
 #include <QDebug>
-#include <QBuffer>
 #include <QStandardPaths>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QSet>
 
 #ifdef Q_OS_WASM
 #include <emscripten.h>
@@ -27,7 +27,7 @@ EMSCRIPTEN_KEEPALIVE void saveFileSelectedCallback(const char* fileName) {
 ImageExporter* ImageExporter::m_instance = nullptr;
 
 ImageExporter::ImageExporter(QObject *parent)
-    : QObject(parent), m_imageContainer(nullptr)
+    : QObject(parent), m_imageContainer(nullptr), m_exportJob(nullptr), m_variantJob(nullptr), m_exportProgress(0.0), m_matteColor(Qt::white)
 {
 #ifdef Q_OS_WASM
     g_imageExporter = this;
@@ -50,6 +50,18 @@ ImageExporter* ImageExporter::instance()
     return m_instance;
 }
 
+void ImageExporter::setMatteColor(const QColor& color)
+{
+    // Formats without alpha get an opaque background, whatever alpha the color had
+    QColor opaque = color;
+    opaque.setAlpha(255);
+    if (opaque == m_matteColor) {
+        return;
+    }
+    m_matteColor = opaque;
+    emit matteColorChanged();
+}
+
 void ImageExporter::openSaveDialog(QQuickItem* imageContainer)
 {
     if (!imageContainer) {
@@ -71,222 +83,377 @@ void ImageExporter::openSaveDialog(QQuickItem* imageContainer)
     emit saveFileSelected(suggestedName, width, height);
 }
 
-void ImageExporter::grabImageAndSave(const QString& fileName, int targetWidth, int targetHeight)
+void ImageExporter::grabImageAndSave(const QString& fileName, int targetWidth, int targetHeight, const QVariantList& variants)
 {
+    TRACE_SCOPE("export", "capture scene");
     if (!m_imageContainer) {
         qWarning() << "No image container stored";
         return;
     }
 
-    // Store original selection states and hide all selections
-    QList<QQuickItem*> textItems;
-    QList<bool> originalSelectionStates;
+    // Snapshot the layer description on the GUI thread, selection frames are never part of it
+    m_pendingScene = SceneCompositor::captureScene(m_imageContainer);
+    m_pendingSize = QSize(targetWidth, targetHeight);
+    m_pendingVariants = variants;
+    m_imageContainer = nullptr;
 
-    for (int i = 0; i < m_imageContainer->childItems().size(); ++i) {
-        QQuickItem* child = m_imageContainer->childItems().at(i);
-        if (child->property("selected").isValid()) {
-            textItems.append(child);
-            originalSelectionStates.append(child->property("selected").toBool());
-            child->setProperty("selected", false);
-        }
-    }
-
-    bool originalBorderVisibility = true;
-    QQuickItem* imageBorder = m_imageContainer->findChild<QQuickItem*>("imageBorder");
-    if (imageBorder) {
-        originalBorderVisibility = imageBorder->isVisible();
-        imageBorder->setVisible(false);
+    if (!m_pendingScene.isValid()) {
+        qWarning() << "Nothing to export";
+        return;
     }
 
-    // Calculate scale factor and create target size
-    QSize targetSize(targetWidth, targetHeight);
-
-    // Grab the image container without selections at the target resolution
-    QSharedPointer<QQuickItemGrabResult> grabResult = m_imageContainer->grabToImage(targetSize);
-
-    connect(grabResult.data(), &QQuickItemGrabResult::ready, [this, grabResult, textItems, originalSelectionStates, imageBorder, originalBorderVisibility, fileName]() {
-        // Store the grabbed image (already scaled to target resolution)
-        m_grabbedImage = grabResult->image();
-
-        // Restore original selection states and border visibility
-        for (int i = 0; i < textItems.size(); ++i) {
-            textItems.at(i)->setProperty("selected", originalSelectionStates.at(i));
-        }
-
-        if (imageBorder) {
-            imageBorder->setVisible(originalBorderVisibility);
-        }
-
-        // Now proceed with saving
+    // Native platforms wait for the file dialog and stream straight to the chosen file
 #ifdef Q_OS_WASM
-        saveGrabbedImage(fileName);
+    saveGrabbedImage(fileName);
+#else
+    Q_UNUSED(fileName)
 #endif
-
-        // Clear the container reference
-        m_imageContainer = nullptr;
-    });
 }
 
 void ImageExporter::saveGrabbedImage(const QString& fileName)
 {
-    if (m_grabbedImage.isNull()) {
+    if (!m_pendingScene.isValid()) {
         qWarning() << "No grabbed image to save";
         return;
     }
 
 #ifdef Q_OS_WASM
-    // WebAssembly: create blob and trigger download
-    QByteArray imageData;
-    QBuffer buffer(&imageData);
-    buffer.open(QIODevice::WriteOnly);
-
-    // Extract file extension to determine format
-    QString format = "PNG";
-    QString mimeType = "image/png";
+    // WebAssembly: ask for the save location while the click still counts as a user gesture,
+    // then encode to memory and hand the bytes to the browser
+    if (m_pendingVariants.isEmpty()) {
+        prepareDownload(fileName, mimeTypeForFormat(formatForPath(fileName)));
+    } else {
+        // Several variants go out as one archive, browsers block bursts of downloads
+        prepareDownload(archiveNameFor(fileName), "application/zip");
+    }
+    startExport(QString(), fileName);
+#else
+    // Native platforms: this shouldn't be called, but handle it just in case
+    qWarning() << "saveGrabbedImage called on native platform";
+#endif
+}
 
-    QString lowerPath = fileName.toLower();
-    if (lowerPath.endsWith(".jpg") || lowerPath.endsWith(".jpeg")) {
-        format = "JPEG";
-        mimeType = "image/jpeg";
-    } else if (lowerPath.endsWith(".bmp")) {
-        format = "BMP";
-        mimeType = "image/bmp";
-    } else if (lowerPath.endsWith(".webp")) {
-        format = "WEBP";
-        mimeType = "image/webp";
+void ImageExporter::saveImage(QQuickItem* imageContainer, const QUrl& fileUrl)
+{
+    QString filePath = fileUrl.toLocalFile();
+    if (filePath.isEmpty()) {
+        filePath = fileUrl.toString();
     }
 
-    if (m_grabbedImage.save(&buffer, format.toUtf8().constData())) {
-        QString base64Data = imageData.toBase64();
+    // Fallback: export the container at its own size (shouldn't be needed with new workflow)
+    if (!m_pendingScene.isValid()) {
+        if (!imageContainer) {
+            qWarning() << "No image container provided and no grabbed image available";
+            return;
+        }
 
-        EM_ASM({
-            var base64Data = UTF8ToString($0);
-            var fileName = UTF8ToString($1);
-            var mimeType = UTF8ToString($2);
+        m_pendingScene = SceneCompositor::captureScene(imageContainer);
+        m_pendingSize = m_pendingScene.sceneSize.toSize();
+        if (!m_pendingScene.isValid()) {
+            qWarning() << "Nothing to export";
+            return;
+        }
+    }
 
-            console.log("Downloading file as:", fileName, "with mime type:", mimeType);
+    startExport(filePath, QFileInfo(filePath).fileName());
+}
 
-            // Convert base64 to blob
-            var byteCharacters = atob(base64Data);
-            var byteNumbers = new Array(byteCharacters.length);
-            for (var i = 0; i < byteCharacters.length; i++) {
-                byteNumbers[i] = byteCharacters.charCodeAt(i);
-            }
-            var byteArray = new Uint8Array(byteNumbers);
-            var blob = new Blob([byteArray], {type: mimeType});
+void ImageExporter::startExport(const QString& filePath, const QString& fileName)
+{
+    if (m_exportJob) {
+        m_exportJob->cancel();
+        m_exportJob->disconnect(this);
+        m_exportJob->deleteLater();
+        m_exportJob = nullptr;
+    }
+    if (m_variantJob) {
+        m_variantJob->cancel();
+        m_variantJob->disconnect(this);
+        m_variantJob->deleteLater();
+        m_variantJob = nullptr;
+    }
 
-            // Create download link
-            var link = document.createElement('a');
-            link.href = URL.createObjectURL(blob);
-            link.download = fileName;
-            document.body.appendChild(link);
-            link.click();
-            document.body.removeChild(link);
-            URL.revokeObjectURL(link.href);
-        }, base64Data.toUtf8().constData(), fileName.toUtf8().constData(), mimeType.toUtf8().constData());
+    if (!m_pendingVariants.isEmpty()) {
+        startVariantExport(filePath, fileName);
+        return;
+    }
 
-        qDebug() << "Image download initiated with filename:" << fileName;
-    } else {
-        qWarning() << "Failed to create image data for download in format:" << format;
+    const QString format = formatForPath(fileName);
+    ExportJob* job = new ExportJob(m_pendingScene, m_pendingSize, format, this);
+    if (!filePath.isEmpty()) {
+        job->setOutputFile(filePath);
     }
-#else
-    // Native platforms: this shouldn't be called, but handle it just in case
-    qWarning() << "saveGrabbedImage called on native platform";
+    job->setMatteColor(m_matteColor.rgb());
+
+    m_pendingScene = SceneDescription();
+    m_exportJob = job;
+
+    connect(job, &ExportJob::progressChanged, this, [this, job](qreal progress) {
+        if (job == m_exportJob) {
+            m_exportProgress = progress;
+            emit exportProgressChanged();
+        }
+    });
+
+    connect(job, &ExportJob::finished, this, [this, job, filePath, fileName](bool success) {
+        if (job != m_exportJob) {
+            return;
+        }
+
+        if (success) {
+#ifdef Q_OS_WASM
+            downloadData(job->encodedData(), fileName, mimeTypeForFormat(job->format()));
 #endif
+            qDebug() << "Image exported successfully:" << (filePath.isEmpty() ? fileName : filePath) << "in format:" << job->format();
+        } else {
+#ifdef Q_OS_WASM
+            discardDownload();
+#endif
+            qWarning() << "Image export failed or was cancelled:" << fileName;
+        }
+
+        m_exportJob = nullptr;
+        job->deleteLater();
+
+        emit exportingChanged();
+        emit exportFinished(success, fileName);
+    });
+
+    m_exportProgress = 0.0;
+    emit exportProgressChanged();
+    emit exportingChanged();
+    emit exportStarted(fileName);
 
-    // Clear the grabbed image
-    m_grabbedImage = QImage();
+    job->start();
 }
 
-void ImageExporter::saveImage(QQuickItem* imageContainer, const QUrl& fileUrl)
+void ImageExporter::startVariantExport(const QString& filePath, const QString& fileName)
 {
-    // If we have a grabbed image, use that instead of grabbing again
-    if (!m_grabbedImage.isNull()) {
-        QString filePath = fileUrl.toLocalFile();
-        if (filePath.isEmpty()) {
-            filePath = fileUrl.toString();
+    VariantExportJob* job = new VariantExportJob(m_pendingScene, variantsFor(fileName), this);
+    if (!filePath.isEmpty()) {
+        // The extra sizes are written next to the file picked in the dialog
+        job->setOutputDirectory(QFileInfo(filePath).absolutePath());
+    }
+    job->setMatteColor(m_matteColor.rgb());
+
+    m_pendingScene = SceneDescription();
+    m_pendingVariants.clear();
+    m_variantJob = job;
+
+    connect(job, &VariantExportJob::progressChanged, this, [this, job](qreal progress) {
+        if (job == m_variantJob) {
+            m_exportProgress = progress;
+            emit exportProgressChanged();
         }
+    });
 
-        QString format = "PNG";
-        QString lowerPath = filePath.toLower();
-        if (lowerPath.endsWith(".jpg") || lowerPath.endsWith(".jpeg")) {
-            format = "JPEG";
-        } else if (lowerPath.endsWith(".bmp")) {
-            format = "BMP";
-        } else if (lowerPath.endsWith(".webp")) {
-            format = "WEBP";
+    connect(job, &VariantExportJob::finished, this, [this, job, fileName](bool success) {
+        if (job != m_variantJob) {
+            return;
         }
 
-        if (m_grabbedImage.save(filePath, format.toUtf8().constData())) {
-            qDebug() << "Grabbed image saved successfully to:" << filePath << "in format:" << format;
+        if (success) {
+#ifdef Q_OS_WASM
+            downloadData(job->archive(), archiveNameFor(fileName), "application/zip");
+#endif
+            qDebug() << "Exported" << job->variants().size() << "variants of" << fileName;
         } else {
-            qWarning() << "Failed to save grabbed image to:" << filePath << "in format:" << format;
+#ifdef Q_OS_WASM
+            discardDownload();
+#endif
+            qWarning() << "Variant export failed or was cancelled:" << fileName;
         }
 
-        // Clear the grabbed image after saving
-        m_grabbedImage = QImage();
-        return;
-    }
+        m_variantJob = nullptr;
+        job->deleteLater();
 
-    // Fallback: original grab and save logic (shouldn't be needed with new workflow)
-    if (!imageContainer) {
-        qWarning() << "No image container provided and no grabbed image available";
-        return;
-    }
+        emit exportingChanged();
+        emit exportFinished(success, fileName);
+    });
 
-    QString filePath = fileUrl.toLocalFile();
-    if (filePath.isEmpty()) {
-        filePath = fileUrl.toString();
-    }
+    m_exportProgress = 0.0;
+    emit exportProgressChanged();
+    emit exportingChanged();
+    emit exportStarted(fileName);
 
-    // Store original selection states and hide all selections
-    QList<QQuickItem*> textItems;
-    QList<bool> originalSelectionStates;
+    job->start();
+}
 
-    for (int i = 0; i < imageContainer->childItems().size(); ++i) {
-        QQuickItem* child = imageContainer->childItems().at(i);
-        if (child->property("selected").isValid()) {
-            textItems.append(child);
-            originalSelectionStates.append(child->property("selected").toBool());
-            child->setProperty("selected", false);
+QList<ExportVariant> ImageExporter::variantsFor(const QString& fileName) const
+{
+    QList<ExportVariant> variants;
+    variants.append({ fileName, formatForPath(fileName), m_pendingSize, -1 });
+
+    const QString baseName = QFileInfo(fileName).completeBaseName();
+    const int longEdge = qMax(m_pendingSize.width(), m_pendingSize.height());
+    QSet<QString> usedNames { fileName };
+
+    for (const QVariant& entry : m_pendingVariants) {
+        const QVariantMap spec = entry.toMap();
+        const QString extension = spec.value("format").toString().toLower();
+        // Never larger than the main export, that is what gets composited
+        const int size = qBound(1, spec.value("size", longEdge).toInt(), longEdge);
+        const qreal scale = qreal(size) / longEdge;
+
+        ExportVariant variant;
+        variant.format = formatForPath("." + extension);
+        variant.size = QSize(qMax(1, qRound(m_pendingSize.width() * scale)),
+                             qMax(1, qRound(m_pendingSize.height() * scale)));
+        variant.quality = spec.value("quality", -1).toInt();
+
+        // photo.png gets photo_2048.jpg and photo_512.webp next to it
+        variant.fileName = QString("%1_%2.%3").arg(baseName).arg(size).arg(extension);
+        for (int n = 2; usedNames.contains(variant.fileName); ++n) {
+            variant.fileName = QString("%1_%2_%3.%4").arg(baseName).arg(size).arg(n).arg(extension);
         }
+        usedNames.insert(variant.fileName);
+        variants.append(variant);
     }
 
-    bool originalBorderVisibility = true;
-    QQuickItem* imageBorder = imageContainer->findChild<QQuickItem*>("imageBorder");
-    if (imageBorder) {
-        originalBorderVisibility = imageBorder->isVisible();
-        imageBorder->setVisible(false);
+    return variants;
+}
+
+void ImageExporter::cancelExport()
+{
+    if (m_exportJob) {
+        m_exportJob->cancel();
+    }
+    if (m_variantJob) {
+        m_variantJob->cancel();
     }
+}
 
-    // Grab the image container without selections
-    QSharedPointer<QQuickItemGrabResult> grabResult = imageContainer->grabToImage();
+QString ImageExporter::formatForPath(const QString& filePath)
+{
+    QString lowerPath = filePath.toLower();
+    if (lowerPath.endsWith(".jpg") || lowerPath.endsWith(".jpeg")) {
+        return "JPEG";
+    } else if (lowerPath.endsWith(".bmp")) {
+        return "BMP";
+    } else if (lowerPath.endsWith(".webp")) {
+        return "WEBP";
+    }
+    return "PNG";
+}
 
-    connect(grabResult.data(), &QQuickItemGrabResult::ready, [grabResult, filePath, textItems, originalSelectionStates, imageBorder, originalBorderVisibility]() {
-        // Restore original selection states and border visibility
-        for (int i = 0; i < textItems.size(); ++i) {
-            textItems.at(i)->setProperty("selected", originalSelectionStates.at(i));
-        }
+QString ImageExporter::archiveNameFor(const QString& fileName)
+{
+    return QFileInfo(fileName).completeBaseName() + ".zip";
+}
 
-        if (imageBorder) {
-            imageBorder->setVisible(originalBorderVisibility);
+QString ImageExporter::mimeTypeForFormat(const QString& format)
+{
+    if (format == "JPEG") {
+        return "image/jpeg";
+    } else if (format == "BMP") {
+        return "image/bmp";
+    } else if (format == "WEBP") {
+        return "image/webp";
+    }
+    return "image/png";
+}
+
+void ImageExporter::prepareDownload(const QString& fileName, const QString& mimeType)
+{
+#ifdef Q_OS_WASM
+    EM_ASM({
+        var fileName = UTF8ToString($0);
+        var mimeType = UTF8ToString($1);
+
+        Module.quickEditsSaveHandle = undefined;
+        if (typeof window.showSaveFilePicker !== 'function') {
+            return;
         }
 
-        // Extract format from file extension
-        QString format = "PNG";
-        QString lowerPath = filePath.toLower();
-        if (lowerPath.endsWith(".jpg") || lowerPath.endsWith(".jpeg")) {
-            format = "JPEG";
-        } else if (lowerPath.endsWith(".bmp")) {
-            format = "BMP";
-        } else if (lowerPath.endsWith(".webp")) {
-            format = "WEBP";
+        // File System Access API: resolves to a handle, or null if the picker was dismissed
+        var extension = fileName.substring(fileName.lastIndexOf('.'));
+        var accept = {};
+        accept[mimeType] = [extension];
+        Module.quickEditsSaveHandle = window.showSaveFilePicker({
+            suggestedName: fileName,
+            types: [{ description: "Image", accept: accept }]
+        }).catch(function(error) {
+            if (error && error.name === 'AbortError') {
+                return null;
+            }
+            console.log("Save picker unavailable, falling back to a download link:", error);
+            return undefined;
+        });
+    }, fileName.toUtf8().constData(), mimeType.toUtf8().constData());
+#else
+    Q_UNUSED(fileName)
+    Q_UNUSED(mimeType)
+#endif
+}
+
+void ImageExporter::discardDownload()
+{
+#ifdef Q_OS_WASM
+    EM_ASM({
+        Module.quickEditsSaveHandle = undefined;
+    });
+#endif
+}
+
+void ImageExporter::downloadData(const QByteArray& data, const QString& fileName, const QString& mimeType)
+{
+    TRACE_SCOPE("transfer", "blob download");
+#ifdef Q_OS_WASM
+    EM_ASM({
+        var fileName = UTF8ToString($2);
+        var mimeType = UTF8ToString($3);
+
+        console.log("Downloading file as:", fileName, "with mime type:", mimeType);
+
+        // View on the encoded bytes inside the wasm heap. Blob rejects views on a
+        // SharedArrayBuffer (threaded builds), those get copied out first.
+        var view = HEAPU8.subarray($0, $0 + $1);
+        if (typeof SharedArrayBuffer !== 'undefined' && view.buffer instanceof SharedArrayBuffer) {
+            view = view.slice();
         }
 
-        if (grabResult->image().save(filePath, format.toUtf8().constData())) {
-            qDebug() << "Image saved successfully to:" << filePath << "in format:" << format;
-        } else {
-            qWarning() << "Failed to save image to:" << filePath << "in format:" << format;
+        // The Blob holds the only copy once this returns, the C++ buffer can be released
+        var blob = new Blob([view], {type: mimeType});
+
+        var downloadLink = function() {
+            var link = document.createElement('a');
+            link.href = URL.createObjectURL(blob);
+            link.download = fileName;
+            document.body.appendChild(link);
+            link.click();
+            document.body.removeChild(link);
+            setTimeout(function() { URL.revokeObjectURL(link.href); }, 0);
+        };
+
+        var handlePromise = Module.quickEditsSaveHandle;
+        Module.quickEditsSaveHandle = undefined;
+        if (!handlePromise) {
+            downloadLink();
+            return;
         }
-    });
+
+        handlePromise.then(function(handle) {
+            if (handle === null) {
+                console.log("Save picker dismissed, nothing written");
+                return;
+            }
+            if (handle === undefined) {
+                downloadLink();
+                return;
+            }
+            return handle.createWritable().then(function(writable) {
+                return blob.stream().pipeTo(writable);
+            });
+        }).catch(function(error) {
+            console.error("Writing through the save picker failed:", error);
+            downloadLink();
+        });
+    }, data.constData(), data.size(), fileName.toUtf8().constData(), mimeType.toUtf8().constData());
+
+    qDebug() << "Image download initiated with filename:" << fileName;
+#else
+    Q_UNUSED(data)
+    Q_UNUSED(fileName)
+    Q_UNUSED(mimeType)
+#endif
 }
@@ -0,0 +1,107 @@
+#include "imagestore.h"
+#include "memorybudget.h"
+#include <QBuffer>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QDebug>
+
+ImageStore* ImageStore::instance()
+{
+    static ImageStore store;
+    return &store;
+}
+
+QString ImageStore::insert(const QByteArray& data)
+{
+    QMutexLocker locker(&m_mutex);
+    QString id = QString::number(m_nextId++);
+    m_data.insert(id, data);
+    m_bytes += data.size();
+    MemoryBudget::instance()->set(MemoryBudget::Uploads, m_bytes);
+    return id;
+}
+
+QByteArray ImageStore::data(const QString& id) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_data.value(id);
+}
+
+void ImageStore::remove(const QString& id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_users.remove(id);
+    m_bytes -= m_data.take(id).size();
+    MemoryBudget::instance()->set(MemoryBudget::Uploads, m_bytes);
+}
+
+void ImageStore::retain(const QString& id)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_data.contains(id)) {
+        ++m_users[id];
+    }
+}
+
+bool ImageStore::release(const QString& id)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_users.find(id);
+        if (it == m_users.end() || --it.value() > 0) {
+            return false;
+        }
+    }
+    remove(id);
+    return true;
+}
+
+QUrl ImageStore::urlForId(const QString& id)
+{
+    return QUrl("image://uploads/" + id);
+}
+
+bool ImageStore::isStoreUrl(const QUrl& url)
+{
+    return url.scheme() == "image" && url.host() == "uploads";
+}
+
+QString ImageStore::idForUrl(const QUrl& url)
+{
+    return url.path().mid(1);
+}
+
+UploadImageProvider::UploadImageProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image)
+{
+}
+
+QImage UploadImageProvider::requestImage(const QString& id, QSize* size, const QSize& requestedSize)
+{
+    // The QByteArray shares the uploaded bytes, QBuffer reads them in place
+    QByteArray data = ImageStore::instance()->data(id);
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    QImageReader reader(&buffer);
+    QSize fullSize = reader.size();
+    if (size) {
+        *size = fullSize;
+    }
+
+    // sourceSize may constrain only one dimension, never upscale
+    if (fullSize.isValid() && (requestedSize.width() > 0 || requestedSize.height() > 0)) {
+        QSize bounds(requestedSize.width() > 0 ? requestedSize.width() : fullSize.width(),
+                     requestedSize.height() > 0 ? requestedSize.height() : fullSize.height());
+        QSize scaled = fullSize.scaled(bounds, Qt::KeepAspectRatio);
+        if (scaled.width() < fullSize.width()) {
+            reader.setScaledSize(scaled);
+        }
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "Failed to decode uploaded image" << id << ":" << reader.errorString();
+    }
+    return image;
+}
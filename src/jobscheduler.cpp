@@ -0,0 +1,62 @@
+#include "jobscheduler.h"
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+
+namespace {
+#ifdef Q_OS_WASM
+#ifndef QUICKEDITS_WASM_WORKERS
+#define QUICKEDITS_WASM_WORKERS 3
+#endif
+// CMake preallocates these for the shared pool, on top of the threads of the other pools
+const int WasmWorkerCount = qMax(1, QUICKEDITS_WASM_WORKERS);
+#endif
+}
+
+// Static instance
+JobScheduler* JobScheduler::m_instance = nullptr;
+
+JobScheduler::JobScheduler(QObject *parent)
+    : QObject(parent)
+    , m_workerCount(qMax(1, QThread::idealThreadCount()))
+{
+#ifdef Q_OS_WASM
+    m_workerCount = WasmWorkerCount;
+#endif
+
+    QThreadPool::globalInstance()->setMaxThreadCount(m_workerCount);
+    qDebug() << "Job scheduler:" << m_workerCount << "workers";
+}
+
+JobScheduler* JobScheduler::instance()
+{
+    // Static initialization is not thread safe here, the GUI thread creates it in main()
+    if (!m_instance) {
+        m_instance = new JobScheduler();
+        // Results are delivered through queued calls on this object, they belong on the GUI thread
+        if (QCoreApplication::instance() && m_instance->thread() != QCoreApplication::instance()->thread()) {
+            m_instance->moveToThread(QCoreApplication::instance()->thread());
+        }
+    }
+    return m_instance;
+}
+
+void JobScheduler::start(QRunnable* runnable)
+{
+    QThreadPool::globalInstance()->start(runnable);
+}
+
+void JobScheduler::start(std::function<void()> job)
+{
+    QThreadPool::globalInstance()->start(std::move(job));
+}
+
+void JobScheduler::runChunked(QObject* context, std::function<bool()> step, std::function<void()> done)
+{
+    run(context, [step = std::move(step)]() {
+        while (!step()) {
+        }
+    }, std::move(done));
+}
@@ -0,0 +1,1012 @@
+#include "jpegtransform.h"
+#include "tracer.h"
+#include <QDebug>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+// Natural (row major) index of every coefficient in zigzag order
+const int ZigZag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Output is always coded with the example tables of the JPEG standard (Annex K.3),
+// they have a code for every symbol an 8 bit baseline file can contain
+const uchar DcLuminanceCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uchar DcChrominanceCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uchar DcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uchar AcLuminanceCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uchar AcLuminanceValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+const uchar AcChrominanceCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uchar AcChrominanceValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Coefficient storage is two bytes per sample of every component, refuse what the decoder could not hold either
+const qint64 MaxCoefficientBytes = 1ll << 30;
+
+const int LookupBits = 9;
+
+struct DecodeTable
+{
+    bool defined = false;
+    quint16 lookup[1 << LookupBits];    // (length << 8) | value for codes up to LookupBits long, 0 otherwise
+    int maxCode[17];
+    int valueOffset[17];
+    uchar values[256];
+};
+
+struct EncodeTable
+{
+    quint16 code[256];
+    uchar size[256];
+};
+
+struct QuantTable
+{
+    bool defined = false;
+    int precision = 0;      // 0: 8 bit values, 1: 16 bit
+    quint16 values[64];     // natural order
+};
+
+struct Component
+{
+    int id = 0;
+    int h = 1;
+    int v = 1;
+    int quantTable = 0;
+    int dcTable = 0;
+    int acTable = 0;
+    int blocksWide = 0;
+    int blocksHigh = 0;
+    std::vector<qint16> blocks;     // 64 coefficients per block in natural order, block rows top to bottom
+};
+
+struct Segment
+{
+    uchar marker = 0;
+    int offset = 0;         // of the payload in the source file
+    QByteArray payload;
+};
+
+struct Jpeg
+{
+    std::vector<Segment> metadata;  // APPn and COM segments, written back as they are
+    QuantTable quantTables[4];
+    DecodeTable dcTables[4];
+    DecodeTable acTables[4];
+    uchar frameMarker = 0;
+    int width = 0;
+    int height = 0;
+    int maxH = 1;
+    int maxV = 1;
+    int restartInterval = 0;
+    int scanStart = 0;              // first byte of entropy coded data
+    std::vector<Component> components;
+
+    int mcuWidth() const { return components.size() == 1 ? 8 : 8 * maxH; }
+    int mcuHeight() const { return components.size() == 1 ? 8 : 8 * maxV; }
+};
+
+bool buildDecodeTable(const uchar* counts, const uchar* values, int valueCount, DecodeTable& table)
+{
+    std::memset(table.lookup, 0, sizeof(table.lookup));
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= 16; ++length) {
+        table.valueOffset[length] = index - code;
+        for (int i = 0; i < counts[length - 1]; ++i, ++index, ++code) {
+            if (index >= valueCount) {
+                return false;
+            }
+            if (length <= LookupBits) {
+                const int shift = LookupBits - length;
+                for (int fill = 0; fill < (1 << shift); ++fill) {
+                    table.lookup[(code << shift) | fill] = quint16((length << 8) | values[index]);
+                }
+            }
+        }
+        table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+        if (code > (1 << length)) {
+            return false;
+        }
+        code <<= 1;
+    }
+
+    std::memcpy(table.values, values, valueCount);
+    table.defined = true;
+    return index == valueCount;
+}
+
+void buildEncodeTable(const uchar* counts, const uchar* values, EncodeTable& table)
+{
+    std::memset(table.size, 0, sizeof(table.size));
+    int code = 0;
+    int index = 0;
+    for (int length = 1; length <= 16; ++length) {
+        for (int i = 0; i < counts[length - 1]; ++i, ++index, ++code) {
+            table.code[values[index]] = quint16(code);
+            table.size[values[index]] = uchar(length);
+        }
+        code <<= 1;
+    }
+}
+
+// Reads entropy coded data, removing stuffed zero bytes. At a marker it supplies zero bits,
+// consuming those means the data was truncated or corrupt.
+class BitReader
+{
+public:
+    BitReader(const uchar* data, int size, int position)
+        : m_data(data), m_size(size), m_position(position)
+    {
+    }
+
+    int bits(int count)
+    {
+        if (count == 0) {
+            return 0;
+        }
+        fill();
+        const int value = int(m_buffer >> (32 - count));
+        m_buffer <<= count;
+        m_count -= count;
+        return value;
+    }
+
+    int decode(const DecodeTable& table)
+    {
+        fill();
+        const quint16 entry = table.lookup[m_buffer >> (32 - LookupBits)];
+        if (entry) {
+            const int length = entry >> 8;
+            m_buffer <<= length;
+            m_count -= length;
+            return entry & 0xff;
+        }
+        for (int length = LookupBits + 1; length <= 16; ++length) {
+            const int code = int(m_buffer >> (32 - length));
+            if (code <= table.maxCode[length]) {
+                m_buffer <<= length;
+                m_count -= length;
+                return table.values[table.valueOffset[length] + code];
+            }
+        }
+        return -1;
+    }
+
+    // Skips to the next RSTn marker and past it, leftover bits of the interval are padding
+    bool restart()
+    {
+        m_buffer = 0;
+        m_count = 0;
+        m_padding = 0;
+        const int marker = nextMarker();
+        if (marker < 0xD0 || marker > 0xD7) {
+            return false;
+        }
+        m_position += 2;
+        m_marker = false;
+        return true;
+    }
+
+    bool exhausted() const { return m_padding * 8 > m_count; }
+
+    // Marker following the entropy coded data, -1 at the end of the file
+    int nextMarker()
+    {
+        while (m_position + 1 < m_size) {
+            if (m_data[m_position] == 0xFF && m_data[m_position + 1] != 0x00 && m_data[m_position + 1] != 0xFF) {
+                return m_data[m_position + 1];
+            }
+            ++m_position;
+        }
+        return -1;
+    }
+
+private:
+    void fill()
+    {
+        while (m_count <= 24) {
+            quint32 byte = 0;
+            if (!m_marker && m_position < m_size) {
+                byte = m_data[m_position];
+                if (byte != 0xFF) {
+                    ++m_position;
+                } else if (m_position + 1 < m_size && m_data[m_position + 1] == 0x00) {
+                    m_position += 2;
+                } else {
+                    m_marker = true;
+                    byte = 0;
+                }
+            }
+            if (m_marker || m_position >= m_size) {
+                ++m_padding;
+            }
+            m_buffer |= byte << (24 - m_count);
+            m_count += 8;
+        }
+    }
+
+    const uchar* m_data;
+    int m_size;
+    int m_position;
+    quint32 m_buffer = 0;
+    int m_count = 0;
+    int m_padding = 0;
+    bool m_marker = false;
+};
+
+class BitWriter
+{
+public:
+    explicit BitWriter(QByteArray& out) : m_out(out) {}
+
+    void put(quint32 value, int count)
+    {
+        m_buffer = (m_buffer << count) | (value & ((1u << count) - 1));
+        m_count += count;
+        while (m_count >= 8) {
+            const char byte = char(m_buffer >> (m_count - 8));
+            m_out.append(byte);
+            if (uchar(byte) == 0xFF) {
+                m_out.append(char(0));
+            }
+            m_count -= 8;
+        }
+        m_buffer &= (1u << m_count) - 1;
+    }
+
+    // The last byte is padded with one bits
+    void flush()
+    {
+        if (m_count > 0) {
+            put(0x7F, 8 - m_count);
+        }
+    }
+
+private:
+    QByteArray& m_out;
+    quint32 m_buffer = 0;
+    int m_count = 0;
+};
+
+int extend(int value, int size)
+{
+    return value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+}
+
+int magnitudeSize(int value)
+{
+    int magnitude = value < 0 ? -value : value;
+    int size = 0;
+    while (magnitude) {
+        ++size;
+        magnitude >>= 1;
+    }
+    return size;
+}
+
+bool decodeBlock(BitReader& reader, qint16* block, int& prediction, const DecodeTable& dc, const DecodeTable& ac)
+{
+    const int dcSize = reader.decode(dc);
+    if (dcSize < 0 || dcSize > 11) {
+        return false;
+    }
+    prediction += dcSize ? extend(reader.bits(dcSize), dcSize) : 0;
+    block[0] = qint16(prediction);
+
+    for (int k = 1; k < 64;) {
+        const int symbol = reader.decode(ac);
+        if (symbol < 0) {
+            return false;
+        }
+        const int run = symbol >> 4;
+        const int size = symbol & 15;
+        if (size == 0) {
+            if (run != 15) {
+                break;
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63 || size > 10) {
+            return false;
+        }
+        block[ZigZag[k++]] = qint16(extend(reader.bits(size), size));
+    }
+    return true;
+}
+
+void encodeBlock(BitWriter& writer, const qint16* block, int& prediction, const EncodeTable& dc, const EncodeTable& ac)
+{
+    const int difference = block[0] - prediction;
+    prediction = block[0];
+    int size = magnitudeSize(difference);
+    writer.put(dc.code[size], dc.size[size]);
+    if (size) {
+        writer.put(quint32(difference < 0 ? difference - 1 : difference), size);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; ++k) {
+        const int value = block[ZigZag[k]];
+        if (value == 0) {
+            ++run;
+            continue;
+        }
+        while (run > 15) {
+            writer.put(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+        size = magnitudeSize(value);
+        const int symbol = (run << 4) | size;
+        writer.put(ac.code[symbol], ac.size[symbol]);
+        writer.put(quint32(value < 0 ? value - 1 : value), size);
+        run = 0;
+    }
+    if (run > 0) {
+        writer.put(ac.code[0x00], ac.size[0x00]);
+    }
+}
+
+// Calls mcu() before every MCU and block(component, block index) in scan order
+template <typename McuFunction, typename BlockFunction>
+bool forEachBlock(const Jpeg& jpeg, McuFunction mcu, BlockFunction block)
+{
+    if (jpeg.components.size() == 1) {
+        // Single component scans are not interleaved, every block is an MCU of its own
+        const Component& component = jpeg.components.front();
+        for (int i = 0; i < component.blocksWide * component.blocksHigh; ++i) {
+            if (!mcu() || !block(0, i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const int mcusWide = (jpeg.width + jpeg.mcuWidth() - 1) / jpeg.mcuWidth();
+    const int mcusHigh = (jpeg.height + jpeg.mcuHeight() - 1) / jpeg.mcuHeight();
+    for (int my = 0; my < mcusHigh; ++my) {
+        for (int mx = 0; mx < mcusWide; ++mx) {
+            if (!mcu()) {
+                return false;
+            }
+            for (size_t c = 0; c < jpeg.components.size(); ++c) {
+                const Component& component = jpeg.components[c];
+                for (int v = 0; v < component.v; ++v) {
+                    for (int h = 0; h < component.h; ++h) {
+                        const int index = (my * component.v + v) * component.blocksWide + mx * component.h + h;
+                        if (!block(int(c), index)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool parseFrame(const uchar* payload, int size, Jpeg& jpeg)
+{
+    if (!jpeg.components.empty() || size < 6 || payload[0] != 8) {
+        return false;
+    }
+    jpeg.height = (payload[1] << 8) | payload[2];
+    jpeg.width = (payload[3] << 8) | payload[4];
+    const int count = payload[5];
+    if (jpeg.width == 0 || jpeg.height == 0 || count < 1 || count > 4 || size < 6 + count * 3) {
+        return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const uchar* entry = payload + 6 + i * 3;
+        Component component;
+        component.id = entry[0];
+        component.h = entry[1] >> 4;
+        component.v = entry[1] & 15;
+        component.quantTable = entry[2];
+        if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3) {
+            return false;
+        }
+        jpeg.maxH = qMax(jpeg.maxH, component.h);
+        jpeg.maxV = qMax(jpeg.maxV, component.v);
+        jpeg.components.push_back(component);
+    }
+    return true;
+}
+
+bool parseHuffmanTables(const uchar* payload, int size, Jpeg& jpeg)
+{
+    int position = 0;
+    while (position < size) {
+        if (position + 17 > size) {
+            return false;
+        }
+        const int tableClass = payload[position] >> 4;
+        const int index = payload[position] & 15;
+        const uchar* counts = payload + position + 1;
+        int valueCount = 0;
+        for (int i = 0; i < 16; ++i) {
+            valueCount += counts[i];
+        }
+        position += 17;
+        if (tableClass > 1 || index > 3 || valueCount > 256 || position + valueCount > size) {
+            return false;
+        }
+        DecodeTable& table = tableClass == 0 ? jpeg.dcTables[index] : jpeg.acTables[index];
+        if (!buildDecodeTable(counts, payload + position, valueCount, table)) {
+            return false;
+        }
+        position += valueCount;
+    }
+    return true;
+}
+
+bool parseQuantTables(const uchar* payload, int size, Jpeg& jpeg)
+{
+    int position = 0;
+    while (position < size) {
+        const int precision = payload[position] >> 4;
+        const int index = payload[position] & 15;
+        const int valueSize = precision ? 2 : 1;
+        ++position;
+        if (precision > 1 || index > 3 || position + 64 * valueSize > size) {
+            return false;
+        }
+        QuantTable& table = jpeg.quantTables[index];
+        for (int k = 0; k < 64; ++k) {
+            const uchar* value = payload + position + k * valueSize;
+            table.values[ZigZag[k]] = precision ? quint16((value[0] << 8) | value[1]) : value[0];
+        }
+        table.precision = precision;
+        table.defined = true;
+        position += 64 * valueSize;
+    }
+    return true;
+}
+
+bool parseScanHeader(const uchar* payload, int size, Jpeg& jpeg)
+{
+    const int count = size > 0 ? payload[0] : 0;
+    // Only a single scan holding every component is supported, multi-scan files are rare outside progressive
+    if (jpeg.components.empty() || count != int(jpeg.components.size()) || size < 1 + count * 2 + 3) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        Component& component = jpeg.components[i];
+        const uchar* entry = payload + 1 + i * 2;
+        component.dcTable = entry[1] >> 4;
+        component.acTable = entry[1] & 15;
+        if (entry[0] != component.id || component.dcTable > 3 || component.acTable > 3
+            || !jpeg.dcTables[component.dcTable].defined || !jpeg.acTables[component.acTable].defined
+            || !jpeg.quantTables[component.quantTable].defined) {
+            return false;
+        }
+    }
+    const uchar* spectral = payload + 1 + count * 2;
+    return spectral[0] == 0 && spectral[1] == 63 && spectral[2] == 0;
+}
+
+// Reads every marker segment up to the start of the scan
+bool parseHeaders(const uchar* data, int size, Jpeg& jpeg)
+{
+    int position = 2;
+    while (position < size) {
+        if (data[position] != 0xFF) {
+            return false;
+        }
+        while (position < size && data[position] == 0xFF) {
+            ++position;
+        }
+        if (position + 3 > size) {
+            return false;
+        }
+        const uchar marker = data[position++];
+        const int length = (data[position] << 8) | data[position + 1];
+        if (length < 2 || position + length > size) {
+            return false;
+        }
+        const uchar* payload = data + position + 2;
+        const int payloadSize = length - 2;
+        position += length;
+
+        bool ok = true;
+        if (marker == 0xC0 || marker == 0xC1) {
+            jpeg.frameMarker = marker;
+            ok = parseFrame(payload, payloadSize, jpeg);
+        } else if (marker == 0xC4) {
+            ok = parseHuffmanTables(payload, payloadSize, jpeg);
+        } else if (marker == 0xDB) {
+            ok = parseQuantTables(payload, payloadSize, jpeg);
+        } else if (marker == 0xDD) {
+            ok = payloadSize >= 2;
+            jpeg.restartInterval = ok ? (payload[0] << 8) | payload[1] : 0;
+        } else if ((marker >= 0xE0 && marker <= 0xEF) || marker == 0xFE) {
+            // The MPF index points at images appended after EOI, which are not carried over
+            const bool multiPicture = marker == 0xE2 && payloadSize >= 4 && std::memcmp(payload, "MPF\0", 4) == 0;
+            if (!multiPicture) {
+                Segment segment;
+                segment.marker = marker;
+                segment.offset = int(payload - data);
+                segment.payload = QByteArray(reinterpret_cast<const char*>(payload), payloadSize);
+                jpeg.metadata.push_back(segment);
+            }
+        } else if (marker == 0xDA) {
+            jpeg.scanStart = position;
+            return parseScanHeader(payload, payloadSize, jpeg);
+        } else {
+            // Progressive, lossless, arithmetic coded or hierarchical
+            ok = false;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool decodeScan(const uchar* data, int size, Jpeg& jpeg)
+{
+    TRACE_SCOPE("export", "decode coefficients");
+    for (Component& component : jpeg.components) {
+        if (jpeg.components.size() == 1) {
+            component.blocksWide = (jpeg.width + 7) / 8;
+            component.blocksHigh = (jpeg.height + 7) / 8;
+        } else {
+            component.blocksWide = (jpeg.width + jpeg.mcuWidth() - 1) / jpeg.mcuWidth() * component.h;
+            component.blocksHigh = (jpeg.height + jpeg.mcuHeight() - 1) / jpeg.mcuHeight() * component.v;
+        }
+    }
+
+    qint64 bytes = 0;
+    for (const Component& component : jpeg.components) {
+        bytes += qint64(component.blocksWide) * component.blocksHigh * 64 * sizeof(qint16);
+    }
+    if (bytes > MaxCoefficientBytes) {
+        return false;
+    }
+    for (Component& component : jpeg.components) {
+        component.blocks.assign(size_t(component.blocksWide) * component.blocksHigh * 64, 0);
+    }
+
+    BitReader reader(data, size, jpeg.scanStart);
+    int predictions[4] = { 0, 0, 0, 0 };
+    int untilRestart = jpeg.restartInterval;
+    bool first = true;
+
+    const bool decoded = forEachBlock(jpeg, [&]() {
+        if (jpeg.restartInterval > 0 && !first && untilRestart == 0) {
+            if (reader.exhausted() || !reader.restart()) {
+                return false;
+            }
+            std::memset(predictions, 0, sizeof(predictions));
+            untilRestart = jpeg.restartInterval;
+        }
+        first = false;
+        --untilRestart;
+        return true;
+    }, [&](int c, int index) {
+        Component& component = jpeg.components[c];
+        return decodeBlock(reader, component.blocks.data() + size_t(index) * 64, predictions[c],
+                           jpeg.dcTables[component.dcTable], jpeg.acTables[component.acTable]);
+    });
+
+    // Anything but EOI after the scan (more scans, DNL) is not supported
+    return decoded && !reader.exhausted() && reader.nextMarker() == 0xD9;
+}
+
+// Source coefficient and sign of every output coefficient, for one block
+struct BlockMapping
+{
+    int source[64];
+    bool negate[64];
+};
+
+// A quarter turn clockwise is a transpose followed by a horizontal flip. Transposing a block
+// transposes its coefficients, flipping it negates the coefficients of odd frequency along that axis.
+BlockMapping blockMapping(int turns)
+{
+    BlockMapping mapping;
+    for (int row = 0; row < 8; ++row) {
+        for (int column = 0; column < 8; ++column) {
+            const int index = row * 8 + column;
+            switch (turns) {
+            case 1:
+                mapping.source[index] = column * 8 + row;
+                mapping.negate[index] = column & 1;
+                break;
+            case 2:
+                mapping.source[index] = index;
+                mapping.negate[index] = (row + column) & 1;
+                break;
+            case 3:
+                mapping.source[index] = column * 8 + row;
+                mapping.negate[index] = row & 1;
+                break;
+            default:
+                mapping.source[index] = index;
+                mapping.negate[index] = false;
+                break;
+            }
+        }
+    }
+    return mapping;
+}
+
+Component rotateComponent(const Component& source, int turns)
+{
+    const bool transposed = turns % 2 == 1;
+    Component result = source;
+    result.blocks.clear();
+    if (transposed) {
+        std::swap(result.h, result.v);
+        std::swap(result.blocksWide, result.blocksHigh);
+    }
+    result.blocks.resize(source.blocks.size());
+
+    const BlockMapping mapping = blockMapping(turns);
+    for (int y = 0; y < result.blocksHigh; ++y) {
+        for (int x = 0; x < result.blocksWide; ++x) {
+            int sourceX = x;
+            int sourceY = y;
+            if (turns == 1) {
+                sourceX = y;
+                sourceY = source.blocksHigh - 1 - x;
+            } else if (turns == 2) {
+                sourceX = source.blocksWide - 1 - x;
+                sourceY = source.blocksHigh - 1 - y;
+            } else if (turns == 3) {
+                sourceX = source.blocksWide - 1 - y;
+                sourceY = x;
+            }
+
+            const qint16* in = source.blocks.data() + (size_t(sourceY) * source.blocksWide + sourceX) * 64;
+            qint16* out = result.blocks.data() + (size_t(y) * result.blocksWide + x) * 64;
+            for (int i = 0; i < 64; ++i) {
+                const qint16 value = in[mapping.source[i]];
+                out[i] = mapping.negate[i] ? qint16(-value) : value;
+            }
+        }
+    }
+    return result;
+}
+
+// Offset of a tag's entry in an APP1 Exif payload, looked up in IFD0 and the Exif IFD
+int exifEntry(const QByteArray& payload, quint16 tag, bool* bigEndian)
+{
+    const int base = 6;
+    if (payload.size() < base + 8 || std::memcmp(payload.constData(), "Exif\0\0", 6) != 0) {
+        return -1;
+    }
+    const uchar* tiff = reinterpret_cast<const uchar*>(payload.constData()) + base;
+    const qint64 size = payload.size() - base;
+    if (tiff[0] != tiff[1] || (tiff[0] != 'M' && tiff[0] != 'I')) {
+        return -1;
+    }
+    *bigEndian = tiff[0] == 'M';
+
+    auto read = [&](qint64 offset, int bytes) {
+        quint32 value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            const quint32 byte = tiff[offset + i];
+            value |= *bigEndian ? byte << ((bytes - 1 - i) * 8) : byte << (i * 8);
+        }
+        return value;
+    };
+
+    qint64 directory = read(4, 4);
+    for (int depth = 0; depth < 2 && directory > 0; ++depth) {
+        if (directory + 2 > size) {
+            return -1;
+        }
+        const int count = int(read(directory, 2));
+        qint64 next = 0;
+        for (int i = 0; i < count; ++i) {
+            const qint64 entry = directory + 2 + i * 12;
+            if (entry + 12 > size) {
+                return -1;
+            }
+            const quint32 entryTag = read(entry, 2);
+            if (entryTag == tag) {
+                return int(base + entry);
+            }
+            if (entryTag == 0x8769) {
+                next = read(entry + 8, 4);
+            }
+        }
+        directory = next;
+    }
+    return -1;
+}
+
+// Value of a SHORT or LONG entry, -1 for other types
+qint64 exifValue(const QByteArray& payload, int entry, bool bigEndian)
+{
+    const uchar* data = reinterpret_cast<const uchar*>(payload.constData()) + entry;
+    const int type = bigEndian ? (data[2] << 8) | data[3] : (data[3] << 8) | data[2];
+    const int bytes = type == 3 ? 2 : type == 4 ? 4 : 0;
+    if (bytes == 0) {
+        return -1;
+    }
+    quint32 value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        const quint32 byte = data[8 + i];
+        value |= bigEndian ? byte << ((bytes - 1 - i) * 8) : byte << (i * 8);
+    }
+    return value;
+}
+
+void setExifValue(QByteArray& payload, int entry, bool bigEndian, quint32 value)
+{
+    uchar* data = reinterpret_cast<uchar*>(payload.data()) + entry;
+    const int type = bigEndian ? (data[2] << 8) | data[3] : (data[3] << 8) | data[2];
+    const int bytes = type == 3 ? 2 : type == 4 ? 4 : 0;
+    for (int i = 0; i < bytes; ++i) {
+        data[8 + i] = uchar(bigEndian ? value >> ((bytes - 1 - i) * 8) : value >> (i * 8));
+    }
+}
+
+// Clockwise quarter turns of the EXIF orientation, -1 for the mirrored ones
+int orientationTurns(qint64 orientation)
+{
+    switch (orientation) {
+    case 1:
+        return 0;
+    case 6:
+        return 1;
+    case 3:
+        return 2;
+    case 8:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+void appendMarker(QByteArray& out, uchar marker)
+{
+    out.append(char(0xFF));
+    out.append(char(marker));
+}
+
+void appendSegment(QByteArray& out, uchar marker, const QByteArray& payload)
+{
+    appendMarker(out, marker);
+    out.append(char((payload.size() + 2) >> 8));
+    out.append(char((payload.size() + 2) & 0xff));
+    out.append(payload);
+}
+
+void appendHuffmanTable(QByteArray& payload, int tableClass, int index, const uchar* counts, const uchar* values, int valueCount)
+{
+    payload.append(char((tableClass << 4) | index));
+    payload.append(reinterpret_cast<const char*>(counts), 16);
+    payload.append(reinterpret_cast<const char*>(values), valueCount);
+}
+
+QByteArray encode(const Jpeg& jpeg)
+{
+    TRACE_SCOPE("export", "encode coefficients");
+    QByteArray out;
+    appendMarker(out, 0xD8);
+
+    for (const Segment& segment : jpeg.metadata) {
+        appendSegment(out, segment.marker, segment.payload);
+    }
+
+    QByteArray quant;
+    for (int i = 0; i < 4; ++i) {
+        const QuantTable& table = jpeg.quantTables[i];
+        if (!table.defined) {
+            continue;
+        }
+        quant.append(char((table.precision << 4) | i));
+        for (int k = 0; k < 64; ++k) {
+            const quint16 value = table.values[ZigZag[k]];
+            if (table.precision) {
+                quant.append(char(value >> 8));
+            }
+            quant.append(char(value & 0xff));
+        }
+    }
+    appendSegment(out, 0xDB, quant);
+
+    QByteArray frame;
+    frame.append(char(8));
+    frame.append(char(jpeg.height >> 8));
+    frame.append(char(jpeg.height & 0xff));
+    frame.append(char(jpeg.width >> 8));
+    frame.append(char(jpeg.width & 0xff));
+    frame.append(char(jpeg.components.size()));
+    for (const Component& component : jpeg.components) {
+        frame.append(char(component.id));
+        frame.append(char((component.h << 4) | component.v));
+        frame.append(char(component.quantTable));
+    }
+    appendSegment(out, jpeg.frameMarker, frame);
+
+    // Table 0 codes the first component, table 1 all others
+    const bool chroma = jpeg.components.size() > 1;
+    QByteArray huffman;
+    appendHuffmanTable(huffman, 0, 0, DcLuminanceCounts, DcValues, 12);
+    appendHuffmanTable(huffman, 1, 0, AcLuminanceCounts, AcLuminanceValues, 162);
+    if (chroma) {
+        appendHuffmanTable(huffman, 0, 1, DcChrominanceCounts, DcValues, 12);
+        appendHuffmanTable(huffman, 1, 1, AcChrominanceCounts, AcChrominanceValues, 162);
+    }
+    appendSegment(out, 0xC4, huffman);
+
+    QByteArray scan;
+    scan.append(char(jpeg.components.size()));
+    for (size_t c = 0; c < jpeg.components.size(); ++c) {
+        scan.append(char(jpeg.components[c].id));
+        scan.append(char(c == 0 ? 0x00 : 0x11));
+    }
+    scan.append(char(0));
+    scan.append(char(63));
+    scan.append(char(0));
+    appendSegment(out, 0xDA, scan);
+
+    EncodeTable dcTables[2];
+    EncodeTable acTables[2];
+    buildEncodeTable(DcLuminanceCounts, DcValues, dcTables[0]);
+    buildEncodeTable(AcLuminanceCounts, AcLuminanceValues, acTables[0]);
+    buildEncodeTable(DcChrominanceCounts, DcValues, dcTables[1]);
+    buildEncodeTable(AcChrominanceCounts, AcChrominanceValues, acTables[1]);
+
+    BitWriter writer(out);
+    int predictions[4] = { 0, 0, 0, 0 };
+    forEachBlock(jpeg, []() { return true; }, [&](int c, int index) {
+        const int table = c == 0 ? 0 : 1;
+        encodeBlock(writer, jpeg.components[c].blocks.data() + size_t(index) * 64, predictions[c],
+                    dcTables[table], acTables[table]);
+        return true;
+    });
+    writer.flush();
+
+    appendMarker(out, 0xD9);
+    return out;
+}
+}
+
+bool JpegTransform::isJpeg(const QByteArray& data)
+{
+    return data.size() > 3 && uchar(data[0]) == 0xFF && uchar(data[1]) == 0xD8 && uchar(data[2]) == 0xFF;
+}
+
+QByteArray JpegTransform::rotate(const QByteArray& data, int quarterTurns, QSize* size)
+{
+    TRACE_SCOPE("export", "lossless jpeg rotate");
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    Jpeg jpeg;
+    if (!isJpeg(data) || !parseHeaders(bytes, int(data.size()), jpeg)) {
+        return QByteArray();
+    }
+
+    // The orientation tag is folded into the rotation, the result is stored upright
+    struct ExifTag
+    {
+        size_t segment;
+        int entry;
+        bool bigEndian;
+    };
+    std::vector<ExifTag> orientationTags;
+    int turns = quarterTurns;
+    for (size_t i = 0; i < jpeg.metadata.size(); ++i) {
+        bool bigEndian = false;
+        const int entry = jpeg.metadata[i].marker == 0xE1 ? exifEntry(jpeg.metadata[i].payload, 0x0112, &bigEndian) : -1;
+        if (entry < 0) {
+            continue;
+        }
+        const int orientationTurn = orientationTurns(exifValue(jpeg.metadata[i].payload, entry, bigEndian));
+        if (orientationTurn < 0) {
+            return QByteArray();
+        }
+        turns += orientationTurn;
+        orientationTags.push_back({ i, entry, bigEndian });
+    }
+    turns = ((turns % 4) + 4) % 4;
+
+    const bool transposed = turns % 2 == 1;
+    if (size) {
+        *size = transposed ? QSize(jpeg.height, jpeg.width) : QSize(jpeg.width, jpeg.height);
+    }
+
+    // Upright already, only the orientation tag changes
+    if (turns == 0) {
+        QByteArray result = data;
+        for (const ExifTag& tag : orientationTags) {
+            QByteArray& payload = jpeg.metadata[tag.segment].payload;
+            setExifValue(payload, tag.entry, tag.bigEndian, 1);
+            std::memcpy(result.data() + jpeg.metadata[tag.segment].offset, payload.constData(), payload.size());
+        }
+        return result;
+    }
+
+    // Partial blocks at the right and bottom edges are padding, they must stay at those edges.
+    // jpegtran calls this a perfect transform, it would otherwise trim them away.
+    const bool widthAligned = jpeg.width % jpeg.mcuWidth() == 0;
+    const bool heightAligned = jpeg.height % jpeg.mcuHeight() == 0;
+    if ((turns == 1 && !heightAligned) || (turns == 2 && !(widthAligned && heightAligned)) || (turns == 3 && !widthAligned)) {
+        qDebug() << "JPEG size" << jpeg.width << "x" << jpeg.height << "is not MCU aligned for a lossless rotation";
+        return QByteArray();
+    }
+
+    if (!decodeScan(bytes, int(data.size()), jpeg)) {
+        qDebug() << "JPEG coding not supported for a lossless rotation";
+        return QByteArray();
+    }
+
+    for (Component& component : jpeg.components) {
+        component = rotateComponent(component, turns);
+    }
+    if (transposed) {
+        std::swap(jpeg.width, jpeg.height);
+        std::swap(jpeg.maxH, jpeg.maxV);
+        for (QuantTable& table : jpeg.quantTables) {
+            const QuantTable source = table;
+            for (int i = 0; i < 64; ++i) {
+                table.values[i] = source.values[(i % 8) * 8 + i / 8];
+            }
+        }
+    }
+
+    for (const ExifTag& tag : orientationTags) {
+        setExifValue(jpeg.metadata[tag.segment].payload, tag.entry, tag.bigEndian, 1);
+    }
+    // Keep the pixel dimensions recorded in the Exif IFD in step with the frame
+    for (Segment& segment : jpeg.metadata) {
+        bool bigEndian = false;
+        if (segment.marker != 0xE1) {
+            continue;
+        }
+        const int widthEntry = exifEntry(segment.payload, 0xA002, &bigEndian);
+        const int heightEntry = exifEntry(segment.payload, 0xA003, &bigEndian);
+        if (!transposed || widthEntry < 0 || heightEntry < 0) {
+            continue;
+        }
+        const qint64 width = exifValue(segment.payload, widthEntry, bigEndian);
+        const qint64 height = exifValue(segment.payload, heightEntry, bigEndian);
+        if (width >= 0 && height >= 0) {
+            setExifValue(segment.payload, widthEntry, bigEndian, quint32(height));
+            setExifValue(segment.payload, heightEntry, bigEndian, quint32(width));
+        }
+    }
+
+    return encode(jpeg);
+}
@@ -0,0 +1,328 @@
+#include "layerindex.h"
+#include "layermodel.h"
+#include "tracer.h"
+#include <QMetaProperty>
+#include <QSet>
+#include <QTransform>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace {
+// Scene units per grid cell, a few cells per typical text layer
+const qreal CellSize = 128;
+
+// Anything that moves the outline of a layer
+const char* const GeometryProperties[] = {
+    "x", "y", "width", "height", "rotation", "textRotation", "imageRotation"
+};
+
+// Layers rotate their content around the center, the item itself stays axis aligned
+const char* const RotationProperties[] = {
+    "textRotation", "imageRotation"
+};
+
+quint64 cellKey(int x, int y)
+{
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+// Left or top, center, right or bottom
+std::array<qreal, 3> lines(const QRectF& rect, Qt::Orientation orientation)
+{
+    if (orientation == Qt::Horizontal) {
+        return { rect.left(), rect.center().x(), rect.right() };
+    }
+    return { rect.top(), rect.center().y(), rect.bottom() };
+}
+}
+
+// Static instance
+LayerIndex* LayerIndex::m_instance = nullptr;
+
+LayerIndex::LayerIndex(QObject *parent)
+    : QObject(parent)
+{
+    LayerModel* model = LayerModel::instance();
+    for (int row = 0; row < model->count(); ++row) {
+        insert(model->itemAt(row));
+    }
+
+    // Only layers in the list are indexed, removed ones kept for undo come back through an insert
+    connect(model, &QAbstractItemModel::rowsInserted, this, [this, model](const QModelIndex&, int first, int last) {
+        for (int row = first; row <= last; ++row) {
+            insert(model->itemAt(row));
+        }
+    });
+    connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this, model](const QModelIndex&, int first, int last) {
+        for (int row = first; row <= last; ++row) {
+            remove(model->itemAt(row));
+        }
+    });
+}
+
+LayerIndex* LayerIndex::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+LayerIndex* LayerIndex::instance()
+{
+    if (!m_instance) {
+        m_instance = new LayerIndex();
+    }
+    return m_instance;
+}
+
+QQuickItem* LayerIndex::layerAt(qreal x, qreal y, QQuickItem* below) const
+{
+    const QPointF point(x, y);
+    const QList<QQuickItem*> candidates = m_cells.value(cellKey(int(std::floor(x / CellSize)), int(std::floor(y / CellSize))));
+
+    QList<QQuickItem*> hits;
+    for (QQuickItem* item : candidates) {
+        if (m_entries.constFind(item)->outline.containsPoint(point, Qt::OddEvenFill)) {
+            hits.append(item);
+        }
+    }
+    if (hits.isEmpty()) {
+        return nullptr;
+    }
+
+    // Same order as the layer list, topmost first
+    std::sort(hits.begin(), hits.end(), [](QQuickItem* a, QQuickItem* b) {
+        return a->z() > b->z();
+    });
+
+    const qsizetype current = below ? hits.indexOf(below) : -1;
+    return hits.at(current < 0 ? 0 : (current + 1) % hits.size());
+}
+
+QVariantMap LayerIndex::snap(QQuickItem* item, qreal x, qreal y, qreal threshold) const
+{
+    TRACE_SCOPE("layers", "snap");
+    QVariantMap result;
+    result["x"] = x;
+    result["y"] = y;
+    result["guides"] = QVariantList();
+    if (!item) {
+        return result;
+    }
+
+    const QRectF canvas = item->parentItem() ? QRectF(QPointF(0, 0), item->parentItem()->size()) : QRectF();
+    const auto entry = m_entries.constFind(item);
+    const QRectF current = entry != m_entries.cend() ? entry->bounds : outlineOf(item).boundingRect();
+    QRectF bounds = current.translated(x - item->x(), y - item->y());
+
+    QVariantList guides;
+    for (Qt::Orientation orientation : { Qt::Horizontal, Qt::Vertical }) {
+        const bool horizontal = orientation == Qt::Horizontal;
+        const std::array<qreal, 3> edges = lines(bounds, orientation);
+
+        // Snap lines of the canvas, then of every layer crossing the bands around the dragged edges
+        QList<qreal> targets;
+        if (!canvas.isEmpty()) {
+            for (qreal line : lines(canvas, orientation)) {
+                targets.append(line);
+            }
+        }
+
+        const QRectF area = canvas.united(bounds);
+        QSet<QQuickItem*> seen;
+        for (qreal edge : edges) {
+            const QRectF band = horizontal ? QRectF(edge - threshold, area.top(), 2 * threshold, area.height())
+                                           : QRectF(area.left(), edge - threshold, area.width(), 2 * threshold);
+            for (QQuickItem* other : layersIn(cellsFor(band))) {
+                if (other == item || seen.contains(other)) {
+                    continue;
+                }
+                seen.insert(other);
+                for (qreal line : lines(m_entries.value(other).bounds, orientation)) {
+                    targets.append(line);
+                }
+            }
+        }
+
+        qreal best = std::numeric_limits<qreal>::max();
+        for (qreal edge : edges) {
+            for (qreal target : std::as_const(targets)) {
+                const qreal offset = target - edge;
+                if (std::abs(offset) <= threshold && std::abs(offset) < std::abs(best)) {
+                    best = offset;
+                }
+            }
+        }
+        if (best == std::numeric_limits<qreal>::max()) {
+            continue;
+        }
+
+        bounds.translate(horizontal ? best : 0, horizontal ? 0 : best);
+        result[horizontal ? "x" : "y"] = (horizontal ? x : y) + best;
+
+        // One guide per line the snapped box now touches
+        QList<qreal> shown;
+        for (qreal edge : lines(bounds, orientation)) {
+            for (qreal target : std::as_const(targets)) {
+                if (std::abs(target - edge) < 0.5 && !shown.contains(target)) {
+                    shown.append(target);
+                    QVariantMap guide;
+                    guide["vertical"] = horizontal;
+                    guide["position"] = target;
+                    guides.append(guide);
+                }
+            }
+        }
+    }
+
+    result["guides"] = guides;
+    return result;
+}
+
+void LayerIndex::insert(QQuickItem* item)
+{
+    if (!item || m_entries.contains(item)) {
+        return;
+    }
+
+    m_entries.insert(item, Entry());
+    update(item);
+
+    const QMetaMethod refresh = metaObject()->method(metaObject()->indexOfSlot("layerGeometryChanged()"));
+    const QMetaObject* itemMeta = item->metaObject();
+    for (const char* name : GeometryProperties) {
+        int propertyIndex = itemMeta->indexOfProperty(name);
+        if (propertyIndex < 0) {
+            continue;
+        }
+        QMetaMethod notify = itemMeta->property(propertyIndex).notifySignal();
+        if (notify.isValid()) {
+            connect(item, notify, this, refresh);
+        }
+    }
+}
+
+void LayerIndex::remove(QQuickItem* item)
+{
+    auto it = m_entries.find(item);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    // Also called while the item is being destroyed, only its address is used here
+    disconnect(item, nullptr, this, nullptr);
+    removeFromCells(item, it->cells);
+    m_entries.erase(it);
+}
+
+void LayerIndex::update(QQuickItem* item)
+{
+    Entry& entry = m_entries[item];
+    entry.outline = outlineOf(item);
+    entry.bounds = entry.outline.boundingRect();
+
+    // Most moves stay within the same cells, the grid is only touched when they change
+    const QRect cells = cellsFor(entry.bounds);
+    if (cells != entry.cells) {
+        removeFromCells(item, entry.cells);
+        addToCells(item, cells);
+        entry.cells = cells;
+    }
+}
+
+void LayerIndex::addToCells(QQuickItem* item, const QRect& cells)
+{
+    if (cells.isEmpty()) {
+        return;
+    }
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            m_cells[cellKey(x, y)].append(item);
+        }
+    }
+}
+
+void LayerIndex::removeFromCells(QQuickItem* item, const QRect& cells)
+{
+    if (cells.isEmpty()) {
+        return;
+    }
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            auto it = m_cells.find(cellKey(x, y));
+            if (it == m_cells.end()) {
+                continue;
+            }
+            it->removeOne(item);
+            if (it->isEmpty()) {
+                m_cells.erase(it);
+            }
+        }
+    }
+}
+
+QList<QQuickItem*> LayerIndex::layersIn(const QRect& cells) const
+{
+    QList<QQuickItem*> layers;
+    QSet<QQuickItem*> seen;
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            const auto it = m_cells.constFind(cellKey(x, y));
+            if (it == m_cells.cend()) {
+                continue;
+            }
+            for (QQuickItem* item : *it) {
+                if (!seen.contains(item)) {
+                    seen.insert(item);
+                    layers.append(item);
+                }
+            }
+        }
+    }
+    return layers;
+}
+
+QPolygonF LayerIndex::outlineOf(QQuickItem* item)
+{
+    const QRectF rect(item->x(), item->y(), item->width(), item->height());
+
+    qreal angle = item->rotation();
+    for (const char* name : RotationProperties) {
+        const QVariant value = item->property(name);
+        if (value.isValid()) {
+            angle += value.toReal();
+            break;
+        }
+    }
+
+    if (angle == 0) {
+        return QPolygonF(rect);
+    }
+    const QPointF center = rect.center();
+    QTransform transform;
+    transform.translate(center.x(), center.y());
+    transform.rotate(angle);
+    transform.translate(-center.x(), -center.y());
+    return transform.map(QPolygonF(rect));
+}
+
+QRect LayerIndex::cellsFor(const QRectF& bounds)
+{
+    if (bounds.isNull()) {
+        return QRect();
+    }
+    return QRect(QPoint(int(std::floor(bounds.left() / CellSize)), int(std::floor(bounds.top() / CellSize))),
+                 QPoint(int(std::floor(bounds.right() / CellSize)), int(std::floor(bounds.bottom() / CellSize))));
+}
+
+void LayerIndex::layerGeometryChanged()
+{
+    QQuickItem* item = qobject_cast<QQuickItem*>(sender());
+    if (item && m_entries.contains(item)) {
+        update(item);
+    }
+}
@@ -0,0 +1,332 @@
+#include "layermodel.h"
+#include <QMetaProperty>
+#include <QUrl>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+// Properties shown in the layer list, rows refresh when any of them changes
+const char* const WatchedProperties[] = {
+    "textContent", "fontFamily", "fontSize", "source", "width", "height", "z"
+};
+
+const int PreviewLength = 20;
+}
+
+// Static instance
+LayerModel* LayerModel::m_instance = nullptr;
+
+LayerModel::LayerModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_selected(nullptr)
+    , m_nextId(1)
+    , m_topZ(0)
+{
+}
+
+LayerModel* LayerModel::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    // The exporter reads the layer order from C++ as well
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+LayerModel* LayerModel::instance()
+{
+    if (!m_instance) {
+        m_instance = new LayerModel();
+    }
+    return m_instance;
+}
+
+int LayerModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : int(m_layers.size());
+}
+
+QVariant LayerModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_layers.size()) {
+        return QVariant();
+    }
+
+    const Layer& layer = m_layers.at(index.row());
+    QQuickItem* item = layer.item;
+
+    switch (role) {
+    case ItemRole:
+        return QVariant::fromValue(item);
+    case LayerIdRole:
+        return layer.id;
+    case TypeRole:
+        return layer.type == Text ? QStringLiteral("Text") : QStringLiteral("Image");
+    case PreviewRole: {
+        QString preview;
+        if (layer.type == Text) {
+            preview = item->property("textContent").toString();
+        } else {
+#ifdef Q_OS_WASM
+            preview = QStringLiteral("Imported image");
+#else
+            preview = item->property("source").toUrl().fileName();
+#endif
+        }
+        if (preview.size() > PreviewLength) {
+            preview = preview.left(PreviewLength) + "...";
+        }
+        return preview.isEmpty() ? QStringLiteral("Empty") : preview;
+    }
+    case DetailsRole:
+        if (layer.type == Text) {
+            return QString("%1 %2pt").arg(item->property("fontFamily").toString())
+                                     .arg(item->property("fontSize").toInt());
+        }
+        return QString("%1×%2").arg(qRound(item->width())).arg(qRound(item->height()));
+    case LayerRole:
+        return item->z();
+    case SelectedRole:
+        return item == m_selected;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LayerModel::roleNames() const
+{
+    return {
+        { ItemRole, "item" },
+        { LayerIdRole, "layerId" },
+        { TypeRole, "type" },
+        { PreviewRole, "preview" },
+        { DetailsRole, "details" },
+        { LayerRole, "layer" },
+        { SelectedRole, "isSelected" }
+    };
+}
+
+QList<LayerModel::Layer> LayerModel::layersBottomToTop() const
+{
+    QList<Layer> layers;
+    layers.reserve(m_layers.size());
+    for (auto it = m_layers.crbegin(); it != m_layers.crend(); ++it) {
+        layers.append(*it);
+    }
+    return layers;
+}
+
+int LayerModel::add(QQuickItem* item, LayerModel::LayerType type)
+{
+    if (!item) {
+        return 0;
+    }
+    if (m_known.contains(item)) {
+        restore(item);
+        return m_known.value(item).id;
+    }
+
+    Layer layer;
+    layer.item = item;
+    layer.id = m_nextId++;
+    layer.type = type;
+
+    // z only ever grows for new layers, swaps exchange existing values
+    m_topZ += 1;
+    item->setZ(m_topZ);
+
+    m_known.insert(item, layer);
+    m_ids.insert(layer.id, item);
+    watch(item);
+
+    insertRow(0, layer);
+    return layer.id;
+}
+
+void LayerModel::restore(QQuickItem* item)
+{
+    if (!item || m_rows.contains(item) || !m_known.contains(item)) {
+        return;
+    }
+
+    // Rows are sorted by z, highest first
+    const qreal z = item->z();
+    auto it = std::lower_bound(m_layers.cbegin(), m_layers.cend(), z, [](const Layer& layer, qreal value) {
+        return layer.item->z() > value;
+    });
+    insertRow(int(it - m_layers.cbegin()), m_known.value(item));
+}
+
+void LayerModel::remove(QQuickItem* item)
+{
+    int row = indexOf(item);
+    if (row < 0) {
+        return;
+    }
+
+    if (item == m_selected) {
+        clearSelection();
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    m_layers.removeAt(row);
+    m_rows.remove(item);
+    reindex(row);
+    endRemoveRows();
+
+    emit countChanged();
+}
+
+void LayerModel::insertRow(int row, const Layer& layer)
+{
+    beginInsertRows(QModelIndex(), row, row);
+    m_layers.insert(row, layer);
+    reindex(row);
+    endInsertRows();
+
+    emit countChanged();
+}
+
+void LayerModel::reindex(int from)
+{
+    for (int row = from; row < m_layers.size(); ++row) {
+        m_rows.insert(m_layers.at(row).item, row);
+    }
+}
+
+void LayerModel::select(QQuickItem* item)
+{
+    if (item == m_selected) {
+        return;
+    }
+
+    QQuickItem* previous = m_selected;
+    m_selected = item;
+
+    // Only the two rows involved change, no need to touch the rest of the list
+    setItemSelected(previous, false);
+    setItemSelected(item, true);
+
+    emit selectedItemChanged();
+}
+
+void LayerModel::clearSelection()
+{
+    select(nullptr);
+}
+
+void LayerModel::setItemSelected(QQuickItem* item, bool selected)
+{
+    if (!item) {
+        return;
+    }
+
+    item->setProperty("selected", selected);
+
+    int row = indexOf(item);
+    if (row >= 0) {
+        QModelIndex modelIndex = index(row);
+        emit dataChanged(modelIndex, modelIndex, { SelectedRole });
+    }
+}
+
+bool LayerModel::shift(QQuickItem* item, int offset)
+{
+    int row = indexOf(item);
+    int other = row + offset;
+    if (row < 0 || offset == 0 || other < 0 || other >= m_layers.size()) {
+        return false;
+    }
+
+    // Only adjacent swaps keep the z values of every other layer untouched
+    if (qAbs(offset) != 1) {
+        qWarning() << "LayerModel::shift only moves by one row";
+        return false;
+    }
+
+    QQuickItem* otherItem = m_layers.at(other).item;
+    qreal z = item->z();
+    item->setZ(otherItem->z());
+    otherItem->setZ(z);
+
+    // Qt expects the destination as the row the item ends up before
+    beginMoveRows(QModelIndex(), row, row, QModelIndex(), offset > 0 ? other + 1 : other);
+    m_layers.swapItemsAt(row, other);
+    m_rows.insert(item, other);
+    m_rows.insert(otherItem, row);
+    endMoveRows();
+
+    return true;
+}
+
+int LayerModel::indexOf(QQuickItem* item) const
+{
+    return m_rows.value(item, -1);
+}
+
+QQuickItem* LayerModel::itemAt(int row) const
+{
+    return row >= 0 && row < m_layers.size() ? m_layers.at(row).item : nullptr;
+}
+
+int LayerModel::layerId(QQuickItem* item) const
+{
+    return m_known.value(item).id;
+}
+
+QQuickItem* LayerModel::itemForId(int id) const
+{
+    return m_ids.value(id);
+}
+
+void LayerModel::watch(QQuickItem* item)
+{
+    connect(item, &QObject::destroyed, this, [this, item]() {
+        forget(item);
+    });
+
+    // QML declared properties have their own notify signals, look them up once per layer
+    const QMetaMethod refresh = metaObject()->method(metaObject()->indexOfSlot("layerPropertyChanged()"));
+    const QMetaObject* itemMeta = item->metaObject();
+    for (const char* name : WatchedProperties) {
+        int propertyIndex = itemMeta->indexOfProperty(name);
+        if (propertyIndex < 0) {
+            continue;
+        }
+        QMetaMethod notify = itemMeta->property(propertyIndex).notifySignal();
+        if (notify.isValid()) {
+            connect(item, notify, this, refresh);
+        }
+    }
+}
+
+void LayerModel::forget(QQuickItem* item)
+{
+    // The item is being destroyed, only its address is used here
+    int row = m_rows.value(item, -1);
+    if (row >= 0) {
+        beginRemoveRows(QModelIndex(), row, row);
+        m_layers.removeAt(row);
+        m_rows.remove(item);
+        reindex(row);
+        endRemoveRows();
+        emit countChanged();
+    }
+
+    m_ids.remove(m_known.value(item).id);
+    m_known.remove(item);
+
+    if (item == m_selected) {
+        m_selected = nullptr;
+        emit selectedItemChanged();
+    }
+}
+
+void LayerModel::layerPropertyChanged()
+{
+    int row = indexOf(qobject_cast<QQuickItem*>(sender()));
+    if (row >= 0) {
+        QModelIndex modelIndex = index(row);
+        emit dataChanged(modelIndex, modelIndex, { PreviewRole, DetailsRole, LayerRole });
+    }
+}
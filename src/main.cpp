@@ -1,13 +1,35 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QQuickWindow>
 #include <QSettings>
 #include <QFontDatabase>
+#include "imagestore.h"
+#include "imagecache.h"
+#include "fontcache.h"
+#include "fontpreview.h"
+#include "batchrenderer.h"
+#include "jobscheduler.h"
+#include "tracer.h"
+
+#ifdef Q_OS_WASM
+#include <emscripten.h>
+#endif
 
 int main(int argc, char *argv[])
 {
     qputenv("QT_QUICK_CONTROLS_MATERIAL_VARIANT", "Dense");
 
+#ifndef Q_OS_WASM
+    // Batch rendering never shows a window, it also runs on machines without a display
+    const bool batch = BatchRenderer::isBatchInvocation(argc, argv);
+    if (batch && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+#endif
+
     QGuiApplication app(argc, argv);
+    // Created before any decoding starts, on the thread its results are delivered to
+    JobScheduler::instance();
 
     qint32 fontId = QFontDatabase::addApplicationFont(":/fonts/Roboto-Regular.ttf");
     QStringList fontList = QFontDatabase::applicationFontFamilies(fontId);
@@ -19,9 +41,18 @@ int main(int argc, char *argv[])
 
 #ifdef Q_OS_WASM
     QSettings::setDefaultFormat(QSettings::WebLocalStorageFormat);
+    // Restoring stored fonts from IndexedDB is asynchronous, start it before QML asks for them
+    FontCache::instance();
+#else
+    if (batch) {
+        return BatchRenderer::run(app.arguments());
+    }
 #endif
 
     QQmlApplicationEngine engine;
+    engine.addImageProvider("uploads", new UploadImageProvider);
+    engine.addImageProvider("cache", new CachedImageProvider);
+    engine.addImageProvider("fontpreview", new FontPreviewProvider);
     QObject::connect(
         &engine,
         &QQmlApplicationEngine::objectCreationFailed,
@@ -30,5 +61,24 @@ int main(int argc, char *argv[])
         Qt::QueuedConnection);
     engine.loadFromModule("Odizinne.QuickEdits", "Main");
 
+    // Per-frame render timings end up in the trace next to the pipeline spans
+    if (!engine.rootObjects().isEmpty()) {
+        QQuickWindow* window = qobject_cast<QQuickWindow*>(engine.rootObjects().first());
+        Tracer::instance()->attachWindow(window);
+
+#ifdef Q_OS_WASM
+        // Time to the first interactive frame, logged by index.html next to the download and compile phases
+        if (window) {
+            QObject::connect(window, &QQuickWindow::frameSwapped, window, []() {
+                MAIN_THREAD_EM_ASM({
+                    if (typeof window.quickEditsFirstFrame === 'function') {
+                        window.quickEditsFirstFrame();
+                    }
+                });
+            }, static_cast<Qt::ConnectionType>(Qt::DirectConnection | Qt::SingleShotConnection));
+        }
+#endif
+    }
+
     return app.exec();
 }
@@ -0,0 +1,225 @@
+#include "memorybudget.h"
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QThread>
+#include <QVariantMap>
+#include <QDebug>
+
+namespace {
+#ifdef Q_OS_WASM
+// QT_WASM_MAXIMUM_MEMORY is 1 GB, the rest is Qt, the scene graph and the wasm stack
+const qint64 DefaultBudget = 768ll * 1024 * 1024;
+#else
+const qint64 DefaultBudget = 2048ll * 1024 * 1024;
+#endif
+
+// Cold caches first, reclaiming stops as soon as the total is back under the budget
+const MemoryBudget::Category ReclaimOrder[] = {
+    MemoryBudget::FontPreviews,
+    MemoryBudget::DecodedImages
+};
+
+QString megabytes(qint64 bytes)
+{
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+}
+
+MemoryBudget::Allocation::Allocation(Category category, qint64 bytes)
+    : m_category(category)
+    , m_bytes(0)
+{
+    resize(bytes);
+}
+
+MemoryBudget::Allocation::~Allocation()
+{
+    resize(0);
+}
+
+void MemoryBudget::Allocation::resize(qint64 bytes)
+{
+    if (bytes != m_bytes) {
+        MemoryBudget::instance()->add(m_category, bytes - m_bytes);
+        m_bytes = bytes;
+    }
+}
+
+MemoryBudget::MemoryBudget(QObject *parent)
+    : QObject(parent)
+    , m_budget(DefaultBudget)
+    , m_updateQueued(false)
+    , m_overBudgetReported(false)
+{
+    for (std::atomic<qint64>& usage : m_usage) {
+        usage = 0;
+    }
+
+    bool ok = false;
+    const qint64 megabytes = qEnvironmentVariableIntValue("QUICKEDITS_MEMORY_BUDGET_MB", &ok);
+    if (ok && megabytes > 0) {
+        m_budget = megabytes * 1024 * 1024;
+    }
+}
+
+MemoryBudget* MemoryBudget::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    // Caches keep reporting after QML lets go of it
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+MemoryBudget* MemoryBudget::instance()
+{
+    static MemoryBudget* instance = []() {
+        MemoryBudget* budget = new MemoryBudget();
+        // The first report may come from a decoding thread, updates belong to the GUI thread
+        if (QCoreApplication::instance() && budget->thread() != QCoreApplication::instance()->thread()) {
+            budget->moveToThread(QCoreApplication::instance()->thread());
+        }
+        return budget;
+    }();
+    return instance;
+}
+
+void MemoryBudget::setBudget(qint64 bytes)
+{
+    if (bytes == m_budget) {
+        return;
+    }
+    m_budget = bytes;
+    emit budgetChanged();
+    scheduleUpdate();
+}
+
+qint64 MemoryBudget::used() const
+{
+    qint64 total = 0;
+    for (const std::atomic<qint64>& usage : m_usage) {
+        total += usage;
+    }
+    return total;
+}
+
+QVariantList MemoryBudget::categories() const
+{
+    QVariantList list;
+    for (int i = 0; i < CategoryCount; ++i) {
+        QVariantMap entry;
+        entry["name"] = QString::fromLatin1(categoryName(Category(i)));
+        entry["bytes"] = m_usage[i].load();
+        list.append(entry);
+    }
+    return list;
+}
+
+void MemoryBudget::set(Category category, qint64 bytes)
+{
+    if (m_usage[category].exchange(bytes) != bytes) {
+        scheduleUpdate();
+    }
+}
+
+void MemoryBudget::add(Category category, qint64 delta)
+{
+    if (delta != 0) {
+        m_usage[category] += delta;
+        scheduleUpdate();
+    }
+}
+
+void MemoryBudget::setReclaimer(Category category, const Reclaimer& reclaimer)
+{
+    QMutexLocker locker(&m_mutex);
+    m_reclaimers[category] = reclaimer;
+}
+
+void MemoryBudget::scheduleUpdate()
+{
+    // Any number of reports between two event loop turns end up in one update
+    if (!m_updateQueued.exchange(true)) {
+        QMetaObject::invokeMethod(this, &MemoryBudget::update, Qt::QueuedConnection);
+    }
+}
+
+void MemoryBudget::update()
+{
+    m_updateQueued = false;
+    enforce();
+
+    if (Tracer::isEnabled()) {
+        for (int i = 0; i < CategoryCount; ++i) {
+            Tracer::instance()->addCounter(categoryName(Category(i)), m_usage[i]);
+        }
+    }
+    emit usageChanged();
+}
+
+void MemoryBudget::enforce()
+{
+    qint64 excess = used() - m_budget;
+    if (excess <= 0) {
+        m_overBudgetReported = false;
+        return;
+    }
+
+    TRACE_SCOPE("memory", "reclaim");
+    for (Category category : ReclaimOrder) {
+        Reclaimer reclaimer;
+        {
+            QMutexLocker locker(&m_mutex);
+            reclaimer = m_reclaimers[category];
+        }
+        if (!reclaimer) {
+            continue;
+        }
+
+        // Reclaimers lock their own cache, never call them with m_mutex held
+        const qint64 freed = reclaimer(excess);
+        if (freed > 0) {
+            qDebug() << "Memory budget: freed" << megabytes(freed) << "of" << categoryName(category);
+        }
+        excess = used() - m_budget;
+        if (excess <= 0) {
+            m_overBudgetReported = false;
+            return;
+        }
+    }
+
+    // Uploads, fonts and running exports cannot be dropped, say so once per overrun
+    if (!m_overBudgetReported) {
+        m_overBudgetReported = true;
+        qWarning() << "Memory budget exceeded by" << megabytes(excess) << "with nothing left to reclaim";
+        logUsage();
+    }
+}
+
+void MemoryBudget::logUsage() const
+{
+    qDebug().noquote() << "Memory:" << megabytes(used()) << "of" << megabytes(m_budget);
+    for (int i = 0; i < CategoryCount; ++i) {
+        qDebug().noquote() << "  " << categoryName(Category(i)) << megabytes(m_usage[i]);
+    }
+}
+
+const char* MemoryBudget::categoryName(Category category)
+{
+    switch (category) {
+    case DecodedImages:
+        return "decoded images";
+    case Uploads:
+        return "uploads";
+    case Fonts:
+        return "fonts";
+    case FontPreviews:
+        return "font previews";
+    case ExportBuffers:
+        return "export buffers";
+    case CategoryCount:
+        break;
+    }
+    return "unknown";
+}
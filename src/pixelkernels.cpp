@@ -0,0 +1,482 @@
+#include "pixelkernels.h"
+#include <cmath>
+
+#if defined(Q_PROCESSOR_X86)
+#define QUICKEDITS_X86_KERNELS
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// MSVC emits any intrinsic without flags, GCC and Clang need the target per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+// (value + 128 + ((value + 128) >> 8)) >> 8 is value / 255 rounded, exact for 0..65025
+inline int div255(int value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+inline uchar unpremultiplyChannel(int value, float scale)
+{
+    return uchar(qMin(255, int(float(value) * scale + 0.5f)));
+}
+
+// Scalar references, the vector kernels hand their tails to these
+
+void unpremultiplyScalar(const QRgb* src, uchar* dst, int count)
+{
+    for (int i = 0; i < count; ++i, dst += 4) {
+        const QRgb pixel = src[i];
+        const int alpha = qAlpha(pixel);
+        const float scale = alpha > 0 ? 255.0f / float(alpha) : 0.0f;
+        dst[0] = unpremultiplyChannel(qRed(pixel), scale);
+        dst[1] = unpremultiplyChannel(qGreen(pixel), scale);
+        dst[2] = unpremultiplyChannel(qBlue(pixel), scale);
+        dst[3] = uchar(alpha);
+    }
+}
+
+void flattenScalar(const QRgb* src, QRgb* dst, int count, QRgb matte)
+{
+    for (int i = 0; i < count; ++i) {
+        const QRgb pixel = src[i];
+        const int inverse = 255 - qAlpha(pixel);
+        dst[i] = qRgb(qMin(255, qRed(pixel) + div255(qRed(matte) * inverse)),
+                      qMin(255, qGreen(pixel) + div255(qGreen(matte) * inverse)),
+                      qMin(255, qBlue(pixel) + div255(qBlue(matte) * inverse)));
+    }
+}
+
+void packScalar(const QRgb* src, uchar* dst, int count, bool bgrOrder)
+{
+    for (int i = 0; i < count; ++i, dst += 3) {
+        const QRgb pixel = src[i];
+        dst[0] = uchar(bgrOrder ? qBlue(pixel) : qRed(pixel));
+        dst[1] = uchar(qGreen(pixel));
+        dst[2] = uchar(bgrOrder ? qRed(pixel) : qBlue(pixel));
+    }
+}
+
+#ifdef QUICKEDITS_X86_KERNELS
+
+// SSE4.1, four pixels per step
+
+KERNEL_TARGET("sse4.1")
+inline __m128i unpremultiplyChannelSse41(__m128i channel, __m128 scale, __m128 half, __m128i byteMask)
+{
+    const __m128 value = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(channel), scale), half);
+    return _mm_min_epi32(_mm_cvttps_epi32(value), byteMask);
+}
+
+KERNEL_TARGET("sse4.1")
+inline __m128i mulDiv255Sse41(__m128i a, __m128i b, __m128i round)
+{
+    const __m128i product = _mm_add_epi16(_mm_mullo_epi16(a, b), round);
+    return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+}
+
+KERNEL_TARGET("sse4.1")
+void unpremultiplySse41(const QRgb* src, uchar* dst, int count)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128 numerator = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i alpha = _mm_srli_epi32(pixels, 24);
+        const __m128 alphaF = _mm_cvtepi32_ps(alpha);
+        // Transparent pixels get a zero scale rather than 255 / 0
+        const __m128 scale = _mm_and_ps(_mm_div_ps(numerator, alphaF), _mm_cmpgt_ps(alphaF, zero));
+
+        const __m128i red = unpremultiplyChannelSse41(_mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask), scale, half, byteMask);
+        const __m128i green = unpremultiplyChannelSse41(_mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask), scale, half, byteMask);
+        const __m128i blue = unpremultiplyChannelSse41(_mm_and_si128(pixels, byteMask), scale, half, byteMask);
+
+        const __m128i rgba = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)),
+                                          _mm_or_si128(_mm_slli_epi32(blue, 16), _mm_slli_epi32(alpha, 24)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), rgba);
+    }
+    unpremultiplyScalar(src + i, dst + i * 4, count - i);
+}
+
+KERNEL_TARGET("sse4.1")
+void flattenSse41(const QRgb* src, QRgb* dst, int count, QRgb matte)
+{
+    const __m128i matte16 = _mm_unpacklo_epi8(_mm_set1_epi32(int(matte | 0xff000000)), _mm_setzero_si128());
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(128);
+    // Spread the alpha byte of two pixels over their four 16 bit lanes
+    const __m128i alphaLow = _mm_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+    const __m128i alphaHigh = _mm_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i low = mulDiv255Sse41(matte16, _mm_sub_epi16(full, _mm_shuffle_epi8(pixels, alphaLow)), round);
+        const __m128i high = mulDiv255Sse41(matte16, _mm_sub_epi16(full, _mm_shuffle_epi8(pixels, alphaHigh)), round);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(pixels, _mm_packus_epi16(low, high)));
+    }
+    flattenScalar(src + i, dst + i, count - i, matte);
+}
+
+KERNEL_TARGET("sse4.1")
+void packSse41(const QRgb* src, uchar* dst, int count, bool bgrOrder)
+{
+    const __m128i shuffle = bgrOrder
+        ? _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+        : _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    // Each store writes 16 bytes for 12, the loop stops while the overhang is still inside dst
+    int i = 0;
+    for (; i + 6 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(pixels, shuffle));
+    }
+    packScalar(src + i, dst + i * 3, count - i, bgrOrder);
+}
+
+// AVX2, eight pixels per step. Shuffles and packs work per 128 bit lane, the masks repeat per lane.
+
+KERNEL_TARGET("avx2")
+inline __m256i unpremultiplyChannelAvx2(__m256i channel, __m256 scale, __m256 half, __m256i byteMask)
+{
+    const __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(channel), scale), half);
+    return _mm256_min_epi32(_mm256_cvttps_epi32(value), byteMask);
+}
+
+KERNEL_TARGET("avx2")
+inline __m256i mulDiv255Avx2(__m256i a, __m256i b, __m256i round)
+{
+    const __m256i product = _mm256_add_epi16(_mm256_mullo_epi16(a, b), round);
+    return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+}
+
+KERNEL_TARGET("avx2")
+void unpremultiplyAvx2(const QRgb* src, uchar* dst, int count)
+{
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256 numerator = _mm256_set1_ps(255.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i alpha = _mm256_srli_epi32(pixels, 24);
+        const __m256 alphaF = _mm256_cvtepi32_ps(alpha);
+        const __m256 scale = _mm256_and_ps(_mm256_div_ps(numerator, alphaF), _mm256_cmp_ps(alphaF, zero, _CMP_GT_OQ));
+
+        const __m256i red = unpremultiplyChannelAvx2(_mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask), scale, half, byteMask);
+        const __m256i green = unpremultiplyChannelAvx2(_mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask), scale, half, byteMask);
+        const __m256i blue = unpremultiplyChannelAvx2(_mm256_and_si256(pixels, byteMask), scale, half, byteMask);
+
+        const __m256i rgba = _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, 8)),
+                                             _mm256_or_si256(_mm256_slli_epi32(blue, 16), _mm256_slli_epi32(alpha, 24)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), rgba);
+    }
+    unpremultiplyScalar(src + i, dst + i * 4, count - i);
+}
+
+KERNEL_TARGET("avx2")
+void flattenAvx2(const QRgb* src, QRgb* dst, int count, QRgb matte)
+{
+    const __m256i matte16 = _mm256_unpacklo_epi8(_mm256_set1_epi32(int(matte | 0xff000000)), _mm256_setzero_si256());
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i alphaLow = _mm256_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1,
+                                              3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+    const __m256i alphaHigh = _mm256_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1,
+                                               11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i low = mulDiv255Avx2(matte16, _mm256_sub_epi16(full, _mm256_shuffle_epi8(pixels, alphaLow)), round);
+        const __m256i high = mulDiv255Avx2(matte16, _mm256_sub_epi16(full, _mm256_shuffle_epi8(pixels, alphaHigh)), round);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epu8(pixels, _mm256_packus_epi16(low, high)));
+    }
+    flattenScalar(src + i, dst + i, count - i, matte);
+}
+
+KERNEL_TARGET("avx2")
+void packAvx2(const QRgb* src, uchar* dst, int count, bool bgrOrder)
+{
+    const __m256i shuffle = bgrOrder
+        ? _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                           0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+        : _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    // Lanes are stored 12 bytes apart, the upper lane overwrites the padding of the lower one
+    int i = 0;
+    for (; i + 10 <= count; i += 8) {
+        const __m256i packed = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm256_castsi256_si128(packed));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 12), _mm256_extracti128_si256(packed, 1));
+    }
+    packScalar(src + i, dst + i * 3, count - i, bgrOrder);
+}
+
+struct CpuFeatures
+{
+    bool sse41 = false;
+    bool avx2 = false;
+};
+
+CpuFeatures detectCpuFeatures()
+{
+    CpuFeatures features;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX2 also needs the OS to save the YMM registers
+    const bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (maxLeaf >= 7 && osSavesYmm) {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+    return features;
+}
+
+#endif // QUICKEDITS_X86_KERNELS
+
+#if defined(__wasm_simd128__)
+
+// WebAssembly SIMD128, four pixels per step
+
+inline v128_t unpremultiplyChannelSimd128(v128_t channel, v128_t scale, v128_t half, v128_t byteMask)
+{
+    const v128_t value = wasm_f32x4_add(wasm_f32x4_mul(wasm_f32x4_convert_i32x4(channel), scale), half);
+    return wasm_i32x4_min(wasm_i32x4_trunc_sat_f32x4(value), byteMask);
+}
+
+inline v128_t mulDiv255Simd128(v128_t a, v128_t b, v128_t round)
+{
+    const v128_t product = wasm_i16x8_add(wasm_i16x8_mul(a, b), round);
+    return wasm_u16x8_shr(wasm_i16x8_add(product, wasm_u16x8_shr(product, 8)), 8);
+}
+
+void unpremultiplySimd128(const QRgb* src, uchar* dst, int count)
+{
+    const v128_t byteMask = wasm_i32x4_splat(0xff);
+    const v128_t numerator = wasm_f32x4_splat(255.0f);
+    const v128_t half = wasm_f32x4_splat(0.5f);
+    const v128_t zero = wasm_f32x4_splat(0.0f);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const v128_t pixels = wasm_v128_load(src + i);
+        const v128_t alpha = wasm_u32x4_shr(pixels, 24);
+        const v128_t alphaF = wasm_f32x4_convert_i32x4(alpha);
+        const v128_t scale = wasm_v128_and(wasm_f32x4_div(numerator, alphaF), wasm_f32x4_gt(alphaF, zero));
+
+        const v128_t red = unpremultiplyChannelSimd128(wasm_v128_and(wasm_u32x4_shr(pixels, 16), byteMask), scale, half, byteMask);
+        const v128_t green = unpremultiplyChannelSimd128(wasm_v128_and(wasm_u32x4_shr(pixels, 8), byteMask), scale, half, byteMask);
+        const v128_t blue = unpremultiplyChannelSimd128(wasm_v128_and(pixels, byteMask), scale, half, byteMask);
+
+        const v128_t rgba = wasm_v128_or(wasm_v128_or(red, wasm_i32x4_shl(green, 8)),
+                                         wasm_v128_or(wasm_i32x4_shl(blue, 16), wasm_i32x4_shl(alpha, 24)));
+        wasm_v128_store(dst + i * 4, rgba);
+    }
+    unpremultiplyScalar(src + i, dst + i * 4, count - i);
+}
+
+void flattenSimd128(const QRgb* src, QRgb* dst, int count, QRgb matte)
+{
+    const v128_t matte16 = wasm_u16x8_extend_low_u8x16(wasm_i32x4_splat(int(matte | 0xff000000)));
+    const v128_t full = wasm_i16x8_splat(255);
+    const v128_t round = wasm_i16x8_splat(128);
+    const v128_t zero = wasm_i32x4_splat(0);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const v128_t pixels = wasm_v128_load(src + i);
+        const v128_t alphaLow = wasm_i8x16_shuffle(pixels, zero, 3, 16, 3, 16, 3, 16, 3, 16, 7, 16, 7, 16, 7, 16, 7, 16);
+        const v128_t alphaHigh = wasm_i8x16_shuffle(pixels, zero, 11, 16, 11, 16, 11, 16, 11, 16, 15, 16, 15, 16, 15, 16, 15, 16);
+        const v128_t low = mulDiv255Simd128(matte16, wasm_i16x8_sub(full, alphaLow), round);
+        const v128_t high = mulDiv255Simd128(matte16, wasm_i16x8_sub(full, alphaHigh), round);
+        wasm_v128_store(dst + i, wasm_u8x16_add_sat(pixels, wasm_u8x16_narrow_i16x8(low, high)));
+    }
+    flattenScalar(src + i, dst + i, count - i, matte);
+}
+
+void packSimd128(const QRgb* src, uchar* dst, int count, bool bgrOrder)
+{
+    // Swizzle indices past 15 produce zero bytes
+    const v128_t shuffle = bgrOrder
+        ? wasm_i8x16_make(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+        : wasm_i8x16_make(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    int i = 0;
+    for (; i + 6 <= count; i += 4) {
+        wasm_v128_store(dst + i * 3, wasm_i8x16_swizzle(wasm_v128_load(src + i), shuffle));
+    }
+    packScalar(src + i, dst + i * 3, count - i, bgrOrder);
+}
+
+#endif // __wasm_simd128__
+
+struct Kernels
+{
+    void (*unpremultiply)(const QRgb*, uchar*, int);
+    void (*flatten)(const QRgb*, QRgb*, int, QRgb);
+    void (*pack)(const QRgb*, uchar*, int, bool);
+    const char* name;
+};
+
+const Kernels& kernels()
+{
+    // Resolved once, every later call is a plain indirect call
+    static const Kernels selected = []() -> Kernels {
+#if defined(QUICKEDITS_X86_KERNELS)
+        const CpuFeatures features = detectCpuFeatures();
+        if (features.avx2) {
+            return { unpremultiplyAvx2, flattenAvx2, packAvx2, "AVX2" };
+        }
+        if (features.sse41) {
+            return { unpremultiplySse41, flattenSse41, packSse41, "SSE4.1" };
+        }
+#elif defined(__wasm_simd128__)
+        return { unpremultiplySimd128, flattenSimd128, packSimd128, "SIMD128" };
+#endif
+        return { unpremultiplyScalar, flattenScalar, packScalar, "scalar" };
+    }();
+    return selected;
+}
+
+// sRGB transfer curve tables for the gamma correct downscale
+struct GammaTables
+{
+    // sRGB byte to linear light scaled to 0..65535
+    quint16 toLinear[256];
+    // Linear light in 1/4096 steps back to an sRGB byte
+    uchar fromLinear[4097];
+
+    GammaTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            const double encoded = i / 255.0;
+            const double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+            toLinear[i] = quint16(std::lround(linear * 65535.0));
+        }
+        for (int i = 0; i <= 4096; ++i) {
+            const double linear = i / 4096.0;
+            const double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            fromLinear[i] = uchar(qBound(0L, std::lround(encoded * 255.0), 255L));
+        }
+    }
+};
+
+const GammaTables& gammaTables()
+{
+    static const GammaTables tables;
+    return tables;
+}
+
+QRgb averageLinear(const QRgb (&block)[4], const GammaTables& tables)
+{
+    int alphaSum = 0;
+    for (QRgb pixel : block) {
+        alphaSum += qAlpha(pixel);
+    }
+
+    if (alphaSum == 4 * 255) {
+        int red = 0;
+        int green = 0;
+        int blue = 0;
+        for (QRgb pixel : block) {
+            red += tables.toLinear[qRed(pixel)];
+            green += tables.toLinear[qGreen(pixel)];
+            blue += tables.toLinear[qBlue(pixel)];
+        }
+        // Sum of four 16 bit values to a 12 bit table index
+        return qRgb(tables.fromLinear[(red + 32) >> 6], tables.fromLinear[(green + 32) >> 6], tables.fromLinear[(blue + 32) >> 6]);
+    }
+
+    if (alphaSum == 0) {
+        return 0;
+    }
+
+    // Straight colors weighted by coverage, so transparent neighbours do not darken edges
+    int red = 0;
+    int green = 0;
+    int blue = 0;
+    for (QRgb pixel : block) {
+        const int alpha = qAlpha(pixel);
+        if (alpha == 0) {
+            continue;
+        }
+        red += tables.toLinear[qMin(255, (qRed(pixel) * 255 + alpha / 2) / alpha)] * alpha;
+        green += tables.toLinear[qMin(255, (qGreen(pixel) * 255 + alpha / 2) / alpha)] * alpha;
+        blue += tables.toLinear[qMin(255, (qBlue(pixel) * 255 + alpha / 2) / alpha)] * alpha;
+    }
+
+    const int alpha = (alphaSum + 2) >> 2;
+    auto encode = [&](int weighted) {
+        const int linear = weighted / alphaSum;
+        return div255(tables.fromLinear[(linear + 8) >> 4] * alpha);
+    };
+    return qRgba(encode(red), encode(green), encode(blue), alpha);
+}
+
+}
+
+namespace PixelKernels
+{
+
+void unpremultiplyToRgba8888(const QRgb* src, uchar* dst, int count)
+{
+    kernels().unpremultiply(src, dst, count);
+}
+
+void flattenOverMatte(const QRgb* src, QRgb* dst, int count, QRgb matte)
+{
+    kernels().flatten(src, dst, count, matte);
+}
+
+void packRgb888(const QRgb* src, uchar* dst, int count, bool bgrOrder)
+{
+    kernels().pack(src, dst, count, bgrOrder);
+}
+
+void downscale2xLinear(const QRgb* top, const QRgb* bottom, int srcWidth, QRgb* dst)
+{
+    const GammaTables& tables = gammaTables();
+    const int dstWidth = (srcWidth + 1) / 2;
+    for (int x = 0; x < dstWidth; ++x) {
+        const int left = x * 2;
+        const int right = qMin(left + 1, srcWidth - 1);
+        const QRgb block[4] = { top[left], top[right], bottom[left], bottom[right] };
+        dst[x] = averageLinear(block, tables);
+    }
+}
+
+const char* instructionSet()
+{
+    return kernels().name;
+}
+
+}
@@ -0,0 +1,460 @@
+#include "projectfile.h"
+#include "filehandler.h"
+#include "fontmanager.h"
+#include "imagecache.h"
+#include "imageexporter.h"
+#include "imagestore.h"
+#include "layermodel.h"
+#include "scenecompositor.h"
+#include "tracer.h"
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QColor>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJSValue>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+#ifdef Q_OS_WASM
+#include <emscripten.h>
+#include <emscripten/html5.h>
+
+static ProjectFile* g_projectFile = nullptr;
+
+extern "C" {
+EMSCRIPTEN_KEEPALIVE void projectSelectedCallback() {
+    qDebug() << "projectSelectedCallback called";
+    if (g_projectFile) {
+        g_projectFile->openData(FileHandler::takeUpload());
+    }
+}
+}
+#endif
+
+namespace {
+const char Magic[4] = { 'Q', 'E', 'D', 'T' };
+const quint16 FormatVersion = 1;
+const int HeaderSize = 16;
+const int ChunkAlignment = 16;
+
+// Layer properties saved in the document, everything else comes from the QML component
+const char* const TextProperties[] = {
+    "x", "y", "width", "height", "textContent", "fontFamily", "fontSize", "fontBold",
+    "fontItalic", "fontUnderline", "fontStrikeout", "textColor", "textRotation"
+};
+const char* const ImageProperties[] = {
+    "x", "y", "width", "height", "imageRotation", "adjustments"
+};
+
+QByteArray readSource(const QUrl& source)
+{
+    QUrl url = ImageCache::resolveSource(source);
+    if (ImageStore::isStoreUrl(url)) {
+        return ImageStore::instance()->data(ImageStore::idForUrl(url));
+    }
+
+    QString path = url.isLocalFile() ? url.toLocalFile()
+                   : url.scheme() == "qrc" ? ":" + url.path() : url.toString();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not read" << path << "for the project:" << file.errorString();
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+QCborValue propertyValue(const QVariant& value)
+{
+    // QCborValue has no color type, QML converts the string back on assignment
+    if (value.metaType().id() == QMetaType::QColor) {
+        return value.value<QColor>().name(QColor::HexArgb);
+    }
+    // QML "var" properties holding objects come back as QJSValue
+    if (value.metaType() == QMetaType::fromType<QJSValue>()) {
+        return QCborValue::fromVariant(value.value<QJSValue>().toVariant());
+    }
+    return QCborValue::fromVariant(value);
+}
+
+class ChunkWriter
+{
+public:
+    ChunkWriter()
+        : m_data(HeaderSize, '\0')
+    {
+    }
+
+    // Returns the chunk number, identical bytes are only stored once
+    int add(ProjectFile::ChunkKind kind, const QByteArray& bytes)
+    {
+        QByteArray hash = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+        auto it = m_chunks.constFind(hash);
+        if (it != m_chunks.constEnd()) {
+            return it.value();
+        }
+
+        align();
+        QCborMap entry;
+        entry[QStringLiteral("kind")] = int(kind);
+        entry[QStringLiteral("hash")] = hash;
+        entry[QStringLiteral("offset")] = qint64(m_data.size());
+        entry[QStringLiteral("size")] = qint64(bytes.size());
+        m_data.append(bytes);
+
+        int chunk = int(m_index.size());
+        m_index.append(entry);
+        m_chunks.insert(hash, chunk);
+        return chunk;
+    }
+
+    QByteArray finish()
+    {
+        align();
+        quint64 indexOffset = quint64(m_data.size());
+        m_data.append(QCborValue(m_index).toCbor());
+
+        char* header = m_data.data();
+        std::memcpy(header, Magic, sizeof(Magic));
+        qToLittleEndian<quint16>(FormatVersion, header + 4);
+        qToLittleEndian<quint16>(0, header + 6);
+        qToLittleEndian<quint64>(indexOffset, header + 8);
+        return m_data;
+    }
+
+private:
+    void align()
+    {
+        // Aligned chunks let readers work on them in place
+        qsizetype padding = (ChunkAlignment - m_data.size() % ChunkAlignment) % ChunkAlignment;
+        m_data.append(padding, '\0');
+    }
+
+    QByteArray m_data;
+    QCborArray m_index;
+    QHash<QByteArray, int> m_chunks;
+};
+}
+
+ProjectFile::ProjectFile(QObject *parent) : QObject(parent)
+{
+#ifdef Q_OS_WASM
+    g_projectFile = this;
+#endif
+}
+
+ProjectFile* ProjectFile::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    static ProjectFile* instance = new ProjectFile();
+    return instance;
+}
+
+QByteArray ProjectFile::serialize(QQuickItem* container)
+{
+    TRACE_SCOPE("io", "serialize project");
+    QQuickItem* base = container ? container->findChild<QQuickItem*>("baseImage", Qt::FindDirectChildrenOnly) : nullptr;
+    if (!base) {
+        qWarning() << "No base image to save";
+        return QByteArray();
+    }
+
+    QByteArray baseBytes = readSource(base->property("source").toUrl());
+    if (baseBytes.isEmpty()) {
+        return QByteArray();
+    }
+
+    ChunkWriter writer;
+    QCborMap baseEntry;
+    baseEntry[QStringLiteral("asset")] = writer.add(ImageChunk, baseBytes);
+    baseEntry[QStringLiteral("rotation")] = base->property("baseRotation").toReal();
+    baseEntry[QStringLiteral("adjustments")] = QCborValue::fromVariant(Adjustments::fromVariant(base->property("adjustments")).toMap());
+
+    QCborArray layers;
+    const QList<LayerModel::Layer> entries = LayerModel::instance()->layersBottomToTop();
+    for (const LayerModel::Layer& entry : entries) {
+        QQuickItem* item = entry.item;
+        // Hidden layers are deletions kept around for undo
+        if (!item->isVisible()) {
+            continue;
+        }
+
+        QCborMap layer;
+        QCborMap properties;
+
+        // Where the content sits inside the layer, renderers without QML need it
+        QRectF content = SceneCompositor::captureLayer(item, entry.type == LayerModel::Text ? SceneLayer::Text
+                                                                                             : SceneLayer::Image).contentRect;
+        layer[QStringLiteral("content")] = QCborArray { content.x(), content.y(), content.width(), content.height() };
+
+        if (entry.type == LayerModel::Text) {
+            for (const char* name : TextProperties) {
+                properties[QLatin1StringView(name)] = propertyValue(item->property(name));
+            }
+
+            // Custom fonts travel with the project, system fonts are expected on the other side
+            QByteArray font = FontManager::instance()->loadFontFromStorage(item->property("fontFamily").toString());
+            if (!font.isEmpty()) {
+                layer[QStringLiteral("font")] = writer.add(FontChunk, font);
+            }
+            layer[QStringLiteral("type")] = QStringLiteral("text");
+        } else {
+            QByteArray image = readSource(item->property("source").toUrl());
+            if (image.isEmpty()) {
+                qWarning() << "Skipping image layer without readable source";
+                continue;
+            }
+            for (const char* name : ImageProperties) {
+                properties[QLatin1StringView(name)] = propertyValue(item->property(name));
+            }
+            layer[QStringLiteral("asset")] = writer.add(ImageChunk, image);
+            layer[QStringLiteral("type")] = QStringLiteral("image");
+        }
+        layer[QStringLiteral("properties")] = properties;
+        layers.append(layer);
+    }
+
+    QCborMap document;
+    document[QStringLiteral("scene")] = QCborArray { container->width(), container->height() };
+    document[QStringLiteral("base")] = baseEntry;
+    document[QStringLiteral("layers")] = layers;
+    writer.add(DocumentChunk, QCborValue(document).toCbor());
+
+    return writer.finish();
+}
+
+bool ProjectFile::save(QQuickItem* container, const QUrl& fileUrl)
+{
+    QByteArray data = serialize(container);
+    if (data.isEmpty()) {
+        emit errorOccurred(tr("Nothing to save"));
+        return false;
+    }
+
+    // QSaveFile replaces the file atomically, an opened project holds no mapping of it (see open())
+    QString filePath = fileUrl.toLocalFile();
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to save project" << filePath << ":" << file.errorString();
+        emit errorOccurred(tr("Could not write %1").arg(QFileInfo(filePath).fileName()));
+        return false;
+    }
+
+    qDebug() << "Project saved:" << filePath << data.size() << "bytes";
+    emit projectSaved(QFileInfo(filePath).fileName());
+    return true;
+}
+
+void ProjectFile::download(QQuickItem* container, const QString& fileName)
+{
+    QByteArray data = serialize(container);
+    if (data.isEmpty()) {
+        emit errorOccurred(tr("Nothing to save"));
+        return;
+    }
+
+    ImageExporter::instance()->downloadData(data, fileName, "application/octet-stream");
+    emit projectSaved(fileName);
+}
+
+bool ProjectFile::open(const QUrl& fileUrl)
+{
+    QString filePath = fileUrl.toLocalFile();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open project" << filePath << ":" << file.errorString();
+        emit errorOccurred(tr("Could not open %1").arg(QFileInfo(filePath).fileName()));
+        return false;
+    }
+
+    // load() copies out what it keeps, the mapping goes away with the file. A live mapping
+    // would keep QSaveFile from replacing the project on Windows.
+    const qint64 size = file.size();
+    if (const uchar* mapped = file.map(0, size)) {
+        return load(reinterpret_cast<const char*>(mapped), size);
+    }
+
+    // Some file systems cannot be mapped
+    qDebug() << "Mapping" << filePath << "failed, reading it into memory";
+    const QByteArray data = file.readAll();
+    return load(data.constData(), data.size());
+}
+
+void ProjectFile::openData(const QByteArray& data)
+{
+    load(data.constData(), data.size());
+}
+
+QByteArray ProjectFile::Archive::chunk(qint64 index, ChunkKind kind) const
+{
+    if (index < 0 || index >= chunks.size() || kinds.at(index) != kind) {
+        return QByteArray();
+    }
+    return chunks.at(index);
+}
+
+bool ProjectFile::parse(const char* data, qint64 size, Archive& archive, QString* error)
+{
+    auto fail = [error](const QString& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    };
+
+    if (size < HeaderSize || std::memcmp(data, Magic, sizeof(Magic)) != 0) {
+        return fail(tr("Not a QuickEdits project"));
+    }
+    if (qFromLittleEndian<quint16>(data + 4) > FormatVersion) {
+        return fail(tr("This project was saved by a newer version of QuickEdits"));
+    }
+
+    const quint64 indexOffset = qFromLittleEndian<quint64>(data + 8);
+    if (indexOffset < quint64(HeaderSize) || indexOffset >= quint64(size)) {
+        return fail(tr("The project file is damaged"));
+    }
+
+    // Only the index and the document are parsed here, assets stay untouched until used
+    QCborValue index = QCborValue::fromCbor(QByteArray::fromRawData(data + indexOffset, size - qint64(indexOffset)));
+    int documentChunk = -1;
+    const QCborArray indexArray = index.toArray();
+    for (const QCborValue& value : indexArray) {
+        int kind = int(value[QStringLiteral("kind")].toInteger(-1));
+        qint64 offset = value[QStringLiteral("offset")].toInteger(-1);
+        qint64 length = value[QStringLiteral("size")].toInteger(-1);
+        if (offset < HeaderSize || length < 0 || offset + length > qint64(indexOffset)) {
+            return fail(tr("The project file is damaged"));
+        }
+        if (kind == DocumentChunk) {
+            documentChunk = int(archive.chunks.size());
+        }
+        archive.chunks.append(QByteArray::fromRawData(data + offset, length));
+        archive.kinds.append(kind);
+    }
+
+    if (documentChunk < 0) {
+        return fail(tr("The project file is damaged"));
+    }
+
+    archive.document = QCborValue::fromCbor(archive.chunks.at(documentChunk)).toMap();
+    if (archive.document.isEmpty()) {
+        return fail(tr("The project file is damaged"));
+    }
+    return true;
+}
+
+bool ProjectFile::load(const char* data, qint64 size)
+{
+    TRACE_SCOPE("io", "open project");
+    Archive archive;
+    QString error;
+    if (!parse(data, size, archive, &error)) {
+        emit errorOccurred(error);
+        return false;
+    }
+
+    // Image chunks are stored still encoded, decoding happens on first display
+    QHash<qint64, QString> imageUrls;
+    auto imageUrl = [&](qint64 chunk) -> QString {
+        auto it = imageUrls.constFind(chunk);
+        if (it == imageUrls.constEnd()) {
+            QByteArray bytes = archive.chunk(chunk, ImageChunk);
+            if (bytes.isEmpty()) {
+                return QString();
+            }
+            // Chunks are views on the buffer being parsed, which does not outlive this call
+            bytes.detach();
+            it = imageUrls.insert(chunk, ImageStore::urlForId(ImageStore::instance()->insert(bytes)).toString());
+        }
+        return it.value();
+    };
+
+    const QCborMap& document = archive.document;
+    QCborMap base = document[QStringLiteral("base")].toMap();
+    QVariantMap project;
+    project["baseSource"] = imageUrl(base[QStringLiteral("asset")].toInteger(-1));
+    project["baseRotation"] = base[QStringLiteral("rotation")].toDouble();
+    project["baseAdjustments"] = Adjustments::fromVariant(base[QStringLiteral("adjustments")].toMap().toVariantMap()).toMap();
+    if (project["baseSource"].toString().isEmpty()) {
+        emit errorOccurred(tr("The project file is damaged"));
+        return false;
+    }
+
+    QVariantList layers;
+    const QCborArray layerArray = document[QStringLiteral("layers")].toArray();
+    for (const QCborValue& value : layerArray) {
+        QVariantMap properties = value[QStringLiteral("properties")].toMap().toVariantMap();
+        QString type = value[QStringLiteral("type")].toString();
+
+        if (type == "image") {
+            QString source = imageUrl(value[QStringLiteral("asset")].toInteger(-1));
+            if (source.isEmpty()) {
+                qWarning() << "Skipping image layer with a missing asset";
+                continue;
+            }
+            properties["source"] = source;
+        } else if (type == "text") {
+            QByteArray font = archive.chunk(value[QStringLiteral("font")].toInteger(-1), FontChunk);
+            if (!font.isEmpty() && !FontManager::instance()->ensureFontLoaded(properties.value("fontFamily").toString())) {
+                // The font database keeps the bytes it is given
+                font.detach();
+                FontManager::instance()->loadCustomFontData(font);
+            }
+        } else {
+            qWarning() << "Skipping unknown layer type" << type;
+            continue;
+        }
+
+        QVariantMap layer;
+        layer["type"] = type;
+        layer["properties"] = properties;
+        layers.append(layer);
+    }
+    project["layers"] = layers;
+
+    qDebug() << "Project opened with" << layers.size() << "layers and" << archive.chunks.size() << "chunks";
+    emit projectOpened(project);
+    return true;
+}
+
+void ProjectFile::openProjectDialog()
+{
+#ifdef Q_OS_WASM
+    qDebug() << "Opening WebAssembly project dialog";
+    EM_ASM({
+        var input = document.getElementById('projectInput');
+        if (!input) {
+            input = document.createElement('input');
+            input.type = 'file';
+            input.id = 'projectInput';
+            input.accept = '.qedit';
+            input.style.display = 'none';
+            document.body.appendChild(input);
+        }
+
+        input.onchange = function(e) {
+            var file = e.target.files[0];
+            if (file) {
+                var reader = new FileReader();
+                reader.onload = function(event) {
+                    var bytes = new Uint8Array(event.target.result);
+                    var ptr = Module._uploadBufferAlloc(bytes.length);
+                    HEAPU8.set(bytes, ptr);
+                    Module._projectSelectedCallback();
+                };
+                reader.readAsArrayBuffer(file);
+            }
+            input.value = '';
+        };
+        input.click();
+    });
+#else
+    qDebug() << "Not WebAssembly platform";
+#endif
+}
@@ -0,0 +1,236 @@
+#include "resampler.h"
+#include "tracer.h"
+#include <QLineF>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QDebug>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+namespace {
+const double Pi = 3.14159265358979323846;
+
+// Output rows per band, small enough to spread a strip over every core
+const int MinBandHeight = 16;
+
+double sinc(double x)
+{
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= Pi;
+    return std::sin(x) / x;
+}
+
+double filterRadius(Resampler::Filter filter)
+{
+    return filter == Resampler::Lanczos3 ? 3.0 : 2.0;
+}
+
+double filterWeight(Resampler::Filter filter, double x)
+{
+    x = std::abs(x);
+    if (filter == Resampler::Lanczos3) {
+        return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+
+    // Mitchell-Netravali with B = C = 1/3
+    const double b = 1.0 / 3.0;
+    const double c = 1.0 / 3.0;
+    if (x < 1.0) {
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6.0;
+    }
+    if (x < 2.0) {
+        return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6.0;
+    }
+    return 0.0;
+}
+
+// Source taps and normalized weights of every output pixel along one axis
+struct Axis
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights;   // count[i] weights at i * stride
+    int stride = 0;
+};
+
+Axis buildAxis(int sourceLength, int targetLength, Resampler::Filter filter)
+{
+    Axis axis;
+    const double scale = double(sourceLength) / targetLength;
+    // When shrinking the filter is stretched over the source, which is what removes aliasing
+    const double filterScale = qMax(1.0, scale);
+    const double support = filterRadius(filter) * filterScale;
+
+    axis.stride = int(std::ceil(support)) * 2 + 2;
+    axis.first.resize(targetLength);
+    axis.count.resize(targetLength);
+    axis.weights.assign(size_t(targetLength) * axis.stride, 0.0f);
+
+    for (int i = 0; i < targetLength; ++i) {
+        const double center = (i + 0.5) * scale;
+        const int first = qMax(0, int(std::floor(center - support)));
+        const int last = qMin(sourceLength - 1, int(std::ceil(center + support)));
+        float* weights = axis.weights.data() + size_t(i) * axis.stride;
+
+        double sum = 0.0;
+        int count = 0;
+        for (int j = first; j <= last && count < axis.stride; ++j, ++count) {
+            const double weight = filterWeight(filter, (j + 0.5 - center) / filterScale);
+            weights[count] = float(weight);
+            sum += weight;
+        }
+        if (sum != 0.0) {
+            for (int k = 0; k < count; ++k) {
+                weights[k] = float(weights[k] / sum);
+            }
+        }
+
+        axis.first[i] = first;
+        axis.count[i] = count;
+    }
+
+    return axis;
+}
+
+// Runs work(band) for every band, on free global pool threads and on the calling thread
+void runBands(int bandCount, const std::function<void(int)>& work)
+{
+    std::atomic<int> next(0);
+    auto drain = [&]() {
+        for (int band = next++; band < bandCount; band = next++) {
+            work(band);
+        }
+    };
+
+    // tryStart never queues, so helpers either run now or not at all and waiting cannot deadlock
+    QThreadPool* pool = QThreadPool::globalInstance();
+    QSemaphore finished;
+    int helpers = 0;
+    const int wanted = qMin(bandCount - 1, pool->maxThreadCount());
+    for (int i = 0; i < wanted; ++i) {
+        if (!pool->tryStart([&]() {
+                drain();
+                finished.release();
+            })) {
+            break;
+        }
+        ++helpers;
+    }
+
+    drain();
+    finished.acquire(helpers);
+}
+
+inline uchar toChannel(float value, float maximum)
+{
+    return uchar(qBound(0.0f, value, maximum) + 0.5f);
+}
+}
+
+QImage Resampler::resize(const QImage& source, const QSize& size)
+{
+    const bool shrinking = size.width() * size.height() < source.width() * source.height();
+    return resize(source, size, shrinking ? Lanczos3 : Mitchell);
+}
+
+QImage Resampler::resize(const QImage& source, const QSize& size, Filter filter)
+{
+    TRACE_SCOPE("image", "resample");
+    if (source.isNull() || size.isEmpty()) {
+        return QImage();
+    }
+    if (size == source.size()) {
+        return source;
+    }
+
+    const bool opaque = source.format() == QImage::Format_RGB32;
+    const QImage input = opaque || source.format() == QImage::Format_ARGB32_Premultiplied
+                             ? source
+                             : source.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    QImage target(size, input.format());
+    if (target.isNull()) {
+        qWarning() << "Could not allocate resampled image of size" << size;
+        return QImage();
+    }
+
+    const Axis horizontal = buildAxis(input.width(), size.width(), filter);
+    const Axis vertical = buildAxis(input.height(), size.height(), filter);
+
+    const int threads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+    const int bandHeight = qMax(MinBandHeight, (size.height() + threads * 4 - 1) / (threads * 4));
+    const int bandCount = (size.height() + bandHeight - 1) / bandHeight;
+    const int width = size.width();
+
+    runBands(bandCount, [&](int band) {
+        const int y0 = band * bandHeight;
+        const int y1 = qMin(size.height(), y0 + bandHeight);
+
+        // Source rows this band reads, filtered horizontally once into a float buffer
+        const int sourceFirst = vertical.first[y0];
+        int sourceLast = sourceFirst;
+        for (int y = y0; y < y1; ++y) {
+            sourceLast = qMax(sourceLast, vertical.first[y] + vertical.count[y] - 1);
+        }
+
+        std::vector<float> rows(size_t(sourceLast - sourceFirst + 1) * width * 4);
+        for (int sy = sourceFirst; sy <= sourceLast; ++sy) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(input.constScanLine(sy));
+            float* out = rows.data() + size_t(sy - sourceFirst) * width * 4;
+            for (int x = 0; x < width; ++x, out += 4) {
+                const QRgb* taps = line + horizontal.first[x];
+                const float* weights = horizontal.weights.data() + size_t(x) * horizontal.stride;
+                float b = 0.0f, g = 0.0f, r = 0.0f, a = 0.0f;
+                for (int k = 0; k < horizontal.count[x]; ++k) {
+                    const QRgb pixel = taps[k];
+                    const float weight = weights[k];
+                    b += weight * float(qBlue(pixel));
+                    g += weight * float(qGreen(pixel));
+                    r += weight * float(qRed(pixel));
+                    a += weight * float(qAlpha(pixel));
+                }
+                out[0] = b;
+                out[1] = g;
+                out[2] = r;
+                out[3] = a;
+            }
+        }
+
+        std::vector<float> accumulator(size_t(width) * 4);
+        for (int y = y0; y < y1; ++y) {
+            std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+            const float* weights = vertical.weights.data() + size_t(y) * vertical.stride;
+            for (int k = 0; k < vertical.count[y]; ++k) {
+                const float weight = weights[k];
+                const float* row = rows.data() + size_t(vertical.first[y] + k - sourceFirst) * width * 4;
+                for (int i = 0; i < width * 4; ++i) {
+                    accumulator[i] += weight * row[i];
+                }
+            }
+
+            // Negative lobes can overshoot, premultiplied colors must also stay below alpha
+            QRgb* out = reinterpret_cast<QRgb*>(target.scanLine(y));
+            const float* value = accumulator.data();
+            for (int x = 0; x < width; ++x, value += 4) {
+                const int alpha = opaque ? 255 : toChannel(value[3], 255.0f);
+                const float maximum = float(alpha);
+                out[x] = qRgba(toChannel(value[2], maximum), toChannel(value[1], maximum),
+                               toChannel(value[0], maximum), alpha);
+            }
+        }
+    });
+
+    return target;
+}
+
+QSize Resampler::deviceSize(const QSizeF& size, const QTransform& transform)
+{
+    const QPointF origin = transform.map(QPointF(0, 0));
+    const qreal xScale = QLineF(origin, transform.map(QPointF(1, 0))).length();
+    const qreal yScale = QLineF(origin, transform.map(QPointF(0, 1))).length();
+    return QSize(qMax(1, qRound(size.width() * xScale)), qMax(1, qRound(size.height() * yScale)));
+}
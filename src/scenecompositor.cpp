@@ -0,0 +1,271 @@
+#include "scenecompositor.h"
+#include "imagecache.h"
+#include "layermodel.h"
+#include "resampler.h"
+#include "textlayer.h"
+#include "tracer.h"
+#include <QQuickItem>
+#include <QPainter>
+#include <QDebug>
+
+namespace {
+QString layerImageKey(const SceneLayer& layer)
+{
+    return layer.adjustments.key() + '|' + layer.source.toString();
+}
+}
+
+SceneCompositor::SceneCompositor(const SceneDescription& scene)
+    : m_scene(scene)
+{
+}
+
+SceneDescription SceneCompositor::captureScene(QQuickItem* container)
+{
+    SceneDescription scene;
+    if (!container) {
+        return scene;
+    }
+
+    scene.sceneSize = container->size();
+
+    if (QQuickItem* base = container->findChild<QQuickItem*>("baseImage", Qt::FindDirectChildrenOnly)) {
+        scene.baseSource = base->property("source").toUrl();
+        scene.baseSize = base->size();
+        scene.baseRotation = base->property("baseRotation").toReal();
+        scene.baseAdjustments = Adjustments::fromVariant(base->property("adjustments"));
+    }
+
+    // The layer model already knows the paint order and the type of every layer
+    const QList<LayerModel::Layer> layers = LayerModel::instance()->layersBottomToTop();
+    for (const LayerModel::Layer& entry : layers) {
+        if (entry.item->isVisible()) {
+            scene.layers.append(captureLayer(entry.item, entry.type == LayerModel::Text ? SceneLayer::Text
+                                                                                         : SceneLayer::Image));
+        }
+    }
+
+    return scene;
+}
+
+SceneLayer SceneCompositor::captureLayer(QQuickItem* item, SceneLayer::Type type)
+{
+    SceneLayer layer;
+    layer.type = type;
+    layer.geometry = QRectF(item->position(), item->size());
+    layer.contentRect = QRectF(QPointF(0, 0), item->size());
+    layer.z = item->z();
+
+    // The content item sits inside the rotating container, use its unrotated offset
+    QQuickItem* content = item->findChild<QQuickItem*>("layerContent");
+    if (content && content->parentItem()) {
+        QPointF offset = content->position() + content->parentItem()->position();
+        layer.contentRect = QRectF(offset, content->size());
+    }
+
+    if (type == SceneLayer::Text) {
+        layer.text = item->property("textContent").toString();
+        layer.rotation = item->property("textRotation").toReal();
+        layer.color = item->property("textColor").value<QColor>();
+
+        QFont font(item->property("fontFamily").toString());
+        font.setPixelSize(qMax(1, item->property("fontSize").toInt()));
+        font.setBold(item->property("fontBold").toBool());
+        font.setItalic(item->property("fontItalic").toBool());
+        font.setUnderline(item->property("fontUnderline").toBool());
+        font.setStrikeOut(item->property("fontStrikeout").toBool());
+        layer.font = font;
+    } else {
+        layer.source = item->property("source").toUrl();
+        layer.rotation = item->property("imageRotation").toReal();
+        layer.adjustments = Adjustments::fromVariant(item->property("adjustments"));
+    }
+
+    return layer;
+}
+
+QImage SceneCompositor::loadImage(const QUrl& url, const Adjustments& adjustments)
+{
+    // Shares the full-resolution decode with what the canvas already displays, adjusted
+    // versions are cached as well so exporting again only redoes layers that changed
+    return ImageCache::instance()->adjusted(url, adjustments);
+}
+
+void SceneCompositor::setBaseImage(const QImage& image)
+{
+    m_baseImage = image;
+}
+
+bool SceneCompositor::prepare(const QSize& outputSize)
+{
+    TRACE_SCOPE("export", "prepare layers");
+    if (m_baseImage.isNull()) {
+        m_baseImage = loadImage(m_scene.baseSource, m_scene.baseAdjustments);
+    } else {
+        m_baseImage = m_scene.baseAdjustments.apply(m_baseImage);
+    }
+    if (m_baseImage.isNull()) {
+        qWarning() << "Failed to decode base image for compositing";
+        return false;
+    }
+    if (m_baseImage.format() != QImage::Format_RGB32) {
+        m_baseImage.convertTo(QImage::Format_ARGB32_Premultiplied);
+    }
+
+    for (const SceneLayer& layer : std::as_const(m_scene.layers)) {
+        if (layer.type == SceneLayer::Image && !m_layerImages.contains(layerImageKey(layer))) {
+            QImage image = loadImage(layer.source, layer.adjustments);
+            if (image.isNull()) {
+                qWarning() << "Failed to decode layer image:" << layer.source.toString().left(64);
+            } else if (image.format() != QImage::Format_RGB32) {
+                image.convertTo(QImage::Format_ARGB32_Premultiplied);
+            }
+            m_layerImages.insert(layerImageKey(layer), image);
+        }
+    }
+
+    // Outlines do not depend on the output size, scaling them is exact
+    m_textOutlines.clear();
+    for (const SceneLayer& layer : std::as_const(m_scene.layers)) {
+        m_textOutlines.append(layer.type == SceneLayer::Text
+                                  ? TextLayer::outline(layer.text, layer.font, layer.contentRect.width())
+                                  : TextLayer::Outline());
+    }
+
+    m_scaledBase = QImage();
+    m_scaledLayers.clear();
+    if (outputSize.isEmpty() || !m_scene.isValid()) {
+        return true;
+    }
+
+    m_scaledBase = resampleFor(m_baseImage, baseDrawSize(), m_scene.baseRotation, outputSize);
+    for (const SceneLayer& layer : std::as_const(m_scene.layers)) {
+        QImage scaled;
+        if (layer.type == SceneLayer::Image) {
+            const QImage image = m_layerImages.value(layerImageKey(layer));
+            scaled = resampleFor(image, layerDrawSize(layer, image), layer.rotation, outputSize);
+        }
+        m_scaledLayers.append(scaled);
+    }
+
+    return true;
+}
+
+QSizeF SceneCompositor::baseDrawSize() const
+{
+    return m_scene.baseSize.isEmpty() ? QSizeF(m_baseImage.size()) : m_scene.baseSize;
+}
+
+QSizeF SceneCompositor::layerDrawSize(const SceneLayer& layer, const QImage& image) const
+{
+    // Matches Image.PreserveAspectFit
+    return QSizeF(image.size()).scaled(layer.contentRect.size(), Qt::KeepAspectRatio);
+}
+
+QImage SceneCompositor::resampleFor(const QImage& image, const QSizeF& drawSize, qreal rotation, const QSize& outputSize) const
+{
+    if (image.isNull() || drawSize.isEmpty()) {
+        return QImage();
+    }
+
+    // Same scale and rotation renderRegion and paintScene apply, minus the translations
+    QTransform transform;
+    transform.scale(outputSize.width() / m_scene.sceneSize.width(), outputSize.height() / m_scene.sceneSize.height());
+    transform.rotate(rotation);
+    const QSize size = Resampler::deviceSize(drawSize, transform);
+
+    // Within a pixel of the source the bilinear draw is already exact enough. Upscales are
+    // drawn bilinearly too: a prepared copy would be a full output-size frame held next to the
+    // strips for the whole export, and Mitchell adds little over bilinear when enlarging.
+    if (size.width() >= image.width() - 1 || size.height() >= image.height() - 1) {
+        return QImage();
+    }
+    return Resampler::resize(image, size);
+}
+
+QImage SceneCompositor::render(const QSize& outputSize, int tileSize) const
+{
+    if (!m_scene.isValid() || outputSize.isEmpty()) {
+        return QImage();
+    }
+
+    QImage target(outputSize, QImage::Format_ARGB32_Premultiplied);
+    if (target.isNull()) {
+        qWarning() << "Could not allocate export image of size" << outputSize;
+        return QImage();
+    }
+    target.fill(Qt::transparent);
+
+    for (int y = 0; y < outputSize.height(); y += tileSize) {
+        for (int x = 0; x < outputSize.width(); x += tileSize) {
+            QRect tileRect(x, y,
+                           qMin(tileSize, outputSize.width() - x),
+                           qMin(tileSize, outputSize.height() - y));
+
+            // Paint through a view on the tile memory so each tile is an independent QPainter target
+            uchar* tileBits = target.bits() + tileRect.y() * target.bytesPerLine() + tileRect.x() * 4;
+            QImage tileView(tileBits, tileRect.width(), tileRect.height(), target.bytesPerLine(), target.format());
+            renderRegion(tileView, tileRect, outputSize);
+        }
+    }
+
+    return target;
+}
+
+void SceneCompositor::renderRegion(QImage& target, const QRect& region, const QSize& outputSize) const
+{
+    TRACE_SCOPE("export", "render region");
+    QPainter painter(&target);
+    painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform | QPainter::TextAntialiasing);
+    painter.translate(-region.x(), -region.y());
+    painter.scale(outputSize.width() / m_scene.sceneSize.width(),
+                  outputSize.height() / m_scene.sceneSize.height());
+
+    paintScene(painter);
+}
+
+void SceneCompositor::paintScene(QPainter& painter) const
+{
+    // Base image is centered in the scene and rotated around its own center
+    painter.save();
+    painter.translate(m_scene.sceneSize.width() / 2, m_scene.sceneSize.height() / 2);
+    painter.rotate(m_scene.baseRotation);
+    QSizeF baseSize = baseDrawSize();
+    painter.drawImage(QRectF(QPointF(-baseSize.width() / 2, -baseSize.height() / 2), baseSize),
+                      m_scaledBase.isNull() ? m_baseImage : m_scaledBase);
+    painter.restore();
+
+    for (qsizetype i = 0; i < m_scene.layers.size(); ++i) {
+        paintLayer(painter, m_scene.layers.at(i), m_scaledLayers.value(i), m_textOutlines.value(i));
+    }
+}
+
+void SceneCompositor::paintLayer(QPainter& painter, const SceneLayer& layer, const QImage& scaledImage,
+                                 const TextLayer::Outline& textOutline) const
+{
+    painter.save();
+
+    QPointF center = layer.geometry.center();
+    painter.translate(center);
+    painter.rotate(layer.rotation);
+    painter.translate(-layer.geometry.width() / 2, -layer.geometry.height() / 2);
+
+    if (layer.type == SceneLayer::Text) {
+        // Filled as vector outlines of the canvas layout, sharp at any output size
+        painter.translate(layer.contentRect.topLeft());
+        painter.fillPath(textOutline.glyphs, layer.color);
+        for (const QRectF& bar : textOutline.decorations) {
+            painter.fillRect(bar, layer.color);
+        }
+    } else {
+        const QImage image = m_layerImages.value(layerImageKey(layer));
+        if (!image.isNull()) {
+            // Centered in the content rectangle
+            QRectF drawRect(QPointF(0, 0), layerDrawSize(layer, image));
+            drawRect.moveCenter(layer.contentRect.center());
+            painter.drawImage(drawRect, scaledImage.isNull() ? image : scaledImage);
+        }
+    }
+
+    painter.restore();
+}
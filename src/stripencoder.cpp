@@ -0,0 +1,359 @@
+#include "stripencoder.h"
+#include "pixelkernels.h"
+#include <QIODevice>
+#include <QImageWriter>
+#include <QtEndian>
+#include <QDebug>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef QUICKEDITS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+std::unique_ptr<StripEncoder> StripEncoder::create(const QString& format)
+{
+    const QByteArray upper = format.toUpper().toLatin1();
+
+#ifdef QUICKEDITS_HAVE_ZLIB
+    if (upper == "PNG") {
+        return std::make_unique<PngStripEncoder>();
+    }
+#endif
+
+    if (upper == "BMP") {
+        return std::make_unique<BmpStripEncoder>();
+    }
+
+    return std::make_unique<ImageWriterStripEncoder>(upper);
+}
+
+#ifdef QUICKEDITS_HAVE_ZLIB
+
+namespace {
+const int PngIdatSize = 256 * 1024;
+
+// Paeth predictor from the PNG specification
+inline uchar paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return uchar(a);
+    }
+    return pb <= pc ? uchar(b) : uchar(c);
+}
+
+// Filters one RGBA row with every PNG filter type and keeps the one with the
+// smallest sum of absolute values, the same heuristic libpng uses
+void filterRow(const uchar* row, const uchar* prev, int length, uchar* out, uchar* scratch)
+{
+    const int bpp = 4;
+    quint64 bestSum = ~quint64(0);
+    int bestType = 0;
+
+    for (int type = 0; type < 5; ++type) {
+        uchar* dst = scratch + length * type;
+        quint64 sum = 0;
+        for (int i = 0; i < length; ++i) {
+            int a = i >= bpp ? row[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (i >= bpp && prev) ? prev[i - bpp] : 0;
+            uchar value = row[i];
+            switch (type) {
+            case 1: value = uchar(row[i] - a); break;
+            case 2: value = uchar(row[i] - b); break;
+            case 3: value = uchar(row[i] - ((a + b) >> 1)); break;
+            case 4: value = uchar(row[i] - paeth(a, b, c)); break;
+            default: break;
+            }
+            dst[i] = value;
+            sum += value < 128 ? value : 256 - value;
+        }
+        if (sum < bestSum) {
+            bestSum = sum;
+            bestType = type;
+        }
+    }
+
+    out[0] = uchar(bestType);
+    std::memcpy(out + 1, scratch + length * bestType, length);
+}
+}
+
+struct PngStripEncoder::Private
+{
+    QIODevice* device = nullptr;
+    QSize size;
+    z_stream stream;
+    bool streamOpen = false;
+    QByteArray previousRow;
+    QByteArray rgbaRow;
+    QByteArray filtered;
+    QByteArray scratch;
+    QByteArray output;
+    bool hasPrevious = false;
+};
+
+PngStripEncoder::PngStripEncoder()
+    : d(std::make_unique<Private>())
+{
+}
+
+PngStripEncoder::~PngStripEncoder()
+{
+    if (d->streamOpen) {
+        deflateEnd(&d->stream);
+    }
+}
+
+bool PngStripEncoder::begin(QIODevice* device, const QSize& size)
+{
+    d->device = device;
+    d->size = size;
+
+    static const char signature[8] = { '\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n' };
+    if (device->write(signature, 8) != 8) {
+        return false;
+    }
+
+    QByteArray header(13, Qt::Uninitialized);
+    qToBigEndian<quint32>(size.width(), header.data());
+    qToBigEndian<quint32>(size.height(), header.data() + 4);
+    header[8] = 8;      // bit depth
+    header[9] = 6;      // RGBA
+    header[10] = 0;     // deflate
+    header[11] = 0;     // adaptive filtering
+    header[12] = 0;     // no interlace
+    if (!writeChunk("IHDR", header)) {
+        return false;
+    }
+
+    std::memset(&d->stream, 0, sizeof(d->stream));
+    if (deflateInit(&d->stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        qWarning() << "deflateInit failed";
+        return false;
+    }
+    d->streamOpen = true;
+
+    const int rowBytes = size.width() * 4;
+    d->previousRow.resize(rowBytes);
+    d->rgbaRow.resize(rowBytes);
+    d->filtered.resize(rowBytes + 1);
+    d->scratch.resize(rowBytes * 5);
+    d->output.resize(PngIdatSize);
+    d->stream.next_out = reinterpret_cast<Bytef*>(d->output.data());
+    d->stream.avail_out = uInt(d->output.size());
+    d->hasPrevious = false;
+
+    return true;
+}
+
+bool PngStripEncoder::writeStrip(const QImage& strip)
+{
+    // Rendered strips are unpremultiplied row by row, anything else goes through Qt once
+    const bool premultiplied = strip.format() == QImage::Format_ARGB32_Premultiplied
+                               || strip.format() == QImage::Format_RGB32;
+    const QImage rgba = premultiplied || strip.format() == QImage::Format_RGBA8888
+                            ? strip
+                            : strip.convertToFormat(QImage::Format_RGBA8888);
+    const int rowBytes = d->size.width() * 4;
+
+    for (int y = 0; y < rgba.height(); ++y) {
+        const uchar* row = rgba.constScanLine(y);
+        if (premultiplied) {
+            uchar* converted = reinterpret_cast<uchar*>(d->rgbaRow.data());
+            PixelKernels::unpremultiplyToRgba8888(reinterpret_cast<const QRgb*>(row), converted, d->size.width());
+            row = converted;
+        }
+        filterRow(row,
+                  d->hasPrevious ? reinterpret_cast<const uchar*>(d->previousRow.constData()) : nullptr,
+                  rowBytes,
+                  reinterpret_cast<uchar*>(d->filtered.data()),
+                  reinterpret_cast<uchar*>(d->scratch.data()));
+
+        if (!deflateRows(reinterpret_cast<const uchar*>(d->filtered.constData()), rowBytes + 1, false)) {
+            return false;
+        }
+
+        std::memcpy(d->previousRow.data(), row, rowBytes);
+        d->hasPrevious = true;
+    }
+
+    return true;
+}
+
+bool PngStripEncoder::finish()
+{
+    if (!deflateRows(nullptr, 0, true)) {
+        return false;
+    }
+
+    deflateEnd(&d->stream);
+    d->streamOpen = false;
+
+    return writeChunk("IEND", QByteArray());
+}
+
+bool PngStripEncoder::deflateRows(const uchar* data, int length, bool last)
+{
+    d->stream.next_in = const_cast<Bytef*>(data);
+    d->stream.avail_in = uInt(length);
+
+    const int flush = last ? Z_FINISH : Z_NO_FLUSH;
+    for (;;) {
+        const int result = deflate(&d->stream, flush);
+        if (result == Z_STREAM_ERROR) {
+            qWarning() << "deflate failed";
+            return false;
+        }
+
+        // Output buffer persists across calls, IDAT chunks are only written when it is full
+        if (d->stream.avail_out == 0) {
+            if (!writeChunk("IDAT", d->output)) {
+                return false;
+            }
+            d->stream.next_out = reinterpret_cast<Bytef*>(d->output.data());
+            d->stream.avail_out = uInt(d->output.size());
+            continue;
+        }
+
+        if (!last) {
+            return true;
+        }
+
+        if (result == Z_STREAM_END) {
+            const int pending = d->output.size() - int(d->stream.avail_out);
+            return pending == 0
+                   || writeChunk("IDAT", QByteArray::fromRawData(d->output.constData(), pending));
+        }
+
+        if (result == Z_BUF_ERROR) {
+            qWarning() << "deflate could not make progress";
+            return false;
+        }
+    }
+}
+
+bool PngStripEncoder::writeChunk(const char* type, const QByteArray& data)
+{
+    uchar length[4];
+    qToBigEndian<quint32>(data.size(), length);
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data.constData()), uInt(data.size()));
+    uchar crcBytes[4];
+    qToBigEndian<quint32>(quint32(crc), crcBytes);
+
+    return d->device->write(reinterpret_cast<const char*>(length), 4) == 4
+           && d->device->write(type, 4) == 4
+           && d->device->write(data) == data.size()
+           && d->device->write(reinterpret_cast<const char*>(crcBytes), 4) == 4;
+}
+
+#endif // QUICKEDITS_HAVE_ZLIB
+
+bool BmpStripEncoder::begin(QIODevice* device, const QSize& size)
+{
+    m_device = device;
+    m_size = size;
+
+    const int rowBytes = (size.width() * 3 + 3) & ~3;
+    const quint32 imageBytes = quint32(rowBytes) * quint32(size.height());
+    m_row = QByteArray(rowBytes, '\0');
+    m_flattened.resize(size.width());
+
+    QByteArray header(54, '\0');
+    char* h = header.data();
+    h[0] = 'B';
+    h[1] = 'M';
+    qToLittleEndian<quint32>(54 + imageBytes, h + 2);
+    qToLittleEndian<quint32>(54, h + 10);           // pixel data offset
+    qToLittleEndian<quint32>(40, h + 14);           // BITMAPINFOHEADER
+    qToLittleEndian<qint32>(size.width(), h + 18);
+    qToLittleEndian<qint32>(-size.height(), h + 22); // negative height means top-down rows
+    qToLittleEndian<quint16>(1, h + 26);
+    qToLittleEndian<quint16>(24, h + 28);
+    qToLittleEndian<quint32>(imageBytes, h + 34);
+    qToLittleEndian<qint32>(2835, h + 38);          // 72 dpi
+    qToLittleEndian<qint32>(2835, h + 42);
+
+    return device->write(header) == header.size();
+}
+
+bool BmpStripEncoder::writeStrip(const QImage& strip)
+{
+    const bool opaque = strip.format() == QImage::Format_RGB32;
+    const QImage source = opaque || strip.format() == QImage::Format_ARGB32_Premultiplied
+                              ? strip
+                              : strip.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    for (int y = 0; y < source.height(); ++y) {
+        const QRgb* src = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        if (!opaque) {
+            PixelKernels::flattenOverMatte(src, m_flattened.data(), m_size.width(), m_matte);
+            src = m_flattened.constData();
+        }
+        // The padding bytes at the end of the row stay zero
+        PixelKernels::packRgb888(src, reinterpret_cast<uchar*>(m_row.data()), m_size.width(), true);
+        if (m_device->write(m_row) != m_row.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool BmpStripEncoder::finish()
+{
+    return true;
+}
+
+ImageWriterStripEncoder::ImageWriterStripEncoder(const QByteArray& format)
+    : m_format(format)
+{
+}
+
+bool ImageWriterStripEncoder::begin(QIODevice* device, const QSize& size)
+{
+    m_device = device;
+    m_nextRow = 0;
+    // JPEG has no alpha channel, its frame is flattened over the matte while strips arrive
+    const bool opaque = m_format == "JPG" || m_format == "JPEG";
+    m_frame = QImage(size, opaque ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied);
+    return !m_frame.isNull();
+}
+
+bool ImageWriterStripEncoder::writeStrip(const QImage& strip)
+{
+    const bool flatten = m_frame.format() == QImage::Format_RGB32 && strip.format() != QImage::Format_RGB32;
+    const QImage::Format sourceFormat = flatten ? QImage::Format_ARGB32_Premultiplied : m_frame.format();
+    const QImage source = strip.format() == sourceFormat ? strip : strip.convertToFormat(sourceFormat);
+    const int rowBytes = m_frame.width() * 4;
+
+    for (int y = 0; y < source.height() && m_nextRow < m_frame.height(); ++y, ++m_nextRow) {
+        if (flatten) {
+            PixelKernels::flattenOverMatte(reinterpret_cast<const QRgb*>(source.constScanLine(y)),
+                                           reinterpret_cast<QRgb*>(m_frame.scanLine(m_nextRow)),
+                                           m_frame.width(), m_matte);
+        } else {
+            std::memcpy(m_frame.scanLine(m_nextRow), source.constScanLine(y), rowBytes);
+        }
+    }
+
+    return true;
+}
+
+bool ImageWriterStripEncoder::finish()
+{
+    QImageWriter writer(m_device, m_format);
+    writer.setQuality(m_quality);
+    bool ok = writer.write(m_frame);
+    if (!ok) {
+        qWarning() << "Failed to encode" << m_format << ":" << writer.errorString();
+    }
+    m_frame = QImage();
+    return ok;
+}
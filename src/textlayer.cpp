@@ -0,0 +1,196 @@
+#include "textlayer.h"
+#include "tracer.h"
+#include <QFontMetricsF>
+#include <QGuiApplication>
+#include <QGlyphRun>
+#include <QQuickWindow>
+#include <QRawFont>
+#include <QSGTextNode>
+#include <QTextLayout>
+#include <QDebug>
+
+TextLayer::TextLayer(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_color(Qt::black)
+    , m_layoutWidth(-1)
+    , m_layoutDirty(true)
+    , m_nodeDirty(true)
+{
+    setFlag(ItemHasContents, true);
+    connect(qGuiApp, &QGuiApplication::fontDatabaseChanged, this, &TextLayer::fontDatabaseChanged);
+}
+
+TextLayer::~TextLayer() = default;
+
+void TextLayer::setText(const QString& text)
+{
+    if (text == m_text) {
+        return;
+    }
+    m_text = text;
+    invalidateLayout();
+    emit textChanged();
+}
+
+void TextLayer::setFont(const QFont& font)
+{
+    // Font aliases assign the whole font for every sub property, most of them change nothing
+    if (font == m_font) {
+        return;
+    }
+    m_font = font;
+    invalidateLayout();
+    emit fontChanged();
+}
+
+void TextLayer::setColor(const QColor& color)
+{
+    if (color == m_color) {
+        return;
+    }
+    // Only the node's color changes, the glyphs stay as they are
+    m_color = color;
+    m_nodeDirty = true;
+    update();
+    emit colorChanged();
+}
+
+void TextLayer::invalidateLayout()
+{
+    m_layoutDirty = true;
+    polish();
+}
+
+void TextLayer::fontDatabaseChanged()
+{
+    // The cached layout still holds the glyphs of the font it resolved to before
+    m_layout.reset();
+    m_nodeDirty = true;
+    invalidateLayout();
+}
+
+void TextLayer::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    // Height only clips, the lines only move when the wrap width does
+    if (newGeometry.width() != m_layoutWidth) {
+        invalidateLayout();
+    }
+}
+
+void TextLayer::layoutText(QTextLayout& layout, const QString& text, qreal width)
+{
+    // Same line breaking as Text.Wrap, QTextLayout wants line separators instead of newlines
+    QString display = text;
+    display.replace(QLatin1Char('\n'), QChar::LineSeparator);
+    layout.setText(display);
+
+    QTextOption option;
+    option.setWrapMode(QTextOption::WrapAtWordBoundaryOrAnywhere);
+    option.setUseDesignMetrics(false);
+    layout.setTextOption(option);
+    layout.setCacheEnabled(true);
+
+    qreal y = 0;
+    layout.beginLayout();
+    for (QTextLine line = layout.createLine(); line.isValid(); line = layout.createLine()) {
+        line.setLineWidth(qMax<qreal>(0, width));
+        line.setPosition(QPointF(0, y));
+        y += line.height();
+    }
+    layout.endLayout();
+}
+
+TextLayer::Outline TextLayer::outline(const QString& text, const QFont& font, qreal width)
+{
+    TRACE_SCOPE("export", "text outline");
+    QTextLayout layout;
+    layout.setFont(font);
+    layoutText(layout, text, width);
+
+    Outline outline;
+    outline.glyphs.setFillRule(Qt::WindingFill);
+    const QFontMetricsF metrics(font);
+    const qreal thickness = qMax<qreal>(1.0, metrics.lineWidth());
+
+    const QList<QGlyphRun> runs = layout.glyphRuns();
+    for (const QGlyphRun& run : runs) {
+        const QRawFont rawFont = run.rawFont();
+        const QList<quint32> indexes = run.glyphIndexes();
+        const QList<QPointF> positions = run.positions();
+        for (qsizetype i = 0; i < indexes.size(); ++i) {
+            QPainterPath glyph = rawFont.pathForGlyph(indexes.at(i));
+            glyph.translate(positions.at(i));
+            outline.glyphs.addPath(glyph);
+        }
+
+        if (positions.isEmpty() || !(run.underline() || run.strikeOut() || run.overline())) {
+            continue;
+        }
+        // Bars span the run at its baseline, where QPainter would draw them
+        const QRectF bounds = run.boundingRect();
+        const qreal baseline = positions.first().y();
+        if (run.underline()) {
+            outline.decorations.append(QRectF(bounds.left(), baseline + metrics.underlinePos(), bounds.width(), thickness));
+        }
+        if (run.strikeOut()) {
+            outline.decorations.append(QRectF(bounds.left(), baseline - metrics.strikeOutPos(), bounds.width(), thickness));
+        }
+        if (run.overline()) {
+            outline.decorations.append(QRectF(bounds.left(), baseline - metrics.overlinePos(), bounds.width(), thickness));
+        }
+    }
+
+    return outline;
+}
+
+void TextLayer::updatePolish()
+{
+    if (!m_layoutDirty) {
+        return;
+    }
+
+    TRACE_SCOPE("text", "shape text layer");
+    if (!m_layout) {
+        m_layout = std::make_unique<QTextLayout>();
+    }
+    m_layout->setFont(m_font);
+    m_layoutWidth = width();
+    layoutText(*m_layout, m_text, m_layoutWidth);
+
+    const QRectF bounds = m_layout->boundingRect();
+    setImplicitSize(bounds.width(), bounds.height());
+
+    m_layoutDirty = false;
+    m_nodeDirty = true;
+    update();
+}
+
+QSGNode* TextLayer::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data)
+{
+    Q_UNUSED(data)
+
+    QSGTextNode* node = static_cast<QSGTextNode*>(oldNode);
+    if (!m_layout || m_text.isEmpty()) {
+        delete node;
+        m_nodeDirty = true;
+        return nullptr;
+    }
+
+    if (!node) {
+        node = window()->createTextNode();
+        m_nodeDirty = true;
+    }
+
+    if (m_nodeDirty) {
+        // Distance field glyphs come from the shared glyph cache and scale with the
+        // canvas zoom, rebuilding the node only copies already shaped glyph runs
+        node->clear();
+        node->setRenderType(QSGTextNode::QtRendering);
+        node->setColor(m_color);
+        node->addTextLayout(QPointF(0, 0), m_layout.get());
+        m_nodeDirty = false;
+    }
+
+    return node;
+}
@@ -0,0 +1,443 @@
+#include "tiledimage.h"
+#include "tracer.h"
+#include "imagecache.h"
+#include <QLineF>
+#include <QQuickWindow>
+#include <QRunnable>
+#include <QSGSimpleTextureNode>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const int DefaultTileSize = 512;
+
+#ifdef Q_OS_WASM
+const qint64 DefaultTextureBudget = 96ll * 1024 * 1024;
+#else
+const qint64 DefaultTextureBudget = 256ll * 1024 * 1024;
+#endif
+
+// Tiles carry one extra pixel on each side so linear filtering does not show seams
+const int TileBorder = 1;
+
+class TileCleanupJob : public QRunnable
+{
+public:
+    explicit TileCleanupJob(const QList<QSGNode*>& nodes)
+        : m_nodes(nodes)
+    {
+    }
+
+    void run() override
+    {
+        qDeleteAll(m_nodes);
+    }
+
+private:
+    QList<QSGNode*> m_nodes;
+};
+}
+
+TiledImage::TiledImage(QQuickItem *parent)
+    : QQuickItem(parent)
+    , m_status(Null)
+    , m_tileSize(DefaultTileSize)
+    , m_textureBudget(DefaultTextureBudget)
+    , m_maxLevel(0)
+    , m_generation(0)
+    , m_targetLevel(-1)
+    , m_clearNodes(false)
+    , m_frame(0)
+{
+    setFlag(ItemHasContents, true);
+    m_loadPool.setMaxThreadCount(2);
+}
+
+TiledImage::~TiledImage()
+{
+    m_loadPool.clear();
+    m_loadPool.waitForDone();
+    if (window()) {
+        releaseResources();
+    }
+}
+
+void TiledImage::setSource(const QUrl& source)
+{
+    if (m_source == source) {
+        return;
+    }
+
+    m_source = source;
+    reset();
+
+    QSize size = source.isEmpty() ? QSize() : ImageCache::instance()->imageSize(source);
+    if (size != m_imageSize) {
+        m_imageSize = size;
+        setImplicitSize(size.width(), size.height());
+        emit imageSizeChanged();
+    }
+
+    m_maxLevel = 0;
+    if (m_imageSize.isValid()) {
+        while (levelSize(m_maxLevel).width() > m_tileSize || levelSize(m_maxLevel).height() > m_tileSize) {
+            ++m_maxLevel;
+        }
+    }
+
+    if (source.isEmpty()) {
+        setStatus(Null);
+    } else if (!m_imageSize.isValid()) {
+        qWarning() << "Could not read image size for" << source.toString().left(64);
+        setStatus(Error);
+    } else {
+        setStatus(Loading);
+    }
+
+    emit sourceChanged();
+    updateVisibleTiles();
+    update();
+}
+
+void TiledImage::setViewport(QQuickItem* viewport)
+{
+    if (m_viewport == viewport) {
+        return;
+    }
+    m_viewport = viewport;
+    emit viewportChanged();
+    updateVisibleTiles();
+}
+
+void TiledImage::setTileSize(int tileSize)
+{
+    tileSize = qMax(64, tileSize);
+    if (m_tileSize == tileSize) {
+        return;
+    }
+    m_tileSize = tileSize;
+    emit tileSizeChanged();
+
+    // Tile keys depend on the tile size, start over with the same source
+    QUrl source = m_source;
+    m_source = QUrl();
+    setSource(source);
+}
+
+void TiledImage::setTextureBudget(qint64 bytes)
+{
+    if (m_textureBudget == bytes) {
+        return;
+    }
+    m_textureBudget = bytes;
+    emit textureBudgetChanged();
+    update();
+}
+
+void TiledImage::setStatus(Status status)
+{
+    if (m_status == status) {
+        return;
+    }
+    m_status = status;
+    emit statusChanged();
+}
+
+void TiledImage::reset()
+{
+    // Loads still in flight carry the old generation and are dropped when they land
+    ++m_generation;
+    m_drawList.clear();
+    m_loadQueue.clear();
+    m_loading.clear();
+    m_pendingUploads.clear();
+    m_resident.clear();
+    m_visibleRect = QRectF();
+    m_targetLevel = -1;
+    m_clearNodes = true;
+}
+
+QSize TiledImage::levelSize(int level) const
+{
+    // Same rounding as the mip levels in ImageCache
+    QSize size = m_imageSize;
+    for (int i = 0; i < level; ++i) {
+        size = QSize((size.width() + 1) / 2, (size.height() + 1) / 2);
+    }
+    return size;
+}
+
+QRect TiledImage::tilePixelRect(const TileKey& key) const
+{
+    QRect bounds(QPoint(0, 0), levelSize(key.level));
+    return QRect(key.x * m_tileSize, key.y * m_tileSize, m_tileSize, m_tileSize) & bounds;
+}
+
+QRectF TiledImage::tileItemRect(const TileKey& key) const
+{
+    QSize size = levelSize(key.level);
+    qreal scaleX = width() / size.width();
+    qreal scaleY = height() / size.height();
+    QRect rect = tilePixelRect(key);
+    return QRectF(rect.x() * scaleX, rect.y() * scaleY, rect.width() * scaleX, rect.height() * scaleY);
+}
+
+void TiledImage::updateVisibleTiles()
+{
+    if (!window() || !m_imageSize.isValid() || width() <= 0 || height() <= 0 || m_status == Error) {
+        return;
+    }
+
+    QQuickItem* viewportItem = m_viewport ? m_viewport.data() : window()->contentItem();
+    QRectF visible = mapRectFromItem(viewportItem, viewportItem->boundingRect()) & boundingRect();
+
+    // Screen pixels per image pixel, including zoom, rotation and device pixel ratio
+    QLineF unit(mapToScene(QPointF(0, 0)), mapToScene(QPointF(1, 0)));
+    qreal screenPerPixel = unit.length() * window()->effectiveDevicePixelRatio() * width() / m_imageSize.width();
+
+    int level = 0;
+    if (screenPerPixel > 0 && screenPerPixel < 1) {
+        level = int(std::floor(std::log2(1 / screenPerPixel)));
+    }
+    level = qBound(0, level, m_maxLevel);
+
+    if (visible == m_visibleRect && level == m_targetLevel) {
+        return;
+    }
+    m_visibleRect = visible;
+    m_targetLevel = level;
+
+    auto tilesForLevel = [this, &visible](int tileLevel) {
+        QList<TileKey> keys;
+        if (visible.isEmpty()) {
+            return keys;
+        }
+        QSize size = levelSize(tileLevel);
+        qreal scaleX = size.width() / width();
+        qreal scaleY = size.height() / height();
+        int lastX = (size.width() - 1) / m_tileSize;
+        int lastY = (size.height() - 1) / m_tileSize;
+        int x0 = qBound(0, int(visible.left() * scaleX) / m_tileSize, lastX);
+        int x1 = qBound(0, int(std::ceil(visible.right() * scaleX) - 1) / m_tileSize, lastX);
+        int y0 = qBound(0, int(visible.top() * scaleY) / m_tileSize, lastY);
+        int y1 = qBound(0, int(std::ceil(visible.bottom() * scaleY) - 1) / m_tileSize, lastY);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                keys.append(TileKey{tileLevel, x, y});
+            }
+        }
+        return keys;
+    };
+
+    // Coarser levels are drawn first and show through until the sharp tiles arrive
+    QList<TileKey> coarsest = tilesForLevel(m_maxLevel);
+    QList<TileKey> target = level == m_maxLevel ? QList<TileKey>() : tilesForLevel(level);
+
+    m_drawList = coarsest;
+    if (level + 1 < m_maxLevel) {
+        m_drawList += tilesForLevel(level + 1);
+    }
+    m_drawList += target;
+
+    // Load the overview first, then the target level from the center of the view outwards
+    QPointF center = visible.center();
+    std::sort(target.begin(), target.end(), [this, &center](const TileKey& a, const TileKey& b) {
+        QPointF da = tileItemRect(a).center() - center;
+        QPointF db = tileItemRect(b).center() - center;
+        return QPointF::dotProduct(da, da) < QPointF::dotProduct(db, db);
+    });
+
+    m_loadQueue.clear();
+    for (const TileKey& key : coarsest + target) {
+        if (!m_resident.contains(key) && !m_pendingUploads.contains(key) && !m_loading.contains(key)) {
+            m_loadQueue.append(key);
+        }
+    }
+
+    scheduleLoads();
+    update();
+}
+
+void TiledImage::scheduleLoads()
+{
+    while (m_loading.size() < m_loadPool.maxThreadCount() && !m_loadQueue.isEmpty()) {
+        TileKey key = m_loadQueue.takeFirst();
+        if (m_resident.contains(key) || m_pendingUploads.contains(key) || m_loading.contains(key)) {
+            continue;
+        }
+        m_loading.insert(key);
+
+        QRect levelRect(QPoint(0, 0), levelSize(key.level));
+        QRect rect = tilePixelRect(key).adjusted(-TileBorder, -TileBorder, TileBorder, TileBorder) & levelRect;
+        quint64 generation = m_generation;
+        QUrl source = m_source;
+
+        m_loadPool.start([this, generation, source, key, rect]() {
+            TRACE_SCOPE("image", "load tile");
+            QImage tile;
+            if (key.level == 0) {
+                // The full image may be far larger than the cache, only its tiles are needed
+                tile = ImageCache::instance()->region(source, rect);
+            } else {
+                QImage level = ImageCache::instance()->image(source, key.level);
+                tile = level.isNull() ? QImage() : level.copy(rect);
+            }
+            QMetaObject::invokeMethod(this, [this, generation, key, tile]() {
+                tileLoaded(generation, key, tile);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void TiledImage::tileLoaded(quint64 generation, const TileKey& key, const QImage& image)
+{
+    if (generation != m_generation) {
+        return;
+    }
+    m_loading.remove(key);
+
+    if (image.isNull()) {
+        if (m_status == Loading) {
+            setStatus(Error);
+        }
+        return;
+    }
+
+    if (m_drawList.contains(key)) {
+        m_pendingUploads.insert(key, image);
+        update();
+    }
+
+    if (key.level == m_maxLevel && m_status == Loading) {
+        setStatus(Ready);
+    }
+
+    scheduleLoads();
+}
+
+QSGNode* TiledImage::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data)
+{
+    Q_UNUSED(data)
+
+    QSGNode* root = oldNode ? oldNode : new QSGNode;
+
+    // Detach everything, nodes are re-appended below in draw order
+    root->removeAllChildNodes();
+
+    if (m_clearNodes) {
+        for (const TileNode& tile : std::as_const(m_nodes)) {
+            delete tile.node;
+        }
+        m_nodes.clear();
+        m_clearNodes = false;
+    }
+
+    ++m_frame;
+
+    for (auto it = m_pendingUploads.constBegin(); it != m_pendingUploads.constEnd(); ++it) {
+        QSGTexture* texture = window()->createTextureFromImage(it.value());
+        if (!texture) {
+            continue;
+        }
+
+        QRect inner = tilePixelRect(it.key());
+        QRect bordered = inner.adjusted(-TileBorder, -TileBorder, TileBorder, TileBorder)
+                         & QRect(QPoint(0, 0), levelSize(it.key().level));
+
+        auto node = new QSGSimpleTextureNode;
+        node->setTexture(texture);
+        node->setOwnsTexture(true);
+        node->setFiltering(QSGTexture::Linear);
+        node->setSourceRect(inner.translated(-bordered.topLeft()));
+
+        TileNode& tile = m_nodes[it.key()];
+        delete tile.node;
+        tile.node = node;
+        tile.bytes = qint64(it.value().width()) * it.value().height() * 4;
+        m_resident.insert(it.key());
+    }
+    m_pendingUploads.clear();
+
+    qint64 totalBytes = 0;
+    for (auto it = m_nodes.begin(); it != m_nodes.end(); ++it) {
+        totalBytes += it->bytes;
+    }
+
+    for (const TileKey& key : std::as_const(m_drawList)) {
+        auto it = m_nodes.find(key);
+        if (it == m_nodes.end()) {
+            continue;
+        }
+        it->node->setRect(tileItemRect(key));
+        it->lastUsed = m_frame;
+        root->appendChildNode(it->node);
+    }
+
+    // Off-screen tiles stay uploaded for quick panning back, until the budget runs out
+    if (totalBytes > m_textureBudget) {
+        QList<TileKey> idle;
+        for (auto it = m_nodes.constBegin(); it != m_nodes.constEnd(); ++it) {
+            if (it->lastUsed != m_frame) {
+                idle.append(it.key());
+            }
+        }
+        std::sort(idle.begin(), idle.end(), [this](const TileKey& a, const TileKey& b) {
+            return m_nodes.value(a).lastUsed < m_nodes.value(b).lastUsed;
+        });
+
+        for (const TileKey& key : std::as_const(idle)) {
+            if (totalBytes <= m_textureBudget) {
+                break;
+            }
+            TileNode tile = m_nodes.take(key);
+            totalBytes -= tile.bytes;
+            delete tile.node;
+            m_resident.remove(key);
+        }
+    }
+
+    return root;
+}
+
+void TiledImage::releaseResources()
+{
+    // Nodes in the tree go with the root, detached ones have to be deleted on the render thread
+    QList<QSGNode*> detached;
+    for (const TileNode& tile : std::as_const(m_nodes)) {
+        if (!tile.node->parent()) {
+            detached.append(tile.node);
+        }
+    }
+    m_nodes.clear();
+    m_resident.clear();
+    m_visibleRect = QRectF();
+    m_targetLevel = -1;
+
+    if (!detached.isEmpty()) {
+        window()->scheduleRenderJob(new TileCleanupJob(detached), QQuickWindow::BeforeSynchronizingStage);
+    }
+}
+
+void TiledImage::itemChange(ItemChange change, const ItemChangeData& value)
+{
+    if (change == ItemSceneChange) {
+        disconnect(m_frameConnection);
+        if (value.window) {
+            // Zoom and pan move transforms above this item, re-check the viewport every frame
+            m_frameConnection = connect(value.window, &QQuickWindow::afterAnimating,
+                                        this, &TiledImage::updateVisibleTiles);
+        }
+    }
+    QQuickItem::itemChange(change, value);
+}
+
+void TiledImage::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry)
+{
+    QQuickItem::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        m_visibleRect = QRectF();
+        updateVisibleTiles();
+        update();
+    }
+}
@@ -0,0 +1,259 @@
+#include "tracer.h"
+#include "imageexporter.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QMutexLocker>
+#include <QQuickWindow>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+
+namespace {
+// Upper bound on recorded events, 48 bytes each
+#ifdef Q_OS_WASM
+const size_t MaxEvents = 250000;
+#else
+const size_t MaxEvents = 2000000;
+#endif
+
+// eventCount notifications while recording, a few per second are enough for a readout
+const int CountUpdateInterval = 250;
+
+void appendEscaped(QByteArray& json, const QByteArray& text)
+{
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+        }
+        json += c;
+    }
+}
+}
+
+std::atomic<bool> Tracer::s_enabled(false);
+
+Tracer::Tracer(QObject *parent)
+    : QObject(parent)
+    , m_frameStart(-1)
+    , m_lastSwap(-1)
+    , m_countUpdateQueued(false)
+{
+    m_clock.start();
+
+    // QUICKEDITS_TRACE=1 records from startup, useful for tracing the first load
+    if (qEnvironmentVariableIntValue("QUICKEDITS_TRACE") != 0) {
+        s_enabled = true;
+    }
+}
+
+Tracer* Tracer::create(QQmlEngine *qmlEngine, QJSEngine *jsEngine)
+{
+    Q_UNUSED(qmlEngine)
+    Q_UNUSED(jsEngine)
+    QJSEngine::setObjectOwnership(instance(), QJSEngine::CppOwnership);
+    return instance();
+}
+
+Tracer* Tracer::instance()
+{
+    // Spans can start on any thread, a function local static is initialized exactly once
+    static Tracer* tracer = []() {
+        Tracer* instance = new Tracer();
+        // The count notification is timed on the GUI thread, whichever thread traced first
+        if (QCoreApplication::instance() && instance->thread() != QCoreApplication::instance()->thread()) {
+            instance->moveToThread(QCoreApplication::instance()->thread());
+        }
+        return instance;
+    }();
+    return tracer;
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (s_enabled.exchange(enabled) == enabled) {
+        return;
+    }
+    qDebug() << "Tracing" << (enabled ? "enabled" : "disabled");
+    emit enabledChanged();
+    emit eventCountChanged();
+}
+
+int Tracer::eventCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_events.size());
+}
+
+int Tracer::threadIndex()
+{
+    // Called with m_mutex held
+    quintptr id = quintptr(QThread::currentThreadId());
+    auto it = m_threads.constFind(id);
+    if (it != m_threads.constEnd()) {
+        return it.value();
+    }
+    int index = int(m_threads.size());
+    m_threads.insert(id, index);
+    // Pool threads share one object name, the index tells them apart
+    QThread* thread = QThread::currentThread();
+    QByteArray name = thread == QCoreApplication::instance()->thread() ? QByteArray("Main")
+                      : (thread->objectName().isEmpty() ? QByteArray("Thread") : thread->objectName().toUtf8())
+                        + " " + QByteArray::number(index);
+    m_threadNames.append(name);
+    return index;
+}
+
+void Tracer::append(const Event& event)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_events.size() >= MaxEvents) {
+            return;
+        }
+        m_events.push_back(event);
+        m_events.back().thread = threadIndex();
+    }
+    scheduleCountUpdate();
+}
+
+void Tracer::scheduleCountUpdate()
+{
+    // Events arrive from every thread, at most one notification per interval
+    if (m_countUpdateQueued.exchange(true)) {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this]() {
+        QTimer::singleShot(CountUpdateInterval, this, [this]() {
+            m_countUpdateQueued = false;
+            emit eventCountChanged();
+        });
+    }, Qt::QueuedConnection);
+}
+
+void Tracer::addSpan(const char* category, const char* name, qint64 startUs, qint64 durationUs)
+{
+    if (isEnabled()) {
+        append({ category, name, startUs, durationUs, 0, 0 });
+    }
+}
+
+void Tracer::addCounter(const char* name, qint64 value)
+{
+    if (isEnabled()) {
+        append({ "counter", name, now(), -1, value, 0 });
+    }
+}
+
+void Tracer::attachWindow(QQuickWindow* window)
+{
+    if (!window || window == m_window) {
+        return;
+    }
+    if (m_window) {
+        m_window->disconnect(this);
+    }
+    m_window = window;
+
+    // These are emitted on the render thread, direct connections keep the timing exact
+    connect(window, &QQuickWindow::beforeFrameBegin, this, [this]() {
+        if (isEnabled()) {
+            m_frameStart = now();
+        }
+    }, Qt::DirectConnection);
+
+    connect(window, &QQuickWindow::afterFrameEnd, this, [this]() {
+        qint64 start = m_frameStart.exchange(-1);
+        if (start >= 0 && isEnabled()) {
+            addSpan("frame", "render frame", start, now() - start);
+        }
+    }, Qt::DirectConnection);
+
+    connect(window, &QQuickWindow::frameSwapped, this, [this]() {
+        if (!isEnabled()) {
+            m_lastSwap = -1;
+            return;
+        }
+        qint64 swap = now();
+        if (m_lastSwap >= 0) {
+            addCounter("frame interval (us)", swap - m_lastSwap);
+        }
+        m_lastSwap = swap;
+    }, Qt::DirectConnection);
+}
+
+QByteArray Tracer::toJson() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Written by hand, a few million events through QJsonDocument would take seconds
+    QByteArray json;
+    json.reserve(qsizetype(m_events.size()) * 96 + 256);
+    json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    for (qsizetype i = 0; i < m_threadNames.size(); ++i) {
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(i)
+                + ",\"args\":{\"name\":\"";
+        appendEscaped(json, m_threadNames.at(i));
+        json += "\"}},\n";
+    }
+
+    for (const Event& event : m_events) {
+        json += "{\"name\":\"";
+        appendEscaped(json, event.name);
+        if (event.duration < 0) {
+            json += "\",\"ph\":\"C\",\"args\":{\"value\":" + QByteArray::number(event.value) + '}';
+        } else {
+            json += "\",\"cat\":\"";
+            appendEscaped(json, event.category);
+            json += "\",\"ph\":\"X\",\"dur\":" + QByteArray::number(event.duration);
+        }
+        json += ",\"ts\":" + QByteArray::number(event.start) + ",\"pid\":1,\"tid\":"
+                + QByteArray::number(event.thread) + "},\n";
+    }
+
+    if (json.endsWith(",\n")) {
+        json.chop(2);
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+void Tracer::clear()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_events.clear();
+    }
+    emit eventCountChanged();
+}
+
+bool Tracer::save(const QUrl& fileUrl)
+{
+    QString filePath = fileUrl.isLocalFile() ? fileUrl.toLocalFile() : fileUrl.toString();
+    QByteArray json = toJson();
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        qWarning() << "Failed to write trace" << filePath << ":" << file.errorString();
+        return false;
+    }
+
+    qDebug() << "Trace written to" << filePath << "with" << eventCount() << "events";
+    emit traceSaved(filePath);
+    return true;
+}
+
+void Tracer::dump()
+{
+    QString fileName = "quickedits-trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+#ifdef Q_OS_WASM
+    ImageExporter::instance()->downloadData(toJson(), fileName, "application/json");
+    emit traceSaved(fileName);
+#else
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
+    save(QUrl::fromLocalFile(QDir(directory).filePath(fileName)));
+#endif
+}
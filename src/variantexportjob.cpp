@@ -0,0 +1,216 @@
+#include "variantexportjob.h"
+#include "jobscheduler.h"
+#include "resampler.h"
+#include "stripencoder.h"
+#include "ziparchive.h"
+#include "tracer.h"
+#include <QBuffer>
+#include <QDir>
+#include <QSaveFile>
+#include <QDebug>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+const int DefaultStripHeight = 128;
+// Share of the progress bar taken by compositing, the rest goes to the variants
+const qreal CompositeShare = 0.5;
+}
+
+VariantExportJob::VariantExportJob(const SceneDescription& scene, const QList<ExportVariant>& variants, QObject *parent)
+    : QObject(parent)
+    , m_scene(scene)
+    , m_variants(variants)
+    , m_matte(0xffffffff)
+    , m_archiveAllocation(MemoryBudget::ExportBuffers)
+    , m_cancelled(false)
+    , m_stripHeight(DefaultStripHeight)
+{
+    m_coordinatorPool.setMaxThreadCount(1);
+    m_workerPool.setMaxThreadCount(JobScheduler::instance()->workerCount());
+}
+
+VariantExportJob::~VariantExportJob()
+{
+    cancel();
+    m_coordinatorPool.waitForDone();
+    m_workerPool.waitForDone();
+}
+
+void VariantExportJob::setOutputDirectory(const QString& directory)
+{
+    m_directory = directory;
+}
+
+void VariantExportJob::setMatteColor(QRgb matte)
+{
+    m_matte = matte;
+}
+
+void VariantExportJob::start()
+{
+    m_coordinatorPool.start([this]() {
+        bool success = run();
+        emit finished(success && !m_cancelled);
+    });
+}
+
+void VariantExportJob::cancel()
+{
+    m_cancelled = true;
+}
+
+bool VariantExportJob::run()
+{
+    TRACE_SCOPE("export", "export variants");
+    if (!m_scene.isValid() || m_variants.isEmpty()) {
+        return false;
+    }
+
+    // Largest first, each variant is resampled from the one before it
+    std::vector<int> order(m_variants.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        const QSize sa = m_variants.at(a).size;
+        const QSize sb = m_variants.at(b).size;
+        return qint64(sa.width()) * sa.height() > qint64(sb.width()) * sb.height();
+    });
+
+    const QSize largest = m_variants.at(order.front()).size;
+    if (largest.isEmpty()) {
+        return false;
+    }
+
+    SceneCompositor compositor(m_scene);
+    if (!compositor.prepare(largest)) {
+        return false;
+    }
+
+    // The full composite plus the variant being resampled from it
+    MemoryBudget::Allocation compositeAllocation(MemoryBudget::ExportBuffers, qint64(largest.width()) * largest.height() * 4 * 2);
+    QImage current = composite(compositor, largest);
+    if (current.isNull() || m_cancelled) {
+        return false;
+    }
+    emit progressChanged(CompositeShare);
+
+    m_encoded.assign(m_variants.size(), QByteArray());
+    std::vector<char> encoded(m_variants.size(), 0);
+    std::atomic<int> done(0);
+    const int total = int(m_variants.size());
+
+    for (int index : order) {
+        const ExportVariant& variant = m_variants.at(index);
+        if (variant.size.isEmpty()) {
+            continue;
+        }
+        if (variant.size != current.size()) {
+            TRACE_SCOPE("export", "resample variant");
+            current = Resampler::resize(current, variant.size);
+        }
+        if (m_cancelled) {
+            break;
+        }
+
+        // The encoder gets its own reference, the cascade carries on with the next size meanwhile
+        const QImage image = current;
+        m_workerPool.start([this, index, image, &encoded, &done, total]() {
+            if (!m_cancelled) {
+                encoded[index] = encode(m_variants.at(index), image, &m_encoded[index]);
+            }
+            emit progressChanged(CompositeShare + (1.0 - CompositeShare) * (++done) / total);
+        });
+    }
+
+    // Tasks reference the local flags, let them drain before leaving
+    m_workerPool.waitForDone();
+    current = QImage();
+
+    if (m_cancelled) {
+        return false;
+    }
+    for (int i = 0; i < total; ++i) {
+        if (!encoded[i]) {
+            qWarning() << "Could not encode export variant:" << m_variants.at(i).fileName;
+            return false;
+        }
+    }
+
+    const bool success = writeOutput();
+    m_encoded.clear();
+    if (success) {
+        emit progressChanged(1.0);
+    }
+    return success;
+}
+
+QImage VariantExportJob::composite(const SceneCompositor& compositor, const QSize& size)
+{
+    TRACE_SCOPE("export", "composite");
+    QImage target(size, QImage::Format_ARGB32_Premultiplied);
+    if (target.isNull()) {
+        qWarning() << "Could not allocate export image of size" << size;
+        return QImage();
+    }
+    target.fill(Qt::transparent);
+
+    // Strips render straight into the shared frame, each through its own view on the rows
+    uchar* bits = target.bits();
+    const qsizetype bytesPerLine = target.bytesPerLine();
+    for (int y = 0; y < size.height(); y += m_stripHeight) {
+        const QRect region(0, y, size.width(), qMin(m_stripHeight, size.height() - y));
+        m_workerPool.start([this, &compositor, bits, bytesPerLine, region, size]() {
+            if (m_cancelled) {
+                return;
+            }
+            QImage view(bits + region.y() * bytesPerLine, region.width(), region.height(),
+                        bytesPerLine, QImage::Format_ARGB32_Premultiplied);
+            compositor.renderRegion(view, region, size);
+        });
+    }
+    m_workerPool.waitForDone();
+
+    return m_cancelled ? QImage() : target;
+}
+
+bool VariantExportJob::encode(const ExportVariant& variant, const QImage& image, QByteArray* data) const
+{
+    TRACE_SCOPE("export", "encode variant");
+    std::unique_ptr<StripEncoder> encoder = StripEncoder::create(variant.format);
+    encoder->setMatteColor(m_matte);
+    encoder->setQuality(variant.quality);
+
+    QBuffer buffer(data);
+    if (!buffer.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return encoder->begin(&buffer, image.size()) && encoder->writeStrip(image) && encoder->finish();
+}
+
+bool VariantExportJob::writeOutput()
+{
+    if (m_directory.isEmpty()) {
+        TRACE_SCOPE("export", "bundle variants");
+        ZipArchive archive;
+        for (qsizetype i = 0; i < m_variants.size(); ++i) {
+            if (!archive.addFile(m_variants.at(i).fileName, m_encoded[i])) {
+                return false;
+            }
+            m_encoded[i].clear();
+        }
+        m_archive = archive.finish();
+        m_archiveAllocation.resize(m_archive.size());
+        return true;
+    }
+
+    const QDir directory(m_directory);
+    for (qsizetype i = 0; i < m_variants.size(); ++i) {
+        const QString filePath = directory.filePath(m_variants.at(i).fileName);
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(m_encoded[i]) != m_encoded[i].size() || !file.commit()) {
+            qWarning() << "Could not write export file:" << filePath;
+            return false;
+        }
+    }
+    return true;
+}
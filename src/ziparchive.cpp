@@ -0,0 +1,128 @@
+#include "ziparchive.h"
+#include <QtEndian>
+#include <QDebug>
+#include <array>
+#include <utility>
+
+namespace {
+const quint32 LocalHeaderSignature = 0x04034b50;
+const quint32 CentralHeaderSignature = 0x02014b50;
+const quint32 EndOfDirectorySignature = 0x06054b50;
+const quint16 ZipVersion = 20;
+// Bit 11: file names are UTF-8
+const quint16 Utf8Flag = 0x0800;
+
+quint32 crc32(const QByteArray& data)
+{
+    static const std::array<quint32, 256> table = []() {
+        std::array<quint32, 256> t {};
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    quint32 crc = 0xffffffffu;
+    const uchar* bytes = reinterpret_cast<const uchar*>(data.constData());
+    for (qsizetype i = 0; i < data.size(); ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+void append16(QByteArray& out, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian<quint16>(value, bytes);
+    out.append(bytes, 2);
+}
+
+void append32(QByteArray& out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    out.append(bytes, 4);
+}
+}
+
+ZipArchive::ZipArchive()
+    : m_entries(0)
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const QDate date = now.date();
+    const QTime time = now.time();
+    m_dosTime = quint16((time.hour() << 11) | (time.minute() << 5) | (time.second() / 2));
+    m_dosDate = quint16(((qMax(1980, date.year()) - 1980) << 9) | (date.month() << 5) | date.day());
+}
+
+bool ZipArchive::addFile(const QString& name, const QByteArray& data)
+{
+    const QByteArray encodedName = name.toUtf8();
+    const qint64 offset = m_data.size();
+    if (offset + data.size() + encodedName.size() + 30 > 0xffffffffll || m_entries == 0xffff) {
+        qWarning() << "Zip archive too large for" << name;
+        return false;
+    }
+
+    const quint32 crc = crc32(data);
+
+    // Local file header followed by the stored bytes
+    append32(m_data, LocalHeaderSignature);
+    append16(m_data, ZipVersion);
+    append16(m_data, Utf8Flag);
+    append16(m_data, 0);                    // stored
+    append16(m_data, m_dosTime);
+    append16(m_data, m_dosDate);
+    append32(m_data, crc);
+    append32(m_data, quint32(data.size()));
+    append32(m_data, quint32(data.size()));
+    append16(m_data, quint16(encodedName.size()));
+    append16(m_data, 0);                    // no extra field
+    m_data.append(encodedName);
+    m_data.append(data);
+
+    append32(m_directory, CentralHeaderSignature);
+    append16(m_directory, ZipVersion);      // made by
+    append16(m_directory, ZipVersion);      // needed to extract
+    append16(m_directory, Utf8Flag);
+    append16(m_directory, 0);
+    append16(m_directory, m_dosTime);
+    append16(m_directory, m_dosDate);
+    append32(m_directory, crc);
+    append32(m_directory, quint32(data.size()));
+    append32(m_directory, quint32(data.size()));
+    append16(m_directory, quint16(encodedName.size()));
+    append16(m_directory, 0);               // extra field
+    append16(m_directory, 0);               // comment
+    append16(m_directory, 0);               // disk
+    append16(m_directory, 0);               // internal attributes
+    append32(m_directory, 0);               // external attributes
+    append32(m_directory, quint32(offset));
+    m_directory.append(encodedName);
+
+    ++m_entries;
+    return true;
+}
+
+QByteArray ZipArchive::finish()
+{
+    const quint32 directoryOffset = quint32(m_data.size());
+    m_data.append(m_directory);
+
+    append32(m_data, EndOfDirectorySignature);
+    append16(m_data, 0);                    // this disk
+    append16(m_data, 0);                    // disk with the directory
+    append16(m_data, m_entries);
+    append16(m_data, m_entries);
+    append32(m_data, quint32(m_directory.size()));
+    append32(m_data, directoryOffset);
+    append16(m_data, 0);                    // comment
+
+    m_directory.clear();
+    m_entries = 0;
+    return std::exchange(m_data, QByteArray());
+}
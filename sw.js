@@ -0,0 +1,83 @@
+// Keeps the build artifacts (QuickEdits.wasm, QuickEdits.js, qtloader.js, ...) in the Cache API,
+// keyed by content hash. deploy-pages.yml writes asset-manifest.json with the sha256 of every
+// artifact, so a visit only downloads what a new deployment actually changed. Serving the wasm
+// from here also lets the browser reuse its compiled code cache for compileStreaming.
+const CACHE = 'quickedits-artifacts';
+const MANIFEST = 'asset-manifest.json';
+const ARTIFACT = /\.(wasm|js|data)$/;
+
+let manifestPromise = null;
+
+self.addEventListener('install', () => {
+    self.skipWaiting();
+});
+
+self.addEventListener('activate', (event) => {
+    event.waitUntil(self.clients.claim());
+});
+
+// The manifest is tiny, always ask the network first and fall back to the last copy offline
+async function loadManifest() {
+    const cache = await caches.open(CACHE);
+    try {
+        const response = await fetch(MANIFEST, { cache: 'no-store' });
+        if (!response.ok) {
+            throw new Error(`HTTP ${response.status}`);
+        }
+        await cache.put(MANIFEST, response.clone());
+        return await response.json();
+    } catch (error) {
+        const cached = await cache.match(MANIFEST);
+        return cached ? cached.json() : {};
+    }
+}
+
+async function serveArtifact(request, name) {
+    if (!manifestPromise) {
+        manifestPromise = loadManifest();
+    }
+    const manifest = await manifestPromise;
+    const hash = manifest[name];
+    if (!hash) {
+        return fetch(request);
+    }
+
+    const cache = await caches.open(CACHE);
+    const key = `${name}?sha256=${hash}`;
+    const cached = await cache.match(key);
+    if (cached) {
+        return cached;
+    }
+
+    const response = await fetch(request, { cache: 'no-cache' });
+    if (response.ok) {
+        await cache.put(key, response.clone());
+        // Older builds of the same file are dead weight
+        const keys = await cache.keys();
+        await Promise.all(keys.filter((entry) => {
+            const url = new URL(entry.url);
+            return url.pathname.endsWith(`/${name}`) && url.search !== `?sha256=${hash}`;
+        }).map((entry) => cache.delete(entry)));
+    }
+    return response;
+}
+
+self.addEventListener('fetch', (event) => {
+    const request = event.request;
+    const url = new URL(request.url);
+    if (request.method !== 'GET' || url.origin !== self.location.origin) {
+        return;
+    }
+
+    // A new page load picks up a new deployment
+    if (request.mode === 'navigate') {
+        manifestPromise = null;
+        return;
+    }
+
+    const name = url.pathname.substring(url.pathname.lastIndexOf('/') + 1);
+    if (!ARTIFACT.test(name) || name === 'sw.js') {
+        return;
+    }
+    event.respondWith(serveArtifact(request, name));
+});